@@ -24,8 +24,10 @@ using asd_client::Asd_client;
 
 class ConnectionPool {
 public:
+  // tcp_kind: the transport for asds that don't use rdma
   ConnectionPool(std::unique_ptr<proxy_protocol::OsdInfo>, size_t,
-                 std::chrono::steady_clock::duration timeout);
+                 std::chrono::steady_clock::duration timeout,
+                 transport::Kind tcp_kind = transport::Kind::tcp);
 
   ~ConnectionPool();
 
@@ -54,6 +56,7 @@ private:
   size_t capacity_;
 
   std::chrono::steady_clock::duration timeout_;
+  transport::Kind tcp_kind_;
 
   std::unique_ptr<Asd_client> make_one_() const;
 
@@ -71,6 +74,9 @@ public:
   get_connection_pool(const proxy_protocol::OsdInfo &, int connection_pool_size,
                       std::chrono::steady_clock::duration timeout);
 
+  // only affects the pools created afterwards
+  void set_tcp_kind(transport::Kind);
+
   ConnectionPools() = default;
 
   ConnectionPools(const ConnectionPools &) = delete;
@@ -80,6 +86,7 @@ public:
 private:
   mutable std::mutex _mutex;
   std::map<std::string, std::unique_ptr<ConnectionPool>> connection_pools_;
+  transport::Kind tcp_kind_ = transport::Kind::tcp;
 };
 }
 }
@@ -6,6 +6,7 @@
 #pragma once
 
 #include "asd_protocol.h"
+#include "io_uring_transport.h"
 #include "transport.h"
 
 #include <boost/asio.hpp>
@@ -21,6 +22,9 @@ using std::string;
 using std::vector;
 using asd_protocol::slice;
 
+// all slices to read from one key
+typedef std::pair<string, vector<slice>> key_slices;
+
 struct asd_exception : std::exception {
   asd_exception(uint32_t return_code, std::string what)
       : _return_code(return_code), _what(what) {}
@@ -38,6 +42,21 @@ public:
              boost::optional<string> long_id);
 
   void partial_get(string &, vector<slice> &);
+
+  /* one PartialGet per key, all the slices of that key in one request.
+   * The asd doesn't support pipelining, so each request waits for the
+   * previous response.
+   */
+  void partial_get(vector<key_slices> &);
+
+  /* the same partial get, as a job for
+   * transport::IOUring_transport::run_batch, so the reads from several
+   * asds can share one ring. nullptr if this client isn't on io_uring.
+   * The batch has to stay put until the job is done.
+   */
+  std::unique_ptr<transport::IOUring_job>
+  partial_get_job(vector<key_slices> &);
+
   void set_slowness(asd_protocol::slowness_t &slowness);
   std::tuple<int32_t, int32_t, int32_t, std::string> get_version();
 
@@ -49,6 +68,13 @@ private:
   const std::chrono::steady_clock::duration _timeout;
   llio::message_builder _mb;
   void check_status(const char *function_name);
+  void _read_partial_get_response(vector<slice> &);
+  void _write_partial_get_request(key_slices &);
+
+  class _partial_get_job;
+
+  std::vector<char> _request;
+  std::vector<struct iovec> _iov;
 };
 }
 }
@@ -40,6 +40,8 @@ struct slice {
   uint32_t offset;
   uint32_t length;
   byte *target;
+
+  auto wire_fields() const { return std::tie(offset, length); }
 };
 
 extern const string _MAGIC;
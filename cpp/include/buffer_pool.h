@@ -0,0 +1,40 @@
+/*
+  Copyright (C) iNuron - info@openvstorage.com
+  This file is part of Open vStorage. For license information, see <LICENSE.txt>
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+
+namespace alba {
+namespace llio {
+
+/* thread local free lists of buffers, in power of 2 size classes
+ * from 64 bytes up to 1MiB. Bigger buffers bypass the pool.
+ * A buffer can be released on another thread than the one that
+ * allocated it; it then joins that thread's free list.
+ */
+
+// capacity is set to the real size of the buffer, >= size
+char *pool_allocate(size_t size, size_t &capacity);
+void pool_release(char *buffer, size_t capacity);
+
+struct buffer_pool_stats {
+  // allocations served from a free list, and those that needed new
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  // too big for the pool
+  uint64_t oversized = 0;
+  // releases that didn't fit in the free list anymore
+  uint64_t dropped = 0;
+};
+
+// totals over all threads
+buffer_pool_stats pool_stats();
+
+std::ostream &operator<<(std::ostream &, const buffer_pool_stats &);
+}
+}
@@ -0,0 +1,66 @@
+/*
+  Copyright (C) iNuron - info@openvstorage.com
+  This file is part of Open vStorage. For license information, see <LICENSE.txt>
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace alba {
+namespace erasure {
+
+/* Reed-Solomon over GF(2^8) (polynomial 0x11d), using the same coding
+ * matrix as the backend: jerasure's big vandermonde distribution matrix,
+ * applied with isa-l. The backend always encodes with w=8, whatever the
+ * preset says.
+ *
+ * The code works byte per byte, so any byte range of a missing fragment
+ * can be rebuilt from the same byte range of k other fragments of its chunk.
+ */
+class ReedSolomon {
+public:
+  ReedSolomon(uint32_t k, uint32_t m);
+
+  /* shared instance per (k, m), built once; there are only a handful of
+   * encoding schemes, so these are never dropped.
+   */
+  static const ReedSolomon &get(uint32_t k, uint32_t m);
+
+  uint32_t k() const { return _k; }
+  uint32_t m() const { return _m; }
+
+  /* fragments [0,k) are data, [k, k+m) parity.
+   * data & parity hold k and m pointers to buffers of len bytes.
+   */
+  void encode(const std::vector<const uint8_t *> &data,
+              const std::vector<uint8_t *> &parity, size_t len) const;
+
+  /* rebuild fragment_id out of the k fragments in sources
+   * (inputs[i] holds fragment sources[i]).
+   * returns false if sources doesn't allow it.
+   */
+  bool decode(uint32_t fragment_id, const std::vector<uint32_t> &sources,
+              const std::vector<const uint8_t *> &inputs, uint8_t *output,
+              size_t len) const;
+
+private:
+  uint32_t _k;
+  uint32_t _m;
+  // (k+m) x k, row major. The top k rows are the identity.
+  std::vector<uint8_t> _matrix;
+};
+
+uint8_t gf_mul(uint8_t a, uint8_t b);
+uint8_t gf_inv(uint8_t a);
+
+// dst ^= c * src
+void gf_mul_region_xor(uint8_t c, const uint8_t *src, uint8_t *dst,
+                       size_t len);
+
+// "avx2", "ssse3" or "scalar"; picked once at runtime
+const char *gf_kernel_name();
+}
+}
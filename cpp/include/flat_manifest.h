@@ -0,0 +1,153 @@
+/*
+  Copyright (C) iNuron - info@openvstorage.com
+  This file is part of Open vStorage. For license information, see <LICENSE.txt>
+*/
+
+#pragma once
+
+#include "manifest.h"
+
+#include <atomic>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace alba {
+namespace proxy_protocol {
+
+/* what the manifest cache keeps of a manifest: the parts needed to map
+ * an object range onto fragments, with the per chunk and per fragment
+ * data in a single allocation instead of a tree of shared_ptrs.
+ *
+ * chunk c covers [chunk_offset(c), chunk_offset(c + 1)) of the object,
+ * and has n_fragments(c) fragments. The fragment checksums and ctrs are
+ * kept serialized in a byte area at the end of the block. Fragment fnrs
+ * are not kept: nothing on the client side uses them.
+ */
+class FlatManifest {
+public:
+  explicit FlatManifest(ManifestWithNamespaceId &&mf);
+
+  FlatManifest(const FlatManifest &) = delete;
+  FlatManifest &operator=(const FlatManifest &) = delete;
+
+  std::string name;
+  std::string object_id;
+  namespace_t namespace_id;
+  EncodingScheme encoding_scheme;
+  bool uses_compression;
+  std::shared_ptr<EncryptInfo> encrypt_info;
+  std::unique_ptr<alba::Checksum> checksum;
+  uint64_t size;
+  uint32_t version_id;
+
+  uint32_t n_chunks() const { return _n_chunks; }
+
+  uint64_t chunk_offset(uint32_t c) const { return _chunk_offsets[c]; }
+
+  uint32_t chunk_size(uint32_t c) const {
+    return _chunk_offsets[c + 1] - _chunk_offsets[c];
+  }
+
+  // the chunk holding pos: a division if all chunks (but the last) have
+  // the same size, a binary search over the chunk offsets otherwise
+  uint32_t chunk_index(uint64_t pos) const;
+
+  uint32_t n_fragments(uint32_t c) const {
+    return _fragment_starts[c + 1] - _fragment_starts[c];
+  }
+
+  fragment_location_t fragment_location(uint32_t c, uint32_t f) const;
+  boost::optional<std::string> ctr(uint32_t c, uint32_t f) const;
+
+  // the packed size of the fragment
+  uint32_t fragment_length(uint32_t c, uint32_t f) const {
+    return _fragment(c, f).len;
+  }
+
+  // deserialized on every call
+  std::unique_ptr<alba::Checksum> fragment_checksum(uint32_t c,
+                                                   uint32_t f) const;
+
+  // the bytes this manifest holds on to (the encrypt info not included)
+  size_t memory_size() const;
+
+private:
+  // the checksum ends where the ctr starts, the ctr where the
+  // next fragment's checksum starts
+  struct fragment {
+    uint64_t osd; // _NO_OSD if the fragment isn't stored
+    uint32_t version;
+    uint32_t len;
+    uint32_t crc; // start in the byte area
+    uint32_t ctr; // idem
+  };
+  static const uint64_t _NO_OSD = UINT64_MAX;
+
+  uint32_t _n_chunks;
+  uint32_t _n_fragments;
+  // 0 if the chunk sizes differ
+  uint32_t _uniform_chunk_size;
+  size_t _block_size;
+  std::unique_ptr<uint64_t[]> _block;
+
+  // all of these point into _block
+  const uint64_t *_chunk_offsets;   // n_chunks + 1
+  const fragment *_fragments;       // n_fragments + 1
+  const uint32_t *_fragment_starts; // n_chunks + 1
+  const char *_bytes;
+
+  const fragment &_fragment(uint32_t c, uint32_t f) const {
+    return _fragments[_fragment_starts[c] + f];
+  }
+};
+
+// the location of (a prefix of) [pos, pos + len)
+Location get_location(const FlatManifest &, uint64_t pos, uint32_t len);
+
+// idem, but chunk is checked first: for callers walking up the object
+Location get_location(const FlatManifest &, uint64_t pos, uint32_t len,
+                      uint32_t chunk);
+
+std::ostream &operator<<(std::ostream &, const FlatManifest &);
+
+/* a manifest cache entry that holds on to the compressed manifest until
+ * the first read that needs it. The first get() uncompresses, decodes and
+ * flattens all of it; the result is kept and the compressed bytes are
+ * dropped.
+ *
+ * A manifest is one snappy frame, so every read uncompresses all of it.
+ * Version 1 lays its per chunk data out per attribute. Version 2 nests
+ * the fragments per chunk, so it could decode just the chunks a slice
+ * touches, but then the uncompressed bytes would have to stay around next
+ * to the decoded chunks, which is more than the flat form costs. Flattening
+ * it all once keeps the cache entry at one allocation.
+ */
+class LazyManifest {
+public:
+  LazyManifest(std::string name, std::unique_ptr<CompressedManifest> cmf);
+
+  LazyManifest(const LazyManifest &) = delete;
+  LazyManifest &operator=(const LazyManifest &) = delete;
+
+  const std::string name;
+
+  // throws llio::deserialisation_exception if the manifest doesn't decode
+  std::shared_ptr<const FlatManifest> get();
+
+  bool decoded();
+  size_t memory_size();
+
+  // nullptr once decoded: only use it before the entry is shared
+  const CompressedManifest *compressed() const { return _compressed.get(); }
+
+private:
+  std::mutex _mutex;
+  std::unique_ptr<CompressedManifest> _compressed;
+  // written once, before _decoded is set: after that, reads need no lock
+  std::shared_ptr<const FlatManifest> _flat;
+  std::atomic<bool> _decoded{false};
+};
+}
+}
@@ -7,6 +7,8 @@
 
 #include "proxy_client.h"
 
+#include <deque>
+
 namespace alba {
 namespace proxy_client {
 
@@ -57,6 +59,17 @@ public:
                        std::vector<proxy_protocol::object_info> &,
                        alba::statistics::RoraCounter &);
 
+  /* the reads are queued and one drain on the event loop sends them one
+   * at a time, each after the response to the one before: the proxy
+   * doesn't take pipelined requests. The other calls on this client have
+   * to wait until they're done. */
+  virtual std::future<void>
+  read_objects_slices_async(const std::string &namespace_,
+                            const std::vector<proxy_protocol::ObjectSlices> &,
+                            const consistent_read,
+                            alba::statistics::RoraCounter &,
+                            read_done_callback on_done = nullptr);
+
   virtual void write_object_fs2(const std::string &namespace_,
                                 const std::string &object_name,
                                 const std::string &input_file,
@@ -106,7 +119,7 @@ public:
   GenericProxy_client(const std::chrono::steady_clock::duration &timeout,
                       std::unique_ptr<transport::Transport> &&);
 
-  virtual ~GenericProxy_client(){};
+  virtual ~GenericProxy_client();
 
 protected:
   void init_();
@@ -122,6 +135,20 @@ protected:
   message_builder _mb;
 
   void check_status(const char *function_name);
+
+private:
+  struct pending_read;
+  typedef std::shared_ptr<pending_read> pending_read_ptr;
+
+  std::mutex _pipeline_mutex;
+  std::condition_variable _pipeline_cond;
+  std::deque<pending_read_ptr> _unsent;
+  bool _draining = false;
+
+  void _drain();
+  // after a transport error nothing on the connection can be trusted
+  void _fail_pipeline(pending_read_ptr current, std::exception_ptr);
+  static void _complete(pending_read &, std::exception_ptr);
 };
 }
 }
@@ -0,0 +1,91 @@
+/*
+  Copyright (C) iNuron - info@openvstorage.com
+  This file is part of Open vStorage. For license information, see <LICENSE.txt>
+*/
+
+#pragma once
+#include "transport.h"
+
+#include <exception>
+#include <memory>
+
+struct io_uring_sqe;
+
+namespace alba {
+namespace transport {
+
+namespace uring {
+class Ring;
+}
+
+class IOUring_transport;
+
+/* one connection's share of an IOUring_transport::run_batch.
+ * next() names the transfer to do next: it's called first, and again each
+ * time the previous transfer completed in full. It returns false when the
+ * job is done; throwing fails the job.
+ */
+class IOUring_job {
+public:
+  IOUring_job(IOUring_transport &transport) : transport(transport) {}
+  virtual ~IOUring_job() {}
+
+  virtual bool next(bool &send, std::vector<struct iovec> &iov) = 0;
+
+  IOUring_transport &transport;
+  // set by run_batch
+  std::exception_ptr error;
+  std::chrono::steady_clock::time_point finished;
+};
+
+/* a plain tcp socket, driven through io_uring instead of asio.
+ * Every thread has its own ring, shared by all the connections used from
+ * that thread. An operation and its deadline (a linked timeout) are
+ * submitted together, so each read_exact or write_exact is a single
+ * io_uring_enter, whether or not the socket was ready.
+ * The socket is registered with the ring it's used on (a fixed file),
+ * which saves the kernel a file lookup per operation.
+ */
+class IOUring_transport : public Transport {
+public:
+  IOUring_transport(const std::string &ip, const std::string &port,
+                    const std::chrono::steady_clock::duration &timeout);
+
+  ~IOUring_transport();
+
+  /* whether the calling thread can set up its ring (the kernel may not
+   * have io_uring, or not allow it) */
+  static bool supported();
+
+  void
+  expires_from_now(const std::chrono::steady_clock::duration &timeout) override;
+
+  void write_exact(const char *buf, int len) override;
+  void read_exact(char *buf, int len) override;
+
+  void writev_exact(const struct iovec *iov, int iovcnt) override;
+  void readv_exact(const struct iovec *iov, int iovcnt) override;
+
+  /* drives the jobs together on the calling thread's ring: every
+   * io_uring_enter submits the next transfer of all the jobs that are
+   * ready for one and reaps whatever completed, so n connections cost
+   * about as many syscalls as one. A job that fails gets its error set
+   * and its transport closed; the others carry on.
+   */
+  static void run_batch(const std::vector<IOUring_job *> &jobs);
+
+private:
+  int _socket;
+  std::chrono::steady_clock::duration _timeout;
+
+  // the ring the socket is registered with, and where
+  std::weak_ptr<uring::Ring> _ring;
+  uint64_t _ring_id;
+  int _slot;
+
+  void _target(uring::Ring &, io_uring_sqe *);
+  void _unregister();
+  void _close();
+};
+}
+}
@@ -5,14 +5,23 @@
 
 #pragma once
 #include "alba_logger.h"
+#include "buffer_pool.h"
 #include "stuff.h"
+#include <algorithm>
+#include <atomic>
+#include <boost/intrusive_ptr.hpp>
 #include <boost/optional.hpp>
+#include <boost/utility/string_ref.hpp>
 #include <istream>
 #include <memory>
+#include <new>
 #include <ostream>
 #include <sstream>
 #include <string.h>
 #include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace alba {
@@ -44,40 +53,52 @@ struct deserialisation_exception : virtual std::exception {
 
 void check_stream(const std::istream &is);
 
+class message_buffer;
+typedef boost::intrusive_ptr<message_buffer> message_buffer_ptr;
+
+/* the header and the data share one buffer out of the buffer pool,
+ * and the reference count is intrusive: a message_buffer costs no
+ * allocation once the pool is warm. */
 class message_buffer {
 public:
-  template <typename R>
-  static std::shared_ptr<message_buffer> from_reader(R &&reader) {
+  template <typename R> static message_buffer_ptr from_reader(R &&reader) {
     uint32_t size;
     reader((char *)&size, sizeof(uint32_t));
-    auto r = std::shared_ptr<message_buffer>(new message_buffer(size));
+    auto r = _create(size);
     reader(r->_data, size);
     return r;
   }
 
   template <typename R>
-  static std::shared_ptr<message_buffer> from_reader_know_size(R &&reader,
-                                                               size_t size) {
+  static message_buffer_ptr from_reader_know_size(R &&reader, size_t size) {
     size_t real_size = 4 + size;
-    auto r = std::shared_ptr<message_buffer>(new message_buffer(real_size));
+    auto r = _create(real_size);
     r->_start = 4;
     reader(r->_data, real_size);
     return r;
   }
 
-  static std::shared_ptr<message_buffer> from_istream(std::istream &is) {
+  // the size has been read already: only reads the payload
+  template <typename R>
+  static message_buffer_ptr from_reader_sized(R &&reader, uint32_t size) {
+    auto r = _create(size);
+    reader(r->_data, size);
+    return r;
+  }
+
+  static message_buffer_ptr from_istream(std::istream &is) {
     uint32_t size;
     is.read((char *)&size, 4);
     check_stream(is);
-    auto r = std::shared_ptr<message_buffer>(new message_buffer(size));
+    auto r = _create(size);
     is.read(r->_data, size);
     check_stream(is);
     return r;
   }
 
-  static std::shared_ptr<message_buffer> from_string(std::string &s) {
+  static message_buffer_ptr from_string(std::string &s) {
     size_t size = s.size();
-    auto r = std::shared_ptr<message_buffer>(new message_buffer(size));
+    auto r = _create(size);
     ALBA_LOG(DEBUG, "copying " << size << " bytes");
     memcpy(r->_data, s.data(), size);
     return r;
@@ -87,30 +108,52 @@ public:
 
   size_t size() { return _size; }
 
-  ~message_buffer() { delete[] _data; }
+  message_buffer(const message_buffer &) = delete;
+  message_buffer &operator=(const message_buffer &) = delete;
 
 private:
+  std::atomic<uint32_t> _refcount;
   char *_data;
   size_t _size;
   size_t _start;
-  message_buffer(size_t size) {
-    _data = new char[size];
-    _size = size;
-    _start = 0;
+  size_t _capacity;
+
+  message_buffer(char *data, size_t size, size_t capacity)
+      : _refcount(0), _data(data), _size(size), _start(0),
+        _capacity(capacity) {}
+
+  static message_buffer_ptr _create(size_t size) {
+    size_t capacity;
+    char *block = pool_allocate(sizeof(message_buffer) + size, capacity);
+    auto r = new (block)
+        message_buffer(block + sizeof(message_buffer), size, capacity);
+    return message_buffer_ptr(r);
+  }
+
+  friend void intrusive_ptr_add_ref(message_buffer *b) {
+    b->_refcount.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  friend void intrusive_ptr_release(message_buffer *b) {
+    if (b->_refcount.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      size_t capacity = b->_capacity;
+      b->~message_buffer();
+      pool_release((char *)b, capacity);
+    }
   }
 };
 
 class message { // a VIEW on a message_buffer
 
 public:
-  message(std::shared_ptr<message_buffer> mb) {
+  message(message_buffer_ptr mb) {
     _mb = mb;
     _initial_offset = 0;
     _pos = 0;
     _size = mb->size();
   }
 
-  message(std::shared_ptr<message_buffer> mb, size_t offset, size_t size) {
+  message(message_buffer_ptr mb, size_t offset, size_t size) {
     _mb = mb;
     _initial_offset = offset;
     _pos = offset;
@@ -149,7 +192,7 @@ public:
   }
 
 private:
-  std::shared_ptr<message_buffer> _mb;
+  message_buffer_ptr _mb;
   size_t _pos;
   size_t _initial_offset;
   size_t _size;
@@ -161,17 +204,32 @@ std::ostream &operator<<(std::ostream &, const message &);
 
 class message_builder {
 public:
-  message_builder() : _size(_SIZE0), _buffer{new char[_SIZE0]}, _pos(4) {
+  message_builder() : _pos(4) {
+    size_t capacity;
+    _buffer = pool_allocate(_SIZE0, capacity);
+    _size = capacity;
     // keep valgrind happy:
     uint32_t *p = (uint32_t *)_buffer;
     p[0] = 0;
   }
 
+  /* the writer is called once per contiguous part:
+   * once, unless there are external parts. */
   template <typename W> void output_using(W &&writer) {
-    uint32_t size = _pos - 4;
+    uint32_t size = _pos - 4 + _external_size;
     uint32_t *p = (uint32_t *)_buffer;
     p[0] = size;
-    writer(_buffer, _pos);
+    uint32_t from = 0;
+    for (auto &e : _externals) {
+      if (e.pos > from) {
+        writer(&_buffer[from], e.pos - from);
+      }
+      writer(e.data, e.len);
+      from = e.pos;
+    }
+    if (_pos > from) {
+      writer(&_buffer[from], _pos - from);
+    }
   }
 
   void output(std::ostream &os) {
@@ -190,42 +248,94 @@ public:
       uint new_size = _size + std::max(len, _size);
       ALBA_LOG(DEBUG, free << " < " << len << " => grow from " << _size
                            << " to " << new_size);
-      char *new_buffer = new char[new_size];
-      memcpy(new_buffer, _buffer, _pos);
-      _size = new_size;
-      delete[] _buffer;
-      _buffer = new_buffer;
+      _grow(new_size);
     }
     memcpy(&_buffer[_pos], b, len);
     _pos += len;
   }
 
+  // makes room for len more bytes in one go
+  void reserve(uint32_t len) noexcept {
+    if (_size - _pos < len) {
+      _grow(_pos + len);
+    }
+  }
+
+  /* adds len bytes by reference instead of copying them:
+   * b needs to stay valid until the message has been output. */
+  void add_external(const char *b, uint32_t len) {
+    _externals.push_back(external{_pos, b, len});
+    _external_size += len;
+  }
+
+  bool has_external() const noexcept { return !_externals.empty(); }
+
   void add_type(const uint8_t i) noexcept {
     const char *ip = (const char *)(&i);
     add_raw(ip, 1);
   }
 
-  std::string as_string() noexcept { return std::string(_buffer, _pos); }
+  std::string as_string() {
+    if (_externals.empty()) {
+      return std::string(_buffer, _pos);
+    }
+    std::string r;
+    r.reserve(_pos + _external_size);
+    output_using([&](const char *b, const int len) { r.append(b, len); });
+    return r;
+  }
 
-  std::string as_string_no_size() noexcept {
-    return std::string(&_buffer[4], _pos - 4);
+  std::string as_string_no_size() {
+    if (_externals.empty()) {
+      return std::string(&_buffer[4], _pos - 4);
+    }
+    return as_string().substr(4);
+  }
+
+  void reset() noexcept {
+    _pos = 4;
+    _externals.clear();
+    _external_size = 0;
   }
 
-  void reset() noexcept { _pos = 4; }
+  ~message_builder() { pool_release(_buffer, _size); }
 
-  ~message_builder() { delete[] _buffer; }
+  message_builder(const message_builder &) = delete;
+  message_builder &operator=(const message_builder &) = delete;
 
 private:
   uint32_t _size;
   char *_buffer;
   uint32_t _pos = 0;
   static const uint32_t _SIZE0 = 32;
+
+  void _grow(uint32_t new_size) noexcept {
+    size_t capacity;
+    char *new_buffer = pool_allocate(new_size, capacity);
+    memcpy(new_buffer, _buffer, _pos);
+    pool_release(_buffer, _size);
+    _size = capacity;
+    _buffer = new_buffer;
+  }
+
+  struct external {
+    uint32_t pos; // in _buffer, where it goes
+    const char *data;
+    uint32_t len;
+  };
+  std::vector<external> _externals;
+  uint32_t _external_size = 0;
 };
 
 template <typename T> void to(message_builder &mb, const T &) noexcept;
 
 template <typename T> void from(message &m, T &t);
 
+/* a string_ref points into the message's buffer instead of copying:
+ * it's only valid as long as the message (or a copy of it) is alive.
+ */
+template <> void from(message &m, boost::string_ref &s);
+
 /*
   ok_to_continue:
     in case of a deserialization exception,
@@ -252,19 +362,44 @@ struct varint_t {
   uint64_t j;
 };
 
-template <typename T> void from(message &m, std::vector<T> &ts) noexcept {
+/* types that are serialized as their in memory representation,
+ * so a vector of them can be decoded with a single memcpy */
+template <typename T> struct is_raw_wire : std::false_type {};
+template <> struct is_raw_wire<uint8_t> : std::true_type {};
+template <> struct is_raw_wire<uint32_t> : std::true_type {};
+template <> struct is_raw_wire<int32_t> : std::true_type {};
+template <> struct is_raw_wire<uint64_t> : std::true_type {};
+template <> struct is_raw_wire<double> : std::true_type {};
 
-  uint32_t size;
-  from(m, size);
+template <typename T>
+void _from_vector(message &m, std::vector<T> &ts, uint32_t size,
+                  std::true_type) {
+  size_t len = size * sizeof(T);
+  const char *b = m.current(len);
   ts.resize(size);
+  memcpy(ts.data(), b, len);
+  // the elements are on the wire last to first
+  std::reverse(ts.begin(), ts.end());
+  m.skip(len);
+}
 
+template <typename T>
+void _from_vector(message &m, std::vector<T> &ts, uint32_t size,
+                  std::false_type) {
+  ts.clear();
+  ts.resize(size);
   for (int32_t i = size - 1; i >= 0; --i) {
-    T t;
-    from(m, t);
-    ts[i] = t;
+    from(m, ts[i]);
   }
 }
 
+template <typename T> void from(message &m, std::vector<T> &ts) noexcept {
+
+  uint32_t size;
+  from(m, size);
+  _from_vector(m, ts, size, is_raw_wire<T>());
+}
+
 template <typename X, typename Y>
 void to(message_builder &mb, const std::pair<X, Y> &p) noexcept {
   to(mb, p.first);
@@ -315,5 +450,137 @@ template <typename X>
 void to(message_builder &mb, const std::unique_ptr<X> &x) noexcept {
   to(mb, *x);
 }
+
+/* field descriptors: a struct that declares its wire fields once, as
+ *
+ *   auto wire_fields() const { return std::tie(a, b, c); }
+ *
+ * (and a non const version if it's also read) gets to_fields, from_fields
+ * and serialized_size. Its to/from specializations just call those.
+ */
+template <typename Tuple, typename F, size_t... I>
+void _for_each_field(Tuple &&t, F &&f, std::index_sequence<I...>) {
+  (void)std::initializer_list<int>{(f(std::get<I>(t)), 0)...};
+}
+
+template <typename Tuple, typename F> void for_each_field(Tuple &&t, F &&f) {
+  _for_each_field(
+      t, f,
+      std::make_index_sequence<std::tuple_size<std::decay_t<Tuple>>::value>());
+}
+
+/* the number of bytes to(mb, x) adds.
+ * wire_size<T> is that size if it's the same for all T, 0 otherwise.
+ */
+template <typename T, typename = void> struct wire_size {
+  static constexpr size_t value = is_raw_wire<T>::value ? sizeof(T) : 0;
+};
+template <> struct wire_size<bool> { static constexpr size_t value = 1; };
+
+template <typename... Ts> struct _fixed_sum;
+template <> struct _fixed_sum<> { static constexpr size_t value = 0; };
+template <typename T, typename... Ts> struct _fixed_sum<T, Ts...> {
+  static constexpr size_t head = wire_size<std::decay_t<T>>::value;
+  static constexpr size_t tail = _fixed_sum<Ts...>::value;
+  static constexpr size_t value = (head == 0 || (tail == 0 && sizeof...(Ts)))
+                                      ? 0
+                                      : head + tail;
+};
+
+template <typename Tuple> struct _tuple_wire_size;
+template <typename... Ts> struct _tuple_wire_size<std::tuple<Ts...>> {
+  static constexpr size_t value = _fixed_sum<Ts...>::value;
+};
+
+template <typename T>
+using wire_fields_t = decltype(std::declval<const T &>().wire_fields());
+
+template <typename T>
+struct wire_size<T, decltype((void)std::declval<wire_fields_t<T>>())> {
+  static constexpr size_t value = _tuple_wire_size<wire_fields_t<T>>::value;
+};
+
+inline size_t serialized_size(const bool &) { return 1; }
+
+template <typename T>
+constexpr typename std::enable_if<is_raw_wire<T>::value, size_t>::type
+serialized_size(const T &) {
+  return sizeof(T);
+}
+
+inline size_t serialized_size(const std::string &s) { return 4 + s.size(); }
+
+template <typename T>
+auto serialized_size(const T &t) -> decltype(t.wire_fields(), size_t());
+template <typename T> size_t serialized_size(const std::vector<T> &ts);
+template <typename X, typename Y>
+size_t serialized_size(const std::pair<X, Y> &p);
+template <typename X> size_t serialized_size(const boost::optional<X> &xo);
+
+template <typename T>
+auto serialized_size(const T &t) -> decltype(t.wire_fields(), size_t()) {
+  if (wire_size<T>::value != 0) {
+    return wire_size<T>::value;
+  }
+  size_t size = 0;
+  for_each_field(t.wire_fields(),
+                 [&](const auto &x) { size += serialized_size(x); });
+  return size;
+}
+
+template <typename T> size_t serialized_size(const std::vector<T> &ts) {
+  if (wire_size<T>::value != 0) {
+    return 4 + ts.size() * wire_size<T>::value;
+  }
+  size_t size = 4;
+  for (auto &t : ts) {
+    size += serialized_size(t);
+  }
+  return size;
+}
+
+template <typename X, typename Y>
+size_t serialized_size(const std::pair<X, Y> &p) {
+  return serialized_size(p.first) + serialized_size(p.second);
+}
+
+template <typename X> size_t serialized_size(const boost::optional<X> &xo) {
+  return 1 + (xo == boost::none ? 0 : serialized_size(*xo));
+}
+
+template <typename T>
+void _to_fields(message_builder &mb, const T &t, std::false_type) noexcept {
+  for_each_field(t.wire_fields(), [&](const auto &x) { to(mb, x); });
+}
+
+// fixed size records are assembled on the stack and added in one go
+template <typename T>
+void _to_fields(message_builder &mb, const T &t, std::true_type) noexcept {
+  char buffer[wire_size<T>::value];
+  char *p = buffer;
+  for_each_field(t.wire_fields(), [&](const auto &x) {
+    memcpy(p, &x, sizeof(x));
+    p += sizeof(x);
+  });
+  mb.add_raw(buffer, sizeof(buffer));
+}
+
+template <typename T> void to_fields(message_builder &mb, const T &t) noexcept {
+  _to_fields(mb, t, std::integral_constant<bool, wire_size<T>::value != 0>());
+}
+
+template <typename T> void from_fields(message &m, T &t) {
+  for_each_field(t.wire_fields(), [&](auto &x) { from(m, x); });
+}
+
+/* writes all the values, after making room for all of them:
+ * the builder grows at most once. */
+template <typename... Ts>
+void to_all(message_builder &mb, const Ts &... ts) noexcept {
+  size_t size = 0;
+  (void)std::initializer_list<size_t>{(size += serialized_size(ts))...};
+  mb.reserve(size);
+  (void)std::initializer_list<int>{(to(mb, ts), 0)...};
+}
 }
 }
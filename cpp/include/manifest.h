@@ -62,6 +62,9 @@ typedef std::pair<boost::optional<osd_t>, uint32_t> fragment_location_t;
 
 template <class T> using layout = std::vector<std::vector<T>>;
 
+struct ManifestWithNamespaceId;
+class FlatManifest;
+
 struct Location {
   namespace_t namespace_id;
   std::string object_id;
@@ -74,6 +77,10 @@ struct Location {
   bool uses_compression;
   std::shared_ptr<EncryptInfo> encrypt_info;
   boost::optional<std::string> ctr;
+
+  // where the location was resolved from; needed to rebuild it out of the
+  // other fragments of its chunk
+  std::shared_ptr<const FlatManifest> manifest;
 };
 
 struct Fragment {
@@ -114,6 +121,21 @@ struct ManifestWithNamespaceId : Manifest {
   ManifestWithNamespaceId(const ManifestWithNamespaceId &) = delete;
 };
 
+/* a manifest as it came over the wire: still compressed, and only
+ * decoded when someone needs it */
+struct CompressedManifest {
+  uint8_t version;
+  std::string compressed;
+  namespace_t namespace_id;
+
+  size_t memory_size() const {
+    return sizeof(CompressedManifest) + compressed.capacity();
+  }
+};
+
+// throws llio::deserialisation_exception
+void decode(const CompressedManifest &, ManifestWithNamespaceId &);
+
 void dump_string(std::ostream &, const std::string &);
 void dump_string_option(std::ostream &, const boost::optional<std::string> &);
 
@@ -8,10 +8,13 @@
 #include "asd_access.h"
 #include "osd_info.h"
 #include "proxy_client.h"
+#include "worker_pool.h"
+#include <atomic>
 #include <condition_variable>
 #include <map>
 #include <memory>
 #include <mutex>
+#include <set>
 #include <vector>
 
 namespace alba {
@@ -47,15 +50,43 @@ public:
 
   bool update(Proxy_client &client);
 
+  /* reads the slices for all osds.
+   * returns 0 on success, -1 on failure and -2 when an asd was disqualified.
+   * With a fan out concurrency > 1, the per osd reads are issued in parallel,
+   * and the first failure stops the dispatch of the remaining osds.
+   * On the io_uring transport, the per osd reads all go through the calling
+   * thread's ring together instead (see IOUring_transport::run_batch).
+   */
   int read_osds_slices(std::map<osd_t, std::vector<asd_slice>> &);
 
+  /* same, but also reports the osds whose slices were not (all) read,
+   * be it because of a failure or because the read was abandoned.
+   * Once *cancelled is set, no more osds are started on; the ones that
+   * weren't read count as unread.
+   */
+  int read_osds_slices(std::map<osd_t, std::vector<asd_slice>> &,
+                       std::set<osd_t> &unread_osds,
+                       const std::atomic<bool> *cancelled = nullptr);
+
+  void set_fan_out_concurrency(int concurrency);
+
+  // the transport for asds that don't use rdma (tcp or io_uring)
+  void set_asd_transport(transport::Kind kind);
+
+  /* the given percentile (in [0,1]) of the recent read latencies of the
+   * slowest of these osds. Osds without enough history count for the
+   * partial read timeout. */
+  std::chrono::steady_clock::duration
+  latency_percentile(const std::set<osd_t> &osds, double percentile);
+
   std::vector<alba_id_t> get_alba_levels(Proxy_client &client);
 
 private:
   OsdAccess(int connection_pool_size,
             std::chrono::steady_clock::duration timeout)
       : _connection_pool_size(connection_pool_size), _timeout(timeout),
-        _filling(false) {}
+        _filling(false), _fan_out_concurrency(1),
+        _asd_transport(transport::Kind::tcp) {}
 
   int _connection_pool_size;
   std::chrono::steady_clock::duration _timeout;
@@ -69,11 +100,37 @@ private:
 
   int _read_osd_slices_asd_direct_path(osd_t osd,
                                        std::vector<asd_slice> &slices);
+  int _partial_get(osd_t osd, asd::ConnectionPool &pool,
+                   std::unique_ptr<asd::Asd_client> connection,
+                   std::vector<asd_client::key_slices> &batch);
   asd::ConnectionPools asd_connection_pools;
 
   std::atomic<bool> _filling;
   std::mutex _filling_mutex;
   std::condition_variable _filling_cond;
+
+  std::mutex _fan_out_mutex;
+  int _fan_out_concurrency;
+  std::shared_ptr<workers::WorkerPool> _fan_out_pool;
+
+  std::atomic<transport::Kind> _asd_transport;
+
+  // a ring of the most recent successful read durations, per osd
+  struct latency_window {
+    std::vector<std::chrono::steady_clock::duration> samples;
+    size_t next = 0;
+  };
+  std::mutex _latency_mutex;
+  std::map<osd_t, latency_window> _latencies;
+  void _record_latency(osd_t, std::chrono::steady_clock::duration);
+
+  int _read_osds_slices_parallel(
+      std::vector<std::pair<osd_t, std::vector<asd_slice> *>> &,
+      std::shared_ptr<workers::WorkerPool> &, int concurrency,
+      std::set<osd_t> &unread_osds, const std::atomic<bool> *cancelled);
+
+  int _read_osds_slices_batched(std::map<osd_t, std::vector<asd_slice>> &,
+                                std::set<osd_t> &unread_osds);
 };
 
 std::ostream &operator<<(std::ostream &, const asd_slice &);
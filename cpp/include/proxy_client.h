@@ -13,7 +13,12 @@
 
 #include <boost/asio.hpp>
 #include <chrono>
+#include <exception>
+#include <functional>
+#include <future>
+#include <condition_variable>
 #include <iosfwd>
+#include <mutex>
 #include <vector>
 
 namespace alba {
@@ -29,19 +34,65 @@ struct proxy_exception : std::exception {
   virtual const char *what() const noexcept { return _what.c_str(); }
 };
 
+// how the manifest cache picks what to evict
+enum class manifest_cache_policy { lru, w_tinylfu };
+std::ostream &operator<<(std::ostream &, manifest_cache_policy);
+std::istream &operator>>(std::istream &, manifest_cache_policy &);
+
 struct RoraConfig {
   RoraConfig(const size_t size = 10000, const bool null_io = false,
              const int asd_connection_pool_size = 5,
-             const int asd_partial_read_timeout_milliseconds = 25)
+             const int asd_partial_read_timeout_milliseconds = 25,
+             const int asd_fan_out_concurrency = 1,
+             const double hedge_percentile = 0.0,
+             const int tcp_reactor_threads = 0,
+             const transport::Kind asd_transport = transport::Kind::tcp,
+             const size_t manifest_cache_bytes = 0,
+             const manifest_cache_policy manifest_cache_policy_ =
+                 manifest_cache_policy::lru,
+             const std::string &manifest_store_path = "",
+             const size_t manifest_store_bytes = 256 << 20)
       : manifest_cache_size(size), use_null_io(null_io),
         asd_connection_pool_size(asd_connection_pool_size),
         asd_partial_read_timeout_milliseconds(
-            asd_partial_read_timeout_milliseconds) {}
-
+            asd_partial_read_timeout_milliseconds),
+        asd_fan_out_concurrency(asd_fan_out_concurrency),
+        hedge_percentile(hedge_percentile),
+        tcp_reactor_threads(tcp_reactor_threads),
+        asd_transport(asd_transport),
+        manifest_cache_bytes(manifest_cache_bytes),
+        manifest_cache_policy_(manifest_cache_policy_),
+        manifest_store_path(manifest_store_path),
+        manifest_store_bytes(manifest_store_bytes) {}
+
+  // max number of cached manifests, over all namespaces
   size_t manifest_cache_size;
   bool use_null_io;
   int asd_connection_pool_size;
   int asd_partial_read_timeout_milliseconds;
+  // max number of asds read from in parallel for one read_objects_slices.
+  // 1 means one asd after the other.
+  int asd_fan_out_concurrency;
+  // when a fast path read takes longer than this percentile (in [0,1]) of
+  // the recent reads on its asds, the same read is also sent to the proxy,
+  // and the first answer is used. 0 disables hedging.
+  // The proxy side of a hedge lands in a staging buffer first.
+  double hedge_percentile;
+  // number of threads the tcp connections made from now on share.
+  // 0 gives every connection its own io_service.
+  int tcp_reactor_threads;
+  // how to reach the asds that don't use rdma: TCP or IO_URING
+  transport::Kind asd_transport;
+  // the memory the cached manifests may take, over all namespaces.
+  // 0 means only manifest_cache_size limits the cache.
+  size_t manifest_cache_bytes;
+  // w_tinylfu keeps scans from flushing the manifests that are read often
+  manifest_cache_policy manifest_cache_policy_;
+  // a file to keep the cached manifests in over restarts ("" = don't).
+  std::string manifest_store_path;
+  // the manifests the file holds at most. 0 means no limit: then it grows
+  // with every object ever read.
+  size_t manifest_store_bytes;
 
   // RoraConfig &operator=(const RoraConfig &) = delete;
   // RoraConfig(const RoraConfig&) = delete;
@@ -59,6 +110,9 @@ BOOLEAN_ENUM(write_barrier)
 
 using namespace proxy_protocol;
 
+// gets the exception the read failed with, or nullptr
+typedef std::function<void(std::exception_ptr)> read_done_callback;
+
 class Proxy_client {
 public:
   virtual bool namespace_exists(const std::string &name) = 0;
@@ -101,10 +155,36 @@ public:
                       const consistent_read,
                       alba::statistics::RoraCounter &) = 0;
 
+  /* read_objects_slices, without waiting for it: the read is finished on
+   * the shared event loop and the future is ready when it's done. on_done,
+   * when given, is called from the loop just before that.
+   * The i/o underneath is still blocking: a read takes one loop thread
+   * while it runs, so no more reads make progress at once than the loop
+   * has threads. The rest wait in its queue.
+   * The object names, the buffers and the counter have to stay alive until
+   * then, and a counter can't be shared by reads in flight. Destroying the
+   * client waits for the reads it still has in flight.
+   */
+  virtual std::future<void>
+  read_objects_slices_async(const std::string &namespace_,
+                            const std::vector<proxy_protocol::ObjectSlices> &,
+                            const consistent_read,
+                            alba::statistics::RoraCounter &,
+                            read_done_callback on_done = nullptr);
+
   virtual std::tuple<uint64_t, Checksum *>
   get_object_info(const std::string &namespace_, const std::string &object_name,
                   const consistent_read, const should_cache) = 0;
 
+  /* gets the manifests of these objects into the manifest cache, in the
+   * background, so the first reads of them don't need the proxy. The
+   * future is ready when that's done. Objects that can't be fetched are
+   * skipped. A client without a manifest cache has nothing to do.
+   */
+  virtual std::future<void>
+  prefetch_manifests(const std::string &namespace_,
+                     const std::vector<std::string> &object_names);
+
   virtual void
   apply_sequence(const std::string &namespace_, const write_barrier,
                  const std::vector<std::shared_ptr<sequences::Assert>> &,
@@ -147,6 +227,22 @@ public:
   virtual boost::optional<string>
   get_fragment_encryption_key(const string &alba_id,
                               const namespace_t namespace_id) = 0;
+
+protected:
+  std::future<void> _run_async(std::function<void()> read,
+                               read_done_callback on_done);
+
+  // waits for the reads _run_async started. The most derived destructor
+  // calls this, before the members those reads use are gone.
+  void _drain_async();
+
+private:
+  // the default read_objects_slices_async can't overlap reads
+  std::mutex _async_mutex;
+
+  std::mutex _outstanding_mutex;
+  std::condition_variable _outstanding_cond;
+  size_t _outstanding = 0;
 };
 
 /* API backward compatibility:
@@ -10,6 +10,7 @@
 #include "manifest.h"
 #include "osd_info.h"
 #include "proxy_sequences.h"
+#include "transport.h"
 
 namespace alba {
 namespace proxy_protocol {
@@ -48,18 +49,22 @@ struct SliceDescriptor {
   byte *buf;
   const uint64_t offset;
   const uint32_t size;
+
+  auto wire_fields() const { return std::tie(offset, size); }
 };
 
 struct ObjectSlices {
   const std::string &object_name;
   const std::vector<SliceDescriptor> slices;
+
+  auto wire_fields() const { return std::tie(object_name, slices); }
 };
 
 std::ostream &operator<<(std::ostream &, const SliceDescriptor &);
 std::ostream &operator<<(std::ostream &, const ObjectSlices &);
 
-typedef std::tuple<std::string, alba_id_t,
-                   std::unique_ptr<ManifestWithNamespaceId>>
+// the manifest is left compressed: see LazyManifest
+typedef std::tuple<std::string, alba_id_t, std::unique_ptr<CompressedManifest>>
     object_info;
 
 using std::string;
@@ -145,6 +150,17 @@ void read_read_objects_slices2_response(message &m, Status &status,
                                         const std::vector<ObjectSlices> &dest,
                                         std::vector<object_info> &object_infos);
 
+/* same, but decoding the response while it's read from the transport:
+ * the slice data goes straight into dest, and only the status and the
+ * object infos are buffered. */
+void read_read_objects_slices_response(transport::Transport &transport,
+                                       Status &status,
+                                       const std::vector<ObjectSlices> &dest);
+void read_read_objects_slices2_response(transport::Transport &transport,
+                                        Status &status,
+                                        const std::vector<ObjectSlices> &dest,
+                                        std::vector<object_info> &object_infos);
+
 void write_update_session_request(
     message_builder &mb,
     const std::vector<std::pair<std::string, boost::optional<std::string>>>
@@ -109,10 +109,11 @@ class UpdateUploadObject final : public Update {
 public:
   /* creates an upload from supplied buffer.
    * The data buffer needs to be kept alive by the user until
-   * Proxy_client::apply_sequence is called.
+   * Proxy_client::apply_sequence returns.
    *
    * performance note:
-   *    when this update is serialized, there will be a copy of the data.
+   *    the data is not copied when this update is serialized,
+   *    it's sent straight from the supplied buffer.
    *
    */
   UpdateUploadObject(const std::string &name, const uint8_t *data,
@@ -123,7 +124,7 @@ public:
     mb.add_type(2);
     llio::to(mb, _name);
     llio::to(mb, _size);
-    mb.add_raw((const char *)_data, _size); // copies
+    mb.add_external((const char *)_data, _size);
     if (_cs_o == nullptr) {
       llio::to<boost::optional<const Checksum *>>(mb, boost::none);
     } else {
@@ -19,6 +19,9 @@ public:
   void write_exact(const char *buf, int len) override;
   void read_exact(char *buf, int len) override;
 
+  void writev_exact(const struct iovec *iov, int iovcnt) override;
+  void readv_exact(const struct iovec *iov, int iovcnt) override;
+
   RDMA_transport(const std::string &ip, const std::string &port,
                  const std::chrono::steady_clock::duration &timeout);
 
@@ -26,6 +29,9 @@ private:
   int _socket;
 
   std::chrono::steady_clock::time_point _deadline;
+
+  // waits until the socket is ready for events, or throws
+  void _poll(short events, const char *what);
 };
 }
 }
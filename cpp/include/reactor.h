@@ -0,0 +1,112 @@
+/*
+  Copyright (C) iNuron - info@openvstorage.com
+  This file is part of Open vStorage. For license information, see <LICENSE.txt>
+*/
+
+#pragma once
+
+#include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include <chrono>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace alba {
+namespace transport {
+
+/* hashed timer wheel on top of a single steady_timer.
+ * Timers are rounded up to the tick, and the timer only ticks while
+ * there is something scheduled.
+ * Callbacks run on the io_service thread while holding the wheel's lock:
+ * once cancel() returns, the callback is not running and never will.
+ * Consequently, a callback must not schedule or cancel timers itself.
+ */
+class TimerWheel {
+public:
+  typedef uint64_t timer_id;
+
+  TimerWheel(boost::asio::io_service &io_service,
+             const std::chrono::milliseconds &tick, size_t n_slots = 512);
+
+  TimerWheel(const TimerWheel &) = delete;
+  TimerWheel &operator=(const TimerWheel &) = delete;
+
+  timer_id schedule(const std::chrono::steady_clock::duration &after,
+                    std::function<void()> callback);
+
+  // false if the callback already ran
+  bool cancel(timer_id id);
+
+  size_t pending();
+
+private:
+  struct entry {
+    timer_id id;
+    uint64_t rounds;
+    std::function<void()> callback;
+  };
+  typedef std::list<entry> slot;
+
+  std::mutex _mutex;
+  boost::asio::steady_timer _timer;
+  const std::chrono::milliseconds _tick;
+  std::vector<slot> _slots;
+  std::unordered_map<timer_id, std::pair<size_t, slot::iterator>> _index;
+  size_t _current = 0;
+  timer_id _next_id = 1;
+  bool _ticking = false;
+
+  void _arm();
+  void _on_tick(const boost::system::error_code &ec);
+};
+
+/* one io_service, drained by one thread, with a timer wheel for the
+ * deadlines of the sockets living on it.
+ */
+class Reactor {
+public:
+  Reactor(const std::chrono::milliseconds &tick);
+  ~Reactor();
+
+  Reactor(const Reactor &) = delete;
+  Reactor &operator=(const Reactor &) = delete;
+
+  boost::asio::io_service &io_service() { return _io_service; }
+  TimerWheel &timers() { return _timers; }
+
+private:
+  boost::asio::io_service _io_service;
+  std::unique_ptr<boost::asio::io_service::work> _work;
+  TimerWheel _timers;
+  std::thread _thread;
+};
+
+/* the process wide set of reactors tcp connections are spread over.
+ * With size 0 (the default) every connection has its own io_service.
+ */
+class Reactors {
+public:
+  static Reactors &getInstance();
+
+  // only affects connections made afterwards
+  void set_size(size_t n);
+  size_t size();
+
+  // round robin; nullptr when disabled
+  std::shared_ptr<Reactor> next();
+
+private:
+  Reactors() = default;
+
+  std::mutex _mutex;
+  std::vector<std::shared_ptr<Reactor>> _reactors;
+  size_t _next = 0;
+};
+}
+}
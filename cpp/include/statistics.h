@@ -16,8 +16,25 @@ using namespace std::chrono;
 struct RoraCounter {
   uint64_t fast_path;
   uint64_t slow_path;
+  // fast path reads that had to be rebuilt from other fragments
+  uint64_t degraded;
+  // fast path reads that were also sent to the proxy, and how many times
+  // the proxy answered first
+  uint64_t hedges_issued;
+  uint64_t hedges_won;
 
-  RoraCounter() : fast_path(0L), slow_path(0L) {}
+  RoraCounter &operator+=(const RoraCounter &other) {
+    fast_path += other.fast_path;
+    slow_path += other.slow_path;
+    degraded += other.degraded;
+    hedges_issued += other.hedges_issued;
+    hedges_won += other.hedges_won;
+    return *this;
+  }
+
+  RoraCounter()
+      : fast_path(0L), slow_path(0L), degraded(0L), hedges_issued(0L),
+        hedges_won(0L) {}
 };
 
 struct Statistics {
@@ -25,9 +42,15 @@ struct Statistics {
 
   void new_start();
   void new_stop();
+  // for measurements that overlap
+  void add_sample(high_resolution_clock::time_point t0,
+                  high_resolution_clock::time_point t1);
 
   void pretty(std::ostream &os) const;
 
+  // p in [0,1], in microseconds
+  double percentile(double p) const;
+
 private:
   uint _n_samples;
   double _min_dur;
@@ -40,6 +63,7 @@ private:
   high_resolution_clock::time_point _creation = high_resolution_clock::now();
   ;
   std::vector<double> _dur_buckets;
+  std::vector<double> _samples;
   friend std::ostream &operator<<(std::ostream &os, const Statistics &);
 };
 std::ostream &operator<<(std::ostream &os, const Statistics &);
@@ -4,8 +4,12 @@
 */
 
 #pragma once
+#include "reactor.h"
 #include "transport.h"
 
+#include <condition_variable>
+#include <mutex>
+
 namespace alba {
 namespace transport {
 class TCP_transport : public Transport {
@@ -17,6 +21,9 @@ public:
   void write_exact(const char *buf, int len) override;
   void read_exact(char *buf, int len) override;
 
+  void writev_exact(const struct iovec *iov, int iovcnt) override;
+  void readv_exact(const struct iovec *iov, int iovcnt) override;
+
   void
   expires_from_now(const std::chrono::steady_clock::duration &timeout) override;
 
@@ -30,6 +37,53 @@ private:
   llio::message input();
   boost::posix_time::milliseconds _timeout;
   void _check_deadline();
+
+  template <typename Buffers>
+  void _write(const Buffers &buffers, size_t len, const char *what);
+  template <typename Buffers>
+  void _read(const Buffers &buffers, size_t len, const char *what);
+};
+/* a tcp connection living on a shared Reactor instead of its own
+ * io_service. Reads and writes are first tried non-blocking from the
+ * calling thread; only when the socket isn't ready, the remainder is
+ * handed to the reactor and the caller waits for it.
+ * Deadlines go through the reactor's timer wheel, and cost nothing
+ * as long as no operation has to wait.
+ */
+class TCP_reactor_transport : public Transport {
+
+public:
+  TCP_reactor_transport(const std::string &ip, const std::string &port,
+                        const std::chrono::steady_clock::duration &timeout,
+                        std::shared_ptr<Reactor> reactor);
+
+  void write_exact(const char *buf, int len) override;
+  void read_exact(char *buf, int len) override;
+
+  void writev_exact(const struct iovec *iov, int iovcnt) override;
+  void readv_exact(const struct iovec *iov, int iovcnt) override;
+
+  void
+  expires_from_now(const std::chrono::steady_clock::duration &timeout) override;
+
+  ~TCP_reactor_transport();
+
+private:
+  std::shared_ptr<Reactor> _reactor;
+  boost::asio::ip::tcp::socket _socket;
+  std::chrono::steady_clock::duration _timeout;
+
+  std::mutex _mutex;
+  std::condition_variable _done_cond;
+  bool _done;
+  // the deadline closed the socket before the operation was done
+  bool _expired;
+  boost::system::error_code _ec;
+
+  typedef std::function<void(const boost::system::error_code &, std::size_t)>
+      io_handler;
+  void _wait_for(const std::function<void(io_handler)> &start,
+                 const char *what);
 };
 }
 }
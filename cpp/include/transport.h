@@ -9,13 +9,16 @@
 #include "llio.h"
 
 #include <chrono>
+#include <vector>
+
+#include <sys/uio.h>
 
 #include <boost/asio.hpp>
 
 namespace alba {
 namespace transport {
 
-enum class Kind { tcp, rdma };
+enum class Kind { tcp, rdma, io_uring };
 std::ostream &operator<<(std::ostream &, Kind);
 std::istream &operator>>(std::istream &, Kind &);
 
@@ -27,6 +30,25 @@ struct transport_exception : std::exception {
   virtual const char *what() const noexcept { return _what.c_str(); }
 };
 
+/* the part of an iovec array that still needs to be transferred */
+class iovec_cursor {
+public:
+  iovec_cursor(const struct iovec *iov, int iovcnt);
+
+  bool done() const { return _first == _iov.size(); }
+  size_t remaining() const;
+
+  // at most IOV_MAX entries, as readv & co accept
+  struct iovec *data() { return &_iov[_first]; }
+  int count() const;
+
+  void consume(size_t n);
+
+private:
+  std::vector<struct iovec> _iov;
+  size_t _first;
+};
+
 class Transport {
 public:
   virtual void
@@ -35,6 +57,11 @@ public:
   virtual void write_exact(const char *buf, int len) = 0;
   virtual void read_exact(char *buf, int len) = 0;
 
+  /* scatter/gather: send or fill all of the buffers, in order.
+   * The default does one write_exact/read_exact per buffer. */
+  virtual void writev_exact(const struct iovec *iov, int iovcnt);
+  virtual void readv_exact(const struct iovec *iov, int iovcnt);
+
   virtual ~Transport(){};
 
   llio::message read_message();
@@ -0,0 +1,52 @@
+/*
+  Copyright (C) iNuron - info@openvstorage.com
+  This file is part of Open vStorage. For license information, see <LICENSE.txt>
+*/
+
+#pragma once
+
+#include <boost/asio.hpp>
+
+#include <future>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace alba {
+namespace workers {
+
+/* a fixed set of threads draining an io_service.
+ * Used to run blocking work (asd reads, proxy calls) next to the
+ * calling thread. Tasks are executed in submission order.
+ */
+class WorkerPool {
+public:
+  WorkerPool(size_t n_threads);
+  ~WorkerPool();
+
+  WorkerPool(const WorkerPool &) = delete;
+  WorkerPool &operator=(const WorkerPool &) = delete;
+
+  template <typename F>
+  std::future<typename std::result_of<F()>::type> submit(F &&f) {
+    using R = typename std::result_of<F()>::type;
+    auto task =
+        std::make_shared<std::packaged_task<R()>>(std::forward<F>(f));
+    auto result = task->get_future();
+    _io_service.post([task]() { (*task)(); });
+    return result;
+  }
+
+  size_t size() const { return _threads.size(); }
+
+private:
+  boost::asio::io_service _io_service;
+  std::unique_ptr<boost::asio::io_service::work> _work;
+  std::vector<std::thread> _threads;
+};
+
+/* the process wide loop the asynchronous client calls run on, one thread
+ * per core. The calls block a thread while they run. */
+WorkerPool &event_loop();
+}
+}
@@ -11,17 +11,22 @@
 #include <boost/program_options/parsers.hpp>
 #include <boost/program_options/variables_map.hpp>
 
+#include <algorithm>
 #include <chrono>
 #include <ctime>
 #include <fstream>
+#include <future>
 #include <iomanip>
 #include <mutex>
 #include <thread>
 
 #include "alba_logger.h"
+#include "asd_client.h"
+#include "buffer_pool.h"
 #include "proxy_client.h"
 #include "statistics.h"
 #include "stuff.h"
+#include "transport_helper.h"
 
 using std::string;
 using std::cout;
@@ -107,41 +112,53 @@ void _bench_one_client(std::unique_ptr<Proxy_client> client, int client_index,
                        const string &namespace_, const string &object_name,
                        const int n, const uint32_t block_size,
                        const uint64_t object_size,
-                       const io_pattern_t io_pattern) {
+                       const io_pattern_t io_pattern,
+                       const uint32_t slices_per_read,
+                       const uint32_t async_depth) {
 
   try {
     alba::statistics::Statistics &stats = *stats_p;
     using namespace alba::proxy_protocol;
     uint64_t range = (object_size / block_size) - 1;
 
-    high_resolution_clock::time_point t0 = high_resolution_clock::now();
-    high_resolution_clock::time_point t1;
-
-    for (int i = 0; i < n; i++) {
-      std::vector<alba::byte> buffer(block_size);
-      uint64_t offset = 0;
-      uint64_t block_index = 0;
-      switch (io_pattern) {
-      case STRIDE: {
-        block_index = i % range;
-      }; break;
-      case RANDOM: {
-        uint64_t rand = std::rand();
-        block_index = rand % range;
-      }; break;
-      default: {}; break;
+    auto make_slices = [&](int i, std::vector<alba::byte> &buffer) {
+      buffer.resize(block_size * slices_per_read);
+      std::vector<uint64_t> block_indexes;
+      for (uint32_t s = 0; s < slices_per_read; s++) {
+        uint64_t block_index = 0;
+        switch (io_pattern) {
+        case STRIDE: {
+          block_index = (i * slices_per_read + s) % range;
+        }; break;
+        case RANDOM: {
+          uint64_t rand = std::rand();
+          block_index = rand % range;
+        }; break;
+        default: {
+          // spread the slices over the object,
+          // so they hit different fragments
+          block_index = (s * (range / slices_per_read)) % range;
+        }; break;
+        }
+        block_indexes.push_back(block_index);
       }
-      offset = block_size * block_index;
-      SliceDescriptor sd{&buffer[0], offset, block_size};
-      std::vector<SliceDescriptor> slices{sd};
-      ObjectSlices object_slices{object_name, slices};
-      std::vector<ObjectSlices> objects_slices{object_slices};
-      stats.new_start();
-
-      client->read_objects_slices(namespace_, objects_slices,
-                                  consistent_read::F, *cntr_p);
+      // the proxy does not like overlapping slices
+      std::sort(block_indexes.begin(), block_indexes.end());
+      block_indexes.erase(
+          std::unique(block_indexes.begin(), block_indexes.end()),
+          block_indexes.end());
+      std::vector<SliceDescriptor> slices;
+      for (uint32_t s = 0; s < block_indexes.size(); s++) {
+        uint64_t offset = block_size * block_indexes[s];
+        slices.push_back(SliceDescriptor{&buffer[s * block_size], offset,
+                                         block_size});
+      }
+      return slices;
+    };
 
-      stats.new_stop();
+    high_resolution_clock::time_point t0 = high_resolution_clock::now();
+    high_resolution_clock::time_point t1;
+    auto maybe_progress = [&](int i) {
       t1 = high_resolution_clock::now();
       int dur2 = duration_cast<seconds>(t1 - t0).count();
       int reporting_period = 1;
@@ -150,6 +167,55 @@ void _bench_one_client(std::unique_ptr<Proxy_client> client, int client_index,
         progress(time2, client_index, i);
         t0 = t0 + seconds(reporting_period);
       }
+    };
+
+    if (async_depth <= 1) {
+      std::vector<alba::byte> buffer;
+      for (int i = 0; i < n; i++) {
+        ObjectSlices object_slices{object_name, make_slices(i, buffer)};
+        std::vector<ObjectSlices> objects_slices{object_slices};
+        stats.new_start();
+
+        client->read_objects_slices(namespace_, objects_slices,
+                                    consistent_read::F, *cntr_p);
+
+        stats.new_stop();
+        maybe_progress(i);
+      }
+    } else {
+      // one thread, async_depth reads queued (they run on the event loop,
+      // at most one per loop thread at a time)
+      struct slot {
+        std::vector<alba::byte> buffer;
+        std::vector<ObjectSlices> objects_slices;
+        alba::statistics::RoraCounter cntr;
+        high_resolution_clock::time_point t0;
+        high_resolution_clock::time_point t1;
+        std::future<void> done;
+      };
+      std::vector<slot> slots(async_depth);
+      auto finish = [&stats](slot &s) {
+        if (s.done.valid()) {
+          s.done.get();
+          stats.add_sample(s.t0, s.t1);
+        }
+      };
+      for (int i = 0; i < n; i++) {
+        slot &s = slots[i % async_depth];
+        finish(s);
+        s.objects_slices.clear();
+        s.objects_slices.push_back(
+            ObjectSlices{object_name, make_slices(i, s.buffer)});
+        s.t0 = high_resolution_clock::now();
+        s.done = client->read_objects_slices_async(
+            namespace_, s.objects_slices, consistent_read::F, s.cntr,
+            [&s](std::exception_ptr) { s.t1 = high_resolution_clock::now(); });
+        maybe_progress(i);
+      }
+      for (auto &s : slots) {
+        finish(s);
+        *cntr_p += s.cntr;
+      }
     }
   } catch (std::exception &e) {
     std::cerr << e.what() << std::endl;
@@ -164,7 +230,9 @@ void partial_read_benchmark(const string &host, const string &port,
                             const boost::optional<RoraConfig> &rora_config,
                             const bool focus, const uint32_t block_size,
                             const io_pattern_t io_pattern,
-                            const bool invalidate_cache) {
+                            const bool invalidate_cache,
+                            const uint32_t slices_per_read,
+                            const uint32_t async_depth) {
 
   ALBA_LOG(WARNING, "partial_read_benchmark("
                         << host << ", " << port << ", " << transport
@@ -217,7 +285,7 @@ void partial_read_benchmark(const string &host, const string &port,
 
     std::thread t(_bench_one_client, std::move(client_p), client_index, stats_p,
                   cntr_p, namespace_, object_name, n, block_size, object_size,
-                  io_pattern);
+                  io_pattern, slices_per_read, async_depth);
 
     thread_v.push_back(std::move(t));
   }
@@ -226,9 +294,14 @@ void partial_read_benchmark(const string &host, const string &port,
     cout << "launched " << n_clients << " client(s). joining" << std::endl;
   }
 
+  auto pool0 = alba::llio::pool_stats();
   for (auto &thread : thread_v) {
     thread.join();
   }
+  auto pool1 = alba::llio::pool_stats();
+  cout << "buffer pool misses per read: "
+       << (double)(pool1.misses - pool0.misses) / (n * n_clients) << " ("
+       << pool1 << ")" << std::endl;
   cout << "----------------" << std::endl;
   for (auto stats_p : stats_v) {
     stats_p->pretty(cout);
@@ -236,7 +309,63 @@ void partial_read_benchmark(const string &host, const string &port,
   }
   for (auto counter_p : cntr_v) {
     cout << "slow_path " << counter_p->slow_path << " fast_path "
-         << counter_p->fast_path << std::endl;
+         << counter_p->fast_path << " degraded " << counter_p->degraded
+         << " hedges_issued " << counter_p->hedges_issued << " hedges_won "
+         << counter_p->hedges_won << std::endl;
+  }
+}
+
+void asd_transport_benchmark(const string &host, const string &port,
+                             const std::chrono::steady_clock::duration &timeout,
+                             const string &key, const int n,
+                             const int n_clients, const uint32_t block_size) {
+  using namespace alba::statistics;
+  using alba::transport::Kind;
+  for (auto kind : {Kind::tcp, Kind::io_uring}) {
+    std::vector<std::shared_ptr<Statistics>> stats_v;
+    std::vector<std::thread> thread_v;
+    auto t0 = high_resolution_clock::now();
+    auto pool0 = alba::llio::pool_stats();
+    for (int client_index = 0; client_index < n_clients; client_index++) {
+      auto stats_p = std::make_shared<Statistics>();
+      stats_v.push_back(stats_p);
+      thread_v.emplace_back([=]() {
+        try {
+          alba::asd_client::Asd_client asd(
+              timeout, alba::transport::make_transport(kind, host, port,
+                                                       timeout),
+              boost::none);
+          std::vector<alba::byte> buffer(block_size);
+          alba::asd_protocol::slice slice{0, block_size, buffer.data()};
+          std::vector<alba::asd_protocol::slice> slices{slice};
+          string key_ = key;
+          for (int i = 0; i < n; i++) {
+            stats_p->new_start();
+            asd.partial_get(key_, slices);
+            stats_p->new_stop();
+          }
+        } catch (std::exception &e) {
+          std::lock_guard<std::mutex> lock(cout_mutex);
+          std::cerr << kind << ": " << e.what() << std::endl;
+        }
+      });
+    }
+    for (auto &thread : thread_v) {
+      thread.join();
+    }
+    double secs =
+        duration_cast<duration<double>>(high_resolution_clock::now() - t0)
+            .count();
+    cout << "---------------- " << kind << std::endl;
+    for (auto stats_p : stats_v) {
+      stats_p->pretty(cout);
+    }
+    cout << kind << ": " << (n * n_clients) / secs << " partial reads/s"
+         << std::endl;
+    auto pool1 = alba::llio::pool_stats();
+    cout << "buffer pool misses per read: "
+         << (double)(pool1.misses - pool0.misses) / (n * n_clients)
+         << std::endl;
   }
 }
 
@@ -260,7 +389,7 @@ int main(int argc, const char *argv[]) {
       " show-object, delete-namespace, create-namespace, "
       " list-namespaces, invalidata-cache, proxy-get-version"
       " proxy-osd_info2"
-      " partial-read-benchmark")("port",
+      " partial-read-benchmark, asd-transport-benchmark")("port",
                                  po::value<string>()->default_value("10000"),
                                  "the alba proxy port number")(
       "host", po::value<string>()->default_value("127.0.0.1"),
@@ -274,7 +403,7 @@ int main(int argc, const char *argv[]) {
           "can we use cached information?")(
           "consistent-read", po::value<bool>()->default_value(true),
           "consistent read?")("transport", po::value<string>(),
-                              "rdma | tcp (default = tcp)")(
+                              "rdma | tcp | io_uring (default = tcp)")(
           "file", po::value<string>(), "file to work with for download/upload")(
           "length", po::value<uint32_t>(), "length for partial object read")(
           "offset", po::value<uint64_t>()->default_value(0),
@@ -300,7 +429,33 @@ int main(int argc, const char *argv[]) {
           "if set, all rora partial reads come from the "
           "same object, and hit the same ASD")(
           "asd-pool-size", po::value<uint32_t>()->default_value(5),
-          "config for partial read benchmark");
+          "config for partial read benchmark")(
+          "slices-per-read", po::value<uint32_t>()->default_value(1),
+          "number of slices per partial read (spread over the object)")(
+          "fan-out-concurrency", po::value<uint32_t>()->default_value(1),
+          "max number of asds read from in parallel for one partial read")(
+          "hedge-percentile", po::value<double>()->default_value(0.0),
+          "hedge partial reads slower than this percentile of the asd "
+          "latencies via the proxy (0 = off)")(
+          "async-depth", po::value<uint32_t>()->default_value(1),
+          "partial reads in flight per client (> 1 uses the async api)")(
+          "asd-transport", po::value<string>()->default_value("tcp"),
+          "transport to the asds that don't use rdma: tcp | io_uring")(
+          "asd-port", po::value<string>()->default_value("8000"),
+          "asd port for asd-transport-benchmark (--host is the asd ip, "
+          "--name the key to read)")(
+          "tcp-reactor-threads", po::value<uint32_t>()->default_value(0),
+          "threads shared by all tcp connections (0 = one io_service per "
+          "connection)")(
+          "manifest-cache-bytes", po::value<uint64_t>()->default_value(0),
+          "memory budget of the manifest cache (0 = entry count only)")(
+          "manifest-cache-policy", po::value<string>()->default_value("LRU"),
+          "what the manifest cache evicts: LRU | W_TINYLFU")(
+          "manifest-store-path", po::value<string>()->default_value(""),
+          "file to keep the manifest cache in over restarts (\"\" = none)")(
+          "manifest-store-bytes",
+          po::value<uint64_t>()->default_value(256 << 20),
+          "max bytes of manifests in that file (0 = no limit)");
 
   po::positional_options_description positionalOptions;
   positionalOptions.add("command", 1);
@@ -337,6 +492,8 @@ int main(int argc, const char *argv[]) {
     string transport_s = vm["transport"].as<string>();
     if (transport_s == "rdma") {
       transport = alba::transport::Kind::rdma;
+    } else if (transport_s == "io_uring") {
+      transport = alba::transport::Kind::io_uring;
     } else {
       assert(transport_s == "tcp");
     }
@@ -473,8 +630,33 @@ int main(int argc, const char *argv[]) {
     uint32_t n_clients = getRequiredArg<uint32_t>(vm, "n-clients");
     bool use_rora = getRequiredArg<bool>(vm, "use-rora");
     uint32_t asd_pool_size = getRequiredArg<uint32_t>(vm, "asd-pool-size");
+    uint32_t fan_out_concurrency =
+        getRequiredArg<uint32_t>(vm, "fan-out-concurrency");
+    double hedge_percentile = getRequiredArg<double>(vm, "hedge-percentile");
+    uint32_t tcp_reactor_threads =
+        getRequiredArg<uint32_t>(vm, "tcp-reactor-threads");
+    string asd_transport_s = getRequiredStringArg(vm, "asd-transport");
+    alba::transport::Kind asd_transport = alba::transport::Kind::tcp;
+    if (asd_transport_s == "io_uring") {
+      asd_transport = alba::transport::Kind::io_uring;
+    }
+    uint64_t manifest_cache_bytes =
+        getRequiredArg<uint64_t>(vm, "manifest-cache-bytes");
+    string manifest_cache_policy_s =
+        getRequiredStringArg(vm, "manifest-cache-policy");
+    auto manifest_cache_policy_ = manifest_cache_policy::lru;
+    if (manifest_cache_policy_s == "W_TINYLFU") {
+      manifest_cache_policy_ = manifest_cache_policy::w_tinylfu;
+    }
+    string manifest_store_path =
+        getRequiredStringArg(vm, "manifest-store-path");
+    uint64_t manifest_store_bytes =
+        getRequiredArg<uint64_t>(vm, "manifest-store-bytes");
     boost::optional<RoraConfig> rora_config =
-        RoraConfig(10000, false, asd_pool_size);
+        RoraConfig(10000, false, asd_pool_size, 25, fan_out_concurrency,
+                   hedge_percentile, tcp_reactor_threads, asd_transport,
+                   manifest_cache_bytes, manifest_cache_policy_,
+                   manifest_store_path, manifest_store_bytes);
     ALBA_LOG(INFO, "config = " << *rora_config);
     uint32_t block_size = getRequiredArg<uint32_t>(vm, "block-size");
     bool focus = getRequiredArg<bool>(vm, "focus");
@@ -482,6 +664,8 @@ int main(int argc, const char *argv[]) {
     io_pattern_t io_pattern = FIXED;
 
     bool invalidate_cache = getRequiredArg<bool>(vm, "invalidate-cache");
+    uint32_t slices_per_read = getRequiredArg<uint32_t>(vm, "slices-per-read");
+    uint32_t async_depth = getRequiredArg<uint32_t>(vm, "async-depth");
 
     const auto &it = string_to_pattern.find(io_pattern_s);
     if (it != string_to_pattern.cend()) {
@@ -494,7 +678,16 @@ int main(int argc, const char *argv[]) {
     }
     partial_read_benchmark(host, port, timeout, transport, ns, file, n,
                            n_clients, rora_config, focus, block_size,
-                           io_pattern, invalidate_cache);
+                           io_pattern, invalidate_cache, slices_per_read,
+                           async_depth);
+  } else if ("asd-transport-benchmark" == command) {
+    string asd_port = getRequiredStringArg(vm, "asd-port");
+    string key = getRequiredStringArg(vm, "name");
+    uint32_t n = getRequiredArg<uint32_t>(vm, "benchmark-size");
+    uint32_t n_clients = getRequiredArg<uint32_t>(vm, "n-clients");
+    uint32_t block_size = getRequiredArg<uint32_t>(vm, "block-size");
+    asd_transport_benchmark(host, asd_port, timeout, key, n, n_clients,
+                            block_size);
   } else {
     cout << "got invalid command name. valid options are: "
          << "download-object, upload-object, delete-object, list-objects "
@@ -21,6 +21,15 @@ template <> void from(message &m, x_uint64_t &t) {
     from(m, t.i);
   }
 }
+
+template <> void to(message_builder &mb, const x_uint64_t &t) noexcept {
+  if (t.i < max_int32) {
+    to(mb, (uint32_t)t.i);
+  } else {
+    to(mb, (uint32_t)max_int32);
+    to(mb, t.i);
+  }
+}
 }
 
 void to_be(alba::llio::message_builder &mb, const x_uint64_t &t) {
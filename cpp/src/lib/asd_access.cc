@@ -18,9 +18,10 @@ using alba::proxy_protocol::OsdInfo;
 #define LOCK() std::lock_guard<std::mutex> lock(_mutex)
 
 ConnectionPool::ConnectionPool(std::unique_ptr<OsdInfo> config, size_t capacity,
-                               std::chrono::steady_clock::duration timeout)
+                               std::chrono::steady_clock::duration timeout,
+                               transport::Kind tcp_kind)
     : config_(std::move(config)), capacity_(capacity), timeout_(timeout),
-      _fast_path_failures(0) {
+      tcp_kind_(tcp_kind), _fast_path_failures(0) {
   ALBA_LOG(INFO, "Created pool for asd client " << *config_ << ", capacity "
                                                 << capacity);
 }
@@ -48,7 +49,7 @@ std::unique_ptr<Asd_client> ConnectionPool::make_one_() const {
   if (config_->use_rdma) {
     t = alba::transport::Kind::rdma;
   } else {
-    t = alba::transport::Kind::tcp;
+    t = tcp_kind_;
   }
   auto transport = alba::transport::make_transport(
       // TODO try to use other ips too
@@ -138,6 +139,11 @@ void ConnectionPool::capacity(size_t cap) {
                           << capacity());
 }
 
+void ConnectionPools::set_tcp_kind(transport::Kind tcp_kind) {
+  LOCK();
+  tcp_kind_ = tcp_kind;
+}
+
 ConnectionPool *ConnectionPools::get_connection_pool(
     const proxy_protocol::OsdInfo &osd_info, int connection_pool_size,
     std::chrono::steady_clock::duration timeout) {
@@ -157,7 +163,7 @@ ConnectionPool *ConnectionPools::get_connection_pool(
         osd_info.long_id,
         std::unique_ptr<ConnectionPool>(new ConnectionPool(
             std::unique_ptr<proxy_protocol::OsdInfo>(osd_info_copy),
-            connection_pool_size, timeout)));
+            connection_pool_size, timeout, tcp_kind_)));
     it = connection_pools_.find(osd_info.long_id);
   }
   return it->second.get();
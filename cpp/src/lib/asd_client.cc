@@ -4,6 +4,7 @@
 */
 
 #include "asd_client.h"
+#include <cstring>
 #include <thread>
 
 namespace alba {
@@ -67,17 +68,131 @@ void Asd_client::partial_get(string &key, vector<slice> &slices) {
   asd_protocol::write_partial_get_request(_mb, key, slices);
   _transport->output(_mb);
   _mb.reset();
+  _read_partial_get_response(slices);
+
+  _transport->expires_from_now(std::chrono::steady_clock::duration::max());
+}
+
+void Asd_client::partial_get(vector<key_slices> &batch) {
+  _transport->expires_from_now(_timeout);
+
+  // the asd doesn't take pipelined requests (it asserts there are no
+  // extra bytes after a request): one at a time
+  for (auto &ks : batch) {
+    asd_protocol::write_partial_get_request(_mb, ks.first, ks.second);
+    _transport->output(_mb);
+    _mb.reset();
+    _read_partial_get_response(ks.second);
+  }
+
+  _transport->expires_from_now(std::chrono::steady_clock::duration::max());
+}
+
+void Asd_client::_write_partial_get_request(key_slices &ks) {
+  _request.clear();
+  asd_protocol::write_partial_get_request(_mb, ks.first, ks.second);
+  _mb.output_using([&](const char *buffer, const int len) -> void {
+    _request.insert(_request.end(), buffer, buffer + len);
+  });
+  _mb.reset();
+}
+
+/* partial_get(batch), one transfer at a time: per key the request goes
+ * out, then its response is read as its size, its body and the slice data,
+ * and only then the next request goes out (the asd doesn't take pipelined
+ * requests). */
+class Asd_client::_partial_get_job : public transport::IOUring_job {
+public:
+  _partial_get_job(Asd_client &client, transport::IOUring_transport &t,
+                   vector<key_slices> &batch)
+      : IOUring_job(t), _client(client), _batch(batch) {}
+
+  bool next(bool &send, std::vector<struct iovec> &iov) override {
+    send = false;
+    switch (_phase) {
+    case phase::request:
+      iov.push_back(iovec{&_size, sizeof(_size)});
+      _phase = phase::size;
+      return true;
+    case phase::size:
+      _body.resize(_size);
+      iov.push_back(iovec{_body.data(), _body.size()});
+      _phase = phase::body;
+      return true;
+    case phase::body: {
+      auto mb = llio::message_buffer::from_reader_sized(
+          [&](char *buffer, const int len) -> void {
+            memcpy(buffer, _body.data(), len);
+          },
+          _size);
+      message response(mb);
+      bool success;
+      asd_protocol::read_partial_get_response(response, _client._status,
+                                              success);
+      _client.check_status("Asd_client::partial_get_job");
+      for (auto &slice : _batch[_i].second) {
+        iov.push_back(iovec{slice.target, slice.length});
+      }
+      _phase = phase::data;
+      return true;
+    }
+    case phase::data:
+      ++_i;
+      return _send_request(send, iov);
+    case phase::start:
+      return _send_request(send, iov);
+    }
+    return false;
+  }
+
+private:
+  enum class phase { start, request, size, body, data };
+
+  Asd_client &_client;
+  vector<key_slices> &_batch;
+  phase _phase = phase::start;
+  size_t _i = 0;
+  uint32_t _size = 0;
+  std::vector<char> _body;
+
+  bool _send_request(bool &send, std::vector<struct iovec> &iov) {
+    if (_i >= _batch.size()) {
+      _client._transport->expires_from_now(
+          std::chrono::steady_clock::duration::max());
+      return false;
+    }
+    _client._write_partial_get_request(_batch[_i]);
+    send = true;
+    iov.push_back(iovec{_client._request.data(), _client._request.size()});
+    _phase = phase::request;
+    return true;
+  }
+};
+
+std::unique_ptr<transport::IOUring_job>
+Asd_client::partial_get_job(vector<key_slices> &batch) {
+  auto t = dynamic_cast<transport::IOUring_transport *>(_transport.get());
+  if (t == nullptr) {
+    return nullptr;
+  }
+  _transport->expires_from_now(_timeout);
+  return std::unique_ptr<transport::IOUring_job>(
+      new _partial_get_job(*this, *t, batch));
+}
+
+void Asd_client::_read_partial_get_response(vector<slice> &slices) {
   message response = _transport->read_message();
   bool success;
   asd_protocol::read_partial_get_response(response, _status, success);
 
   check_status(__PRETTY_FUNCTION__);
 
+  // the slice data follows the response, straight into the targets
+  _iov.clear();
   for (auto &slice : slices) {
-    _transport->read_exact((char *)slice.target, slice.length);
+    _iov.push_back(iovec{slice.target, slice.length});
   }
-
-  _transport->expires_from_now(std::chrono::steady_clock::duration::max());
+  _transport->readv_exact(_iov.data(), _iov.size());
 }
 
 void Asd_client::set_slowness(asd_protocol::slowness_t &slowness) {
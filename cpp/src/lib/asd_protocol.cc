@@ -27,12 +27,15 @@ void make_prologue(message_builder &mb, boost::optional<string> long_id) {
 
 void write_partial_get_request(message_builder &mb, string &key,
                                vector<slice> &slices) {
-  to<uint32_t>(mb, 11);
+  // the slices go in order here, not as an llio vector
+  const uint32_t tag = PARTIAL_GET;
+  mb.reserve(llio::serialized_size(tag) + llio::serialized_size(key) + 4 +
+             slices.size() * llio::wire_size<slice>::value + 4);
+  to(mb, tag);
   to(mb, key);
   to<uint32_t>(mb, slices.size());
   for (auto &slice : slices) {
-    to<uint32_t>(mb, slice.offset);
-    to<uint32_t>(mb, slice.length);
+    llio::to_fields(mb, slice);
   }
   to<uint32_t>(mb, 1);
 }
@@ -54,14 +57,7 @@ void read_partial_get_response(message &m, Status &status, bool &success) {
 
 void write_set_slowness_request(message_builder &mb,
                                 const slowness_t &slowness) {
-  to<uint32_t>(mb, SLOWNESS);
-  // to<slowness_t>(mb, slowness);
-  if (boost::none == slowness) {
-    to(mb, false);
-  } else {
-    to(mb, true);
-    to(mb, *slowness);
-  }
+  llio::to_all(mb, (uint32_t)SLOWNESS, slowness);
 }
 
 void read_set_slowness_response(message &m, Status &status) {
@@ -69,7 +65,7 @@ void read_set_slowness_response(message &m, Status &status) {
 }
 
 void write_get_version_request(message_builder &mb) {
-  to<uint32_t>(mb, GET_VERSION);
+  llio::to_all(mb, (uint32_t)GET_VERSION);
 }
 
 void read_get_version_response(message &m, Status &status, int32_t &major,
@@ -0,0 +1,124 @@
+/*
+  Copyright (C) iNuron - info@openvstorage.com
+  This file is part of Open vStorage. For license information, see <LICENSE.txt>
+*/
+
+#include "buffer_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <vector>
+
+namespace alba {
+namespace llio {
+
+namespace {
+const size_t _MIN_SHIFT = 6;  // 64 bytes
+const size_t _MAX_SHIFT = 20; // 1MiB
+const size_t _N_CLASSES = _MAX_SHIFT - _MIN_SHIFT + 1;
+// per thread and per class, the free list holds at most this many bytes
+const size_t _CLASS_BUDGET = 4 << 20;
+
+std::atomic<uint64_t> _hits(0);
+std::atomic<uint64_t> _misses(0);
+std::atomic<uint64_t> _oversized(0);
+std::atomic<uint64_t> _dropped(0);
+
+size_t _class_of(size_t size) {
+  size_t shift = _MIN_SHIFT;
+  while (((size_t)1 << shift) < size) {
+    shift++;
+  }
+  return shift - _MIN_SHIFT;
+}
+
+size_t _class_size(size_t c) { return (size_t)1 << (c + _MIN_SHIFT); }
+
+size_t _class_limit(size_t c) {
+  return std::min((size_t)1024,
+                  std::max((size_t)8, _CLASS_BUDGET / _class_size(c)));
+}
+
+struct thread_cache {
+  std::vector<char *> free[_N_CLASSES];
+
+  ~thread_cache() {
+    for (auto &list : free) {
+      for (char *b : list) {
+        delete[] b;
+      }
+    }
+  }
+};
+
+// 0: not created yet, 1: alive, 2: destroyed (thread exit)
+thread_local int _cache_state = 0;
+
+thread_cache *_cache() {
+  struct holder {
+    thread_cache cache;
+    holder() { _cache_state = 1; }
+    ~holder() { _cache_state = 2; }
+  };
+  if (_cache_state == 2) {
+    return nullptr;
+  }
+  static thread_local holder h;
+  return &h.cache;
+}
+}
+
+char *pool_allocate(size_t size, size_t &capacity) {
+  if (size > ((size_t)1 << _MAX_SHIFT)) {
+    _oversized.fetch_add(1, std::memory_order_relaxed);
+    capacity = size;
+    return new char[size];
+  }
+  size_t c = _class_of(size);
+  capacity = _class_size(c);
+  thread_cache *cache = _cache();
+  if (cache != nullptr && !cache->free[c].empty()) {
+    char *b = cache->free[c].back();
+    cache->free[c].pop_back();
+    _hits.fetch_add(1, std::memory_order_relaxed);
+    return b;
+  }
+  _misses.fetch_add(1, std::memory_order_relaxed);
+  return new char[capacity];
+}
+
+void pool_release(char *buffer, size_t capacity) {
+  if (buffer == nullptr) {
+    return;
+  }
+  if (capacity > ((size_t)1 << _MAX_SHIFT)) {
+    delete[] buffer;
+    return;
+  }
+  size_t c = _class_of(capacity);
+  thread_cache *cache = _cache();
+  if (cache == nullptr || cache->free[c].size() >= _class_limit(c)) {
+    _dropped.fetch_add(1, std::memory_order_relaxed);
+    delete[] buffer;
+    return;
+  }
+  cache->free[c].push_back(buffer);
+}
+
+buffer_pool_stats pool_stats() {
+  buffer_pool_stats s;
+  s.hits = _hits.load(std::memory_order_relaxed);
+  s.misses = _misses.load(std::memory_order_relaxed);
+  s.oversized = _oversized.load(std::memory_order_relaxed);
+  s.dropped = _dropped.load(std::memory_order_relaxed);
+  return s;
+}
+
+std::ostream &operator<<(std::ostream &os, const buffer_pool_stats &s) {
+  os << "buffer_pool_stats{ hits = " << s.hits << ", misses = " << s.misses
+     << ", oversized = " << s.oversized << ", dropped = " << s.dropped << "}";
+  return os;
+}
+}
+}
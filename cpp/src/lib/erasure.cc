@@ -0,0 +1,355 @@
+/*
+  Copyright (C) iNuron - info@openvstorage.com
+  This file is part of Open vStorage. For license information, see <LICENSE.txt>
+*/
+
+#include "erasure.h"
+#include "alba_logger.h"
+
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define ALBA_GF_X86 1
+#endif
+
+namespace alba {
+namespace erasure {
+
+namespace {
+struct gf_tables {
+  uint8_t exp[512];
+  uint8_t log[256];
+  gf_tables() {
+    uint32_t x = 1;
+    for (int i = 0; i < 255; i++) {
+      exp[i] = x;
+      log[x] = i;
+      x <<= 1;
+      if (x & 0x100) {
+        x ^= 0x11d;
+      }
+    }
+    for (int i = 255; i < 512; i++) {
+      exp[i] = exp[i - 255];
+    }
+    log[0] = 0;
+  }
+};
+
+const gf_tables &_tables() {
+  static gf_tables t;
+  return t;
+}
+
+void _region_scalar(uint8_t c, const uint8_t *src, uint8_t *dst, size_t len) {
+  uint8_t row[256];
+  for (int i = 0; i < 256; i++) {
+    row[i] = gf_mul(c, i);
+  }
+  for (size_t i = 0; i < len; i++) {
+    dst[i] ^= row[src[i]];
+  }
+}
+
+#ifdef ALBA_GF_X86
+// c * x = c * (x & 0x0f) ^ c * (x & 0xf0), each looked up with a shuffle
+void _nibble_tables(uint8_t c, uint8_t *lo, uint8_t *hi) {
+  for (int i = 0; i < 16; i++) {
+    lo[i] = gf_mul(c, i);
+    hi[i] = gf_mul(c, i << 4);
+  }
+}
+
+__attribute__((target("ssse3"))) void
+_region_ssse3(uint8_t c, const uint8_t *src, uint8_t *dst, size_t len) {
+  uint8_t lo[16], hi[16];
+  _nibble_tables(c, lo, hi);
+  const __m128i tlo = _mm_loadu_si128((const __m128i *)lo);
+  const __m128i thi = _mm_loadu_si128((const __m128i *)hi);
+  const __m128i mask = _mm_set1_epi8(0x0f);
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i *)(src + i));
+    __m128i l = _mm_and_si128(x, mask);
+    __m128i h = _mm_and_si128(_mm_srli_epi64(x, 4), mask);
+    __m128i p =
+        _mm_xor_si128(_mm_shuffle_epi8(tlo, l), _mm_shuffle_epi8(thi, h));
+    __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+    _mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(d, p));
+  }
+  for (; i < len; i++) {
+    dst[i] ^= lo[src[i] & 0x0f] ^ hi[src[i] >> 4];
+  }
+}
+
+__attribute__((target("avx2"))) void
+_region_avx2(uint8_t c, const uint8_t *src, uint8_t *dst, size_t len) {
+  uint8_t lo[16], hi[16];
+  _nibble_tables(c, lo, hi);
+  // the shuffle works per 128 bit lane, so both lanes get the table
+  const __m256i tlo =
+      _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)lo));
+  const __m256i thi =
+      _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)hi));
+  const __m256i mask = _mm256_set1_epi8(0x0f);
+  size_t i = 0;
+  for (; i + 32 <= len; i += 32) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)(src + i));
+    __m256i l = _mm256_and_si256(x, mask);
+    __m256i h = _mm256_and_si256(_mm256_srli_epi64(x, 4), mask);
+    __m256i p = _mm256_xor_si256(_mm256_shuffle_epi8(tlo, l),
+                                 _mm256_shuffle_epi8(thi, h));
+    __m256i d = _mm256_loadu_si256((const __m256i *)(dst + i));
+    _mm256_storeu_si256((__m256i *)(dst + i), _mm256_xor_si256(d, p));
+  }
+  for (; i < len; i++) {
+    dst[i] ^= lo[src[i] & 0x0f] ^ hi[src[i] >> 4];
+  }
+}
+#endif
+
+typedef void (*region_fn)(uint8_t, const uint8_t *, uint8_t *, size_t);
+
+struct gf_kernel {
+  region_fn fn;
+  const char *name;
+};
+
+gf_kernel _pick_kernel() {
+#ifdef ALBA_GF_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return {_region_avx2, "avx2"};
+  }
+  if (__builtin_cpu_supports("ssse3")) {
+    return {_region_ssse3, "ssse3"};
+  }
+#endif
+  return {_region_scalar, "scalar"};
+}
+
+const gf_kernel &_kernel() {
+  static gf_kernel k = _pick_kernel();
+  return k;
+}
+
+// jerasure's reed_sol_big_vandermonde_distribution_matrix(rows, cols, 8)
+std::vector<uint8_t> _big_vandermonde_distribution_matrix(uint32_t rows,
+                                                          uint32_t cols) {
+  std::vector<uint8_t> dist(rows * cols, 0);
+
+  // extended vandermonde: first row 1 0 .. 0, last row 0 .. 0 1,
+  // row i in between is 1 i i^2 ...
+  dist[0] = 1;
+  dist[(rows - 1) * cols + cols - 1] = 1;
+  for (uint32_t i = 1; i < rows - 1; i++) {
+    uint8_t x = 1;
+    for (uint32_t j = 0; j < cols; j++) {
+      dist[i * cols + j] = x;
+      x = gf_mul(x, i);
+    }
+  }
+
+  // column operations until the top cols x cols is the identity
+  for (uint32_t i = 1; i < cols; i++) {
+    uint32_t j = i;
+    while (j < rows && dist[j * cols + i] == 0) {
+      j++;
+    }
+    if (j >= rows) {
+      throw std::runtime_error("could not build distribution matrix");
+    }
+    if (j != i) {
+      for (uint32_t c = 0; c < cols; c++) {
+        std::swap(dist[j * cols + c], dist[i * cols + c]);
+      }
+    }
+
+    uint8_t e = dist[i * cols + i];
+    if (e != 1) {
+      uint8_t inv = gf_inv(e);
+      for (uint32_t r = 0; r < rows; r++) {
+        dist[r * cols + i] = gf_mul(inv, dist[r * cols + i]);
+      }
+    }
+
+    for (uint32_t c = 0; c < cols; c++) {
+      uint8_t t = dist[i * cols + c];
+      if (c != i && t != 0) {
+        for (uint32_t r = 0; r < rows; r++) {
+          dist[r * cols + c] ^= gf_mul(t, dist[r * cols + i]);
+        }
+      }
+    }
+  }
+
+  // row cols: all ones
+  for (uint32_t c = 0; c < cols; c++) {
+    uint8_t t = dist[cols * cols + c];
+    if (t != 1) {
+      uint8_t inv = gf_inv(t);
+      for (uint32_t r = cols; r < rows; r++) {
+        dist[r * cols + c] = gf_mul(inv, dist[r * cols + c]);
+      }
+    }
+  }
+
+  // first column of the remaining rows: all ones
+  for (uint32_t r = cols + 1; r < rows; r++) {
+    uint8_t t = dist[r * cols];
+    if (t != 1) {
+      uint8_t inv = gf_inv(t);
+      for (uint32_t c = 0; c < cols; c++) {
+        dist[r * cols + c] = gf_mul(dist[r * cols + c], inv);
+      }
+    }
+  }
+  return dist;
+}
+
+// gauss-jordan; a is n x n and gets destroyed
+bool _invert(std::vector<uint8_t> &a, std::vector<uint8_t> &inv, uint32_t n) {
+  inv.assign(n * n, 0);
+  for (uint32_t i = 0; i < n; i++) {
+    inv[i * n + i] = 1;
+  }
+  for (uint32_t i = 0; i < n; i++) {
+    uint32_t p = i;
+    while (p < n && a[p * n + i] == 0) {
+      p++;
+    }
+    if (p == n) {
+      return false;
+    }
+    if (p != i) {
+      for (uint32_t c = 0; c < n; c++) {
+        std::swap(a[p * n + c], a[i * n + c]);
+        std::swap(inv[p * n + c], inv[i * n + c]);
+      }
+    }
+    uint8_t f = gf_inv(a[i * n + i]);
+    for (uint32_t c = 0; c < n; c++) {
+      a[i * n + c] = gf_mul(f, a[i * n + c]);
+      inv[i * n + c] = gf_mul(f, inv[i * n + c]);
+    }
+    for (uint32_t r = 0; r < n; r++) {
+      uint8_t t = a[r * n + i];
+      if (r != i && t != 0) {
+        for (uint32_t c = 0; c < n; c++) {
+          a[r * n + c] ^= gf_mul(t, a[i * n + c]);
+          inv[r * n + c] ^= gf_mul(t, inv[i * n + c]);
+        }
+      }
+    }
+  }
+  return true;
+}
+}
+
+uint8_t gf_mul(uint8_t a, uint8_t b) {
+  if (a == 0 || b == 0) {
+    return 0;
+  }
+  auto &t = _tables();
+  return t.exp[t.log[a] + t.log[b]];
+}
+
+uint8_t gf_inv(uint8_t a) {
+  auto &t = _tables();
+  return t.exp[255 - t.log[a]];
+}
+
+void gf_mul_region_xor(uint8_t c, const uint8_t *src, uint8_t *dst,
+                       size_t len) {
+  if (c == 0) {
+    return;
+  }
+  _kernel().fn(c, src, dst, len);
+}
+
+const char *gf_kernel_name() { return _kernel().name; }
+
+ReedSolomon::ReedSolomon(uint32_t k, uint32_t m) : _k(k), _m(m) {
+  if (k == 0 || k + m > 256) {
+    throw std::invalid_argument("unsupported encoding scheme");
+  }
+  if (m == 0) {
+    _matrix.assign(k * k, 0);
+    for (uint32_t i = 0; i < k; i++) {
+      _matrix[i * k + i] = 1;
+    }
+  } else {
+    _matrix = _big_vandermonde_distribution_matrix(k + m, k);
+  }
+}
+
+const ReedSolomon &ReedSolomon::get(uint32_t k, uint32_t m) {
+  static std::mutex mutex;
+  static std::map<std::pair<uint32_t, uint32_t>, std::unique_ptr<ReedSolomon>>
+      instances;
+  std::lock_guard<std::mutex> lock(mutex);
+  auto &rs = instances[std::make_pair(k, m)];
+  if (rs == nullptr) {
+    rs.reset(new ReedSolomon(k, m));
+  }
+  return *rs;
+}
+
+void ReedSolomon::encode(const std::vector<const uint8_t *> &data,
+                         const std::vector<uint8_t *> &parity,
+                         size_t len) const {
+  for (uint32_t p = 0; p < _m; p++) {
+    std::memset(parity[p], 0, len);
+    for (uint32_t j = 0; j < _k; j++) {
+      gf_mul_region_xor(_matrix[(_k + p) * _k + j], data[j], parity[p], len);
+    }
+  }
+}
+
+bool ReedSolomon::decode(uint32_t fragment_id,
+                         const std::vector<uint32_t> &sources,
+                         const std::vector<const uint8_t *> &inputs,
+                         uint8_t *output, size_t len) const {
+  const uint32_t n = _k + _m;
+  if (fragment_id >= n || sources.size() != _k || inputs.size() != _k) {
+    return false;
+  }
+  for (uint32_t i = 0; i < _k; i++) {
+    if (sources[i] >= n) {
+      return false;
+    }
+    if (sources[i] == fragment_id) {
+      std::memcpy(output, inputs[i], len);
+      return true;
+    }
+  }
+
+  std::vector<uint8_t> a(_k * _k);
+  for (uint32_t r = 0; r < _k; r++) {
+    std::memcpy(&a[r * _k], &_matrix[sources[r] * _k], _k);
+  }
+  std::vector<uint8_t> inv;
+  if (!_invert(a, inv, _k)) {
+    ALBA_LOG(WARNING, "ReedSolomon::decode: singular matrix");
+    return false;
+  }
+
+  // fragment = row(fragment_id) * data = row(fragment_id) * inv * sources
+  const uint8_t *row = &_matrix[fragment_id * _k];
+  std::memset(output, 0, len);
+  for (uint32_t j = 0; j < _k; j++) {
+    uint8_t coef = 0;
+    for (uint32_t c = 0; c < _k; c++) {
+      coef ^= gf_mul(row[c], inv[c * _k + j]);
+    }
+    gf_mul_region_xor(coef, inputs[j], output, len);
+  }
+  return true;
+}
+}
+}
@@ -0,0 +1,242 @@
+/*
+  Copyright (C) iNuron - info@openvstorage.com
+  This file is part of Open vStorage. For license information, see <LICENSE.txt>
+*/
+
+#include "flat_manifest.h"
+#include "stuff.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace alba {
+namespace proxy_protocol {
+
+namespace {
+// the heap bytes of a string, if it has any
+size_t _heap_size(const std::string &s) {
+  return s.capacity() > 15 ? s.capacity() + 1 : 0;
+}
+}
+
+FlatManifest::FlatManifest(ManifestWithNamespaceId &&mf)
+    : name(std::move(mf.name)), object_id(std::move(mf.object_id)),
+      namespace_id(mf.namespace_id), encoding_scheme(mf.encoding_scheme),
+      uses_compression(mf.compression->get_compressor() !=
+                       compressor_t::NO_COMPRESSION),
+      encrypt_info(std::move(mf.encrypt_info)),
+      checksum(std::move(mf.checksum)), size(mf.size),
+      version_id(mf.version_id) {
+
+  if (mf.fragments.size() != mf.chunk_sizes.size()) {
+    throw llio::deserialisation_exception(
+        "manifest: chunk_sizes and fragments don't match");
+  }
+  _n_chunks = mf.chunk_sizes.size();
+  _n_fragments = 0;
+  // checksum and ctr of every fragment, back to back
+  std::string bytes;
+  std::vector<uint32_t> crc_sizes;
+  llio::message_builder mb;
+  for (auto &chunk : mf.fragments) {
+    _n_fragments += chunk.size();
+    for (auto &f : chunk) {
+      const alba::Checksum *crc = f->crc.get();
+      llio::to(mb, crc);
+      std::string crc_s = mb.as_string_no_size();
+      mb.reset();
+      crc_sizes.push_back(crc_s.size());
+      bytes += crc_s;
+      if (f->ctr != boost::none) {
+        bytes += *f->ctr;
+      }
+    }
+  }
+
+  const size_t offsets_size = (_n_chunks + 1) * sizeof(uint64_t);
+  const size_t fragments_size = (_n_fragments + 1) * sizeof(fragment);
+  const size_t starts_size = (_n_chunks + 1) * sizeof(uint32_t);
+  const size_t n_words =
+      (offsets_size + fragments_size + starts_size + bytes.size() + 7) / 8;
+  _block_size = n_words * sizeof(uint64_t);
+  _block.reset(new uint64_t[n_words]);
+
+  char *p = (char *)_block.get();
+  uint64_t *chunk_offsets = (uint64_t *)p;
+  fragment *fragments = (fragment *)(p + offsets_size);
+  uint32_t *fragment_starts =
+      (uint32_t *)(p + offsets_size + fragments_size);
+  char *area = p + offsets_size + fragments_size + starts_size;
+  memcpy(area, bytes.data(), bytes.size());
+
+  uint64_t offset = 0;
+  uint32_t n = 0;
+  uint32_t pos = 0;
+  for (uint32_t c = 0; c < _n_chunks; c++) {
+    chunk_offsets[c] = offset;
+    offset += mf.chunk_sizes[c];
+    fragment_starts[c] = n;
+    for (auto &f : mf.fragments[c]) {
+      auto &frag = fragments[n++];
+      frag.osd = f->loc.first == boost::none ? _NO_OSD : f->loc.first->i;
+      frag.version = f->loc.second;
+      frag.len = f->len;
+      frag.crc = pos;
+      pos += crc_sizes[n - 1];
+      frag.ctr = pos;
+      if (f->ctr != boost::none) {
+        pos += f->ctr->size();
+      }
+    }
+  }
+  chunk_offsets[_n_chunks] = offset;
+  _uniform_chunk_size = _n_chunks == 0 ? 0 : mf.chunk_sizes[0];
+  for (uint32_t c = 1; c + 1 < _n_chunks; c++) {
+    if (mf.chunk_sizes[c] != _uniform_chunk_size) {
+      _uniform_chunk_size = 0;
+      break;
+    }
+  }
+  // a bigger last chunk would make the division go wrong
+  if (_n_chunks > 1 && mf.chunk_sizes[_n_chunks - 1] > _uniform_chunk_size) {
+    _uniform_chunk_size = 0;
+  }
+  fragment_starts[_n_chunks] = n;
+  fragments[n] = fragment{_NO_OSD, 0, 0, pos, pos};
+
+  _chunk_offsets = chunk_offsets;
+  _fragments = fragments;
+  _fragment_starts = fragment_starts;
+  _bytes = area;
+}
+
+uint32_t FlatManifest::chunk_index(uint64_t pos) const {
+  if (_n_chunks == 0) {
+    return 0;
+  }
+  if (_uniform_chunk_size != 0) {
+    return std::min<uint64_t>(pos / _uniform_chunk_size, _n_chunks - 1);
+  }
+  auto it = std::upper_bound(_chunk_offsets + 1, _chunk_offsets + _n_chunks,
+                             pos);
+  return it - (_chunk_offsets + 1);
+}
+
+fragment_location_t FlatManifest::fragment_location(uint32_t c,
+                                                    uint32_t f) const {
+  auto &frag = _fragment(c, f);
+  boost::optional<osd_t> osd;
+  if (frag.osd != _NO_OSD) {
+    osd = osd_t{frag.osd};
+  }
+  return fragment_location_t(osd, frag.version);
+}
+
+boost::optional<std::string> FlatManifest::ctr(uint32_t c, uint32_t f) const {
+  auto &frag = _fragment(c, f);
+  uint32_t end = (&frag + 1)->crc;
+  if (end == frag.ctr) {
+    return boost::none;
+  }
+  return std::string(_bytes + frag.ctr, end - frag.ctr);
+}
+
+std::unique_ptr<alba::Checksum>
+FlatManifest::fragment_checksum(uint32_t c, uint32_t f) const {
+  auto &frag = _fragment(c, f);
+  std::string s(_bytes + frag.crc, frag.ctr - frag.crc);
+  llio::message m(llio::message_buffer::from_string(s));
+  std::unique_ptr<alba::Checksum> crc;
+  llio::from(m, crc);
+  return crc;
+}
+
+size_t FlatManifest::memory_size() const {
+  size_t checksum_size = checksum == nullptr ? 0 : sizeof(*checksum);
+  return sizeof(FlatManifest) + _block_size + _heap_size(name) +
+         _heap_size(object_id) + checksum_size;
+}
+
+Location get_location(const FlatManifest &mf, uint64_t pos, uint32_t len) {
+  return get_location(mf, pos, len, mf.chunk_index(pos));
+}
+
+Location get_location(const FlatManifest &mf, uint64_t pos, uint32_t len,
+                      uint32_t chunk_index) {
+  if (chunk_index >= mf.n_chunks() || pos < mf.chunk_offset(chunk_index) ||
+      (pos >= mf.chunk_offset(chunk_index + 1) &&
+       chunk_index + 1 < mf.n_chunks())) {
+    chunk_index = mf.chunk_index(pos);
+  }
+
+  uint32_t chunk_size = mf.chunk_size(chunk_index);
+  uint64_t total = mf.chunk_offset(chunk_index);
+  uint32_t fragment_length = chunk_size / mf.encoding_scheme.k;
+  uint32_t pos_in_chunk = pos - total;
+
+  uint32_t fragment_index = pos_in_chunk / fragment_length;
+
+  total += fragment_length * fragment_index;
+  uint32_t pos_in_fragment = pos - total;
+
+  Location l;
+  l.namespace_id = mf.namespace_id;
+  l.object_id = mf.object_id;
+  l.chunk_id = chunk_index;
+  l.fragment_id = fragment_index;
+  l.fragment_location = mf.fragment_location(chunk_index, fragment_index);
+  l.offset = pos_in_fragment;
+  l.length = std::min(len, fragment_length - pos_in_fragment);
+  l.uses_compression = mf.uses_compression;
+  l.encrypt_info = mf.encrypt_info;
+  l.ctr = mf.ctr(chunk_index, fragment_index);
+  return l;
+}
+
+LazyManifest::LazyManifest(std::string name,
+                           std::unique_ptr<CompressedManifest> cmf)
+    : name(std::move(name)), _compressed(std::move(cmf)) {}
+
+std::shared_ptr<const FlatManifest> LazyManifest::get() {
+  if (_decoded.load(std::memory_order_acquire)) {
+    return _flat;
+  }
+  std::lock_guard<std::mutex> g(_mutex);
+  if (_flat == nullptr) {
+    ManifestWithNamespaceId mf;
+    decode(*_compressed, mf);
+    _flat = std::make_shared<FlatManifest>(std::move(mf));
+    _compressed.reset();
+    _decoded.store(true, std::memory_order_release);
+  }
+  return _flat;
+}
+
+bool LazyManifest::decoded() {
+  return _decoded.load(std::memory_order_acquire);
+}
+
+size_t LazyManifest::memory_size() {
+  std::lock_guard<std::mutex> g(_mutex);
+  size_t size = sizeof(LazyManifest) + _heap_size(name);
+  if (_flat != nullptr) {
+    size += _flat->memory_size();
+  } else {
+    size += _compressed->memory_size();
+  }
+  return size;
+}
+
+std::ostream &operator<<(std::ostream &os, const FlatManifest &mf) {
+  os << "FlatManifest{ name = `";
+  dump_string(os, mf.name);
+  os << "`, object_id = `";
+  dump_string(os, mf.object_id);
+  os << "`, namespace_id = " << mf.namespace_id
+     << ", encoding_scheme = " << mf.encoding_scheme
+     << ", n_chunks = " << mf.n_chunks() << ", size = " << mf.size
+     << ", version_id = " << mf.version_id << " }";
+  return os;
+}
+}
+}
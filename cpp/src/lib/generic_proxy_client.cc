@@ -5,6 +5,7 @@
 
 #include "generic_proxy_client.h"
 #include "alba_logger.h"
+#include "worker_pool.h"
 
 #include <iostream>
 
@@ -212,8 +213,8 @@ void GenericProxy_client::read_objects_slices(
       _mb, namespace_, slices, BooleanEnumTrue(consistent_read));
   _output();
 
-  message response = _input();
-  proxy_protocol::read_read_objects_slices_response(response, _status, slices);
+  proxy_protocol::read_read_objects_slices_response(*_transport, _status,
+                                                    slices);
   cntr.slow_path += slices.size();
 
   check_status(__PRETTY_FUNCTION__);
@@ -235,14 +236,127 @@ void GenericProxy_client::read_objects_slices2(
       _mb, namespace_, slices, BooleanEnumTrue(consistent_read));
   _output();
 
-  message response = _input();
-  proxy_protocol::read_read_objects_slices2_response(response, _status, slices,
-                                                     object_infos);
+  proxy_protocol::read_read_objects_slices2_response(*_transport, _status,
+                                                     slices, object_infos);
   cntr.slow_path += slices.size();
 
   check_status(__PRETTY_FUNCTION__);
 }
 
+struct GenericProxy_client::pending_read {
+  pending_read(const vector<proxy_protocol::ObjectSlices> &slices)
+      : slices(slices) {}
+
+  message_builder request;
+  vector<proxy_protocol::ObjectSlices> slices;
+  alba::statistics::RoraCounter *cntr = nullptr;
+  read_done_callback on_done;
+  std::promise<void> done;
+};
+
+std::future<void> GenericProxy_client::read_objects_slices_async(
+    const string &namespace_,
+    const vector<proxy_protocol::ObjectSlices> &slices,
+    const consistent_read consistent_read,
+    alba::statistics::RoraCounter &cntr, read_done_callback on_done) {
+
+  auto read = std::make_shared<pending_read>(slices);
+  read->cntr = &cntr;
+  read->on_done = std::move(on_done);
+  auto result = read->done.get_future();
+  if (slices.size() == 0) {
+    _complete(*read, nullptr);
+    return result;
+  }
+
+  proxy_protocol::write_read_objects_slices_request(
+      read->request, namespace_, slices, BooleanEnumTrue(consistent_read));
+
+  bool start;
+  {
+    std::lock_guard<std::mutex> lock(_pipeline_mutex);
+    _unsent.push_back(read);
+    start = !_draining;
+    _draining = true;
+  }
+  if (start) {
+    workers::event_loop().submit([this]() { _drain(); });
+  }
+  return result;
+}
+
+void GenericProxy_client::_drain() {
+  while (true) {
+    pending_read_ptr next;
+    {
+      std::lock_guard<std::mutex> lock(_pipeline_mutex);
+      if (_unsent.empty()) {
+        // the last we touch of this: the client can be gone right after
+        _draining = false;
+        _pipeline_cond.notify_all();
+        return;
+      }
+      next = _unsent.front();
+      _unsent.pop_front();
+    }
+
+    // the proxy doesn't take pipelined requests (it drops whatever follows
+    // a request in the same read): one at a time
+    proxy_protocol::Status status;
+    try {
+      _expires_from_now(_timeout);
+      _transport->output(next->request);
+      proxy_protocol::read_read_objects_slices_response(*_transport, status,
+                                                        next->slices);
+      _expires_from_now(std::chrono::steady_clock::duration::max());
+    } catch (...) {
+      _fail_pipeline(next, std::current_exception());
+      continue;
+    }
+
+    if (status.is_ok()) {
+      next->cntr->slow_path += next->slices.size();
+      _complete(*next, nullptr);
+    } else {
+      ALBA_LOG(DEBUG, "read_objects_slices_async received rc:"
+                          << (uint32_t)status._return_code);
+      _complete(*next, std::make_exception_ptr(proxy_exception(
+                           status._return_code, status._what)));
+    }
+  }
+}
+
+void GenericProxy_client::_fail_pipeline(pending_read_ptr current,
+                                         std::exception_ptr error) {
+  std::deque<pending_read_ptr> failed;
+  {
+    std::lock_guard<std::mutex> lock(_pipeline_mutex);
+    failed.swap(_unsent);
+  }
+  failed.push_front(current);
+  for (auto &read : failed) {
+    _complete(*read, error);
+  }
+}
+
+void GenericProxy_client::_complete(pending_read &read,
+                                    std::exception_ptr error) {
+  if (read.on_done) {
+    read.on_done(error);
+  }
+  if (error) {
+    read.done.set_exception(error);
+  } else {
+    read.done.set_value();
+  }
+}
+
+GenericProxy_client::~GenericProxy_client() {
+  _drain_async();
+  std::unique_lock<std::mutex> lock(_pipeline_mutex);
+  _pipeline_cond.wait(lock, [this]() { return !_draining; });
+}
+
 void GenericProxy_client::write_object_fs2(
     const string &namespace_, const string &object_name,
     const string &input_file, const allow_overwrite allow_overwrite,
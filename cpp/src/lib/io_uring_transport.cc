@@ -0,0 +1,627 @@
+/*
+  Copyright (C) iNuron - info@openvstorage.com
+  This file is part of Open vStorage. For license information, see <LICENSE.txt>
+*/
+
+#include "io_uring_transport.h"
+
+#include <linux/io_uring.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace alba {
+namespace transport {
+
+using std::string;
+
+namespace {
+string _errno_msg(const string &prefix, int err) {
+  std::ostringstream ss;
+  ss << prefix << ": " << strerror(err) << " (" << err << ")";
+  return ss.str();
+}
+}
+
+namespace uring {
+/* the minimal part of liburing we need, on top of the raw syscalls.
+ * Everything queued is submitted, and reaped, before the call that queued
+ * it returns: nothing is left in flight between calls.
+ */
+class Ring : public std::enable_shared_from_this<Ring> {
+public:
+  Ring(unsigned entries, unsigned files) : _id(_next_id++) {
+    io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    _fd = syscall(__NR_io_uring_setup, entries, &p);
+    if (_fd < 0) {
+      throw transport_exception(_errno_msg("io_uring_setup", errno));
+    }
+
+    _sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    _cq_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    const bool single_mmap = p.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+      _sq_size = _cq_size = std::max(_sq_size, _cq_size);
+    }
+    _sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+
+    _sq = _map(_sq_size, IORING_OFF_SQ_RING);
+    _cq = single_mmap ? _sq : _map(_cq_size, IORING_OFF_CQ_RING);
+    _sqes = (io_uring_sqe *)_map(_sqes_size, IORING_OFF_SQES);
+    if (_sq == nullptr || _cq == nullptr || _sqes == nullptr) {
+      int err = errno;
+      _unmap();
+      throw transport_exception(_errno_msg("io_uring mmap", err));
+    }
+
+    char *sq = (char *)_sq;
+    _sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    _sq_mask = *(unsigned *)(sq + p.sq_off.ring_mask);
+    _sq_array = (unsigned *)(sq + p.sq_off.array);
+    char *cq = (char *)_cq;
+    _cq_head = (unsigned *)(cq + p.cq_off.head);
+    _cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    _cq_mask = *(unsigned *)(cq + p.cq_off.ring_mask);
+    _cqes = (io_uring_cqe *)(cq + p.cq_off.cqes);
+    _tail = *_sq_tail;
+
+    // an empty table of fixed files, filled as sockets get used here
+    // (older kernels don't do sparse tables: they go without)
+    std::vector<int> fds(files, -1);
+    if (syscall(__NR_io_uring_register, _fd, IORING_REGISTER_FILES, fds.data(),
+                files) == 0) {
+      _slots.assign(files, false);
+    }
+  }
+
+  ~Ring() { _unmap(); }
+
+  Ring(const Ring &) = delete;
+  Ring &operator=(const Ring &) = delete;
+
+  // unique over the life of the process, unlike the address
+  uint64_t id() const { return _id; }
+
+  // the fixed file slot fd now occupies, -1 if there's none
+  int register_fd(int fd) {
+    std::lock_guard<std::mutex> lock(_slots_mutex);
+    auto it = std::find(_slots.begin(), _slots.end(), false);
+    if (it == _slots.end()) {
+      return -1;
+    }
+    int slot = it - _slots.begin();
+    if (_update_slot(slot, fd) != 1) {
+      return -1;
+    }
+    *it = true;
+    return slot;
+  }
+
+  // can be called from any thread
+  void unregister_fd(int slot) {
+    std::lock_guard<std::mutex> lock(_slots_mutex);
+    if (_update_slot(slot, -1) != 1) {
+      ALBA_LOG(WARNING, "io_uring: couldn't clear fixed file slot " << slot);
+    }
+    _slots[slot] = false;
+  }
+
+  io_uring_sqe *next_sqe() {
+    unsigned index = _tail & _sq_mask;
+    io_uring_sqe *sqe = &_sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    _sq_array[index] = index;
+    _tail++;
+    _queued++;
+    return sqe;
+  }
+
+  // submits what's queued and waits for n completions
+  void submit_and_wait(unsigned n, io_uring_cqe *cqes) {
+    __atomic_store_n(_sq_tail, _tail, __ATOMIC_RELEASE);
+    unsigned reaped = 0;
+    while (true) {
+      unsigned head = *_cq_head;
+      unsigned tail = __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+      while (head != tail && reaped < n) {
+        cqes[reaped++] = _cqes[head & _cq_mask];
+        head++;
+      }
+      __atomic_store_n(_cq_head, head, __ATOMIC_RELEASE);
+      if (reaped == n) {
+        return;
+      }
+      int rc = syscall(__NR_io_uring_enter, _fd, _queued, n - reaped,
+                       IORING_ENTER_GETEVENTS, nullptr, 0);
+      if (rc < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        // the in flight state is lost, nothing sensible to retry
+        throw transport_exception(_errno_msg("io_uring_enter", errno));
+      }
+      _queued -= rc;
+    }
+  }
+
+  /* submits what's queued, waits for at least one completion, and hands
+   * all the completions that are in to on_cqe */
+  template <typename F> void submit_and_reap(F on_cqe) {
+    __atomic_store_n(_sq_tail, _tail, __ATOMIC_RELEASE);
+    unsigned reaped = 0;
+    while (true) {
+      unsigned head = *_cq_head;
+      unsigned tail = __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+      for (; head != tail; head++, reaped++) {
+        // copied out, so on_cqe can queue more
+        io_uring_cqe cqe = _cqes[head & _cq_mask];
+        __atomic_store_n(_cq_head, head + 1, __ATOMIC_RELEASE);
+        on_cqe(cqe);
+      }
+      if (reaped > 0 && _queued == 0) {
+        return;
+      }
+      int rc = syscall(__NR_io_uring_enter, _fd, _queued, reaped > 0 ? 0 : 1,
+                       IORING_ENTER_GETEVENTS, nullptr, 0);
+      if (rc < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        throw transport_exception(_errno_msg("io_uring_enter", errno));
+      }
+      _queued -= rc;
+    }
+  }
+
+private:
+  static std::atomic<uint64_t> _next_id;
+  const uint64_t _id;
+  int _fd = -1;
+  void *_sq = nullptr;
+  void *_cq = nullptr;
+  io_uring_sqe *_sqes = nullptr;
+  size_t _sq_size, _cq_size, _sqes_size;
+
+  unsigned *_sq_tail;
+  unsigned _sq_mask;
+  unsigned *_sq_array;
+  unsigned *_cq_head;
+  unsigned *_cq_tail;
+  unsigned _cq_mask;
+  io_uring_cqe *_cqes;
+
+  unsigned _tail = 0;
+  unsigned _queued = 0;
+
+  // fixed file slots in use; empty without fixed files
+  std::mutex _slots_mutex;
+  std::vector<bool> _slots;
+
+  int _update_slot(int slot, int fd) {
+    io_uring_files_update update;
+    memset(&update, 0, sizeof(update));
+    update.offset = slot;
+    update.fds = (uint64_t)&fd;
+    return syscall(__NR_io_uring_register, _fd, IORING_REGISTER_FILES_UPDATE,
+                   &update, 1);
+  }
+
+  void *_map(size_t size, off_t offset) {
+    void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, _fd, offset);
+    return p == MAP_FAILED ? nullptr : p;
+  }
+
+  void _unmap() {
+    if (_sqes != nullptr) {
+      munmap(_sqes, _sqes_size);
+    }
+    if (_cq != nullptr && _cq != _sq) {
+      munmap(_cq, _cq_size);
+    }
+    if (_sq != nullptr) {
+      munmap(_sq, _sq_size);
+    }
+    if (_fd >= 0) {
+      close(_fd);
+    }
+  }
+};
+
+std::atomic<uint64_t> Ring::_next_id(1);
+}
+
+namespace {
+using uring::Ring;
+
+const unsigned _RING_ENTRIES = 64;
+const unsigned _RING_FILES = 64;
+// a transfer and its linked timeout take 2 entries
+const size_t _MAX_IN_FLIGHT = _RING_ENTRIES / 2;
+
+std::shared_ptr<Ring> &_thread_ring() {
+  static thread_local std::shared_ptr<Ring> ring =
+      std::make_shared<Ring>(_RING_ENTRIES, _RING_FILES);
+  return ring;
+}
+
+const uint64_t _OP = 1;
+const uint64_t _TIMEOUT = 2;
+
+/* links a timeout for the deadline to the operation in sqe, if there's a
+ * deadline at all. ts has to stay put until the submit. */
+bool _link_timeout(Ring &ring, io_uring_sqe *sqe,
+                   const std::chrono::steady_clock::time_point &deadline,
+                   __kernel_timespec &ts, uint64_t user_data) {
+  if (deadline == std::chrono::steady_clock::time_point::max()) {
+    return false;
+  }
+  auto remaining = deadline - std::chrono::steady_clock::now();
+  if (remaining <= std::chrono::steady_clock::duration::zero()) {
+    remaining = std::chrono::nanoseconds(1);
+  }
+  auto ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(remaining).count();
+  ts.tv_sec = ns / 1000000000;
+  ts.tv_nsec = ns % 1000000000;
+  sqe->flags |= IOSQE_IO_LINK;
+  io_uring_sqe *t = ring.next_sqe();
+  t->opcode = IORING_OP_LINK_TIMEOUT;
+  t->addr = (uint64_t)&ts;
+  t->len = 1;
+  t->user_data = user_data;
+  return true;
+}
+
+/* runs the prepared operation with a deadline,
+ * returns its result or -ETIME if the deadline passed. */
+template <typename F>
+int _run(const std::chrono::steady_clock::time_point &deadline, F prepare) {
+  auto &ring = *_thread_ring();
+  io_uring_sqe *sqe = ring.next_sqe();
+  prepare(ring, sqe);
+  sqe->user_data = _OP;
+
+  __kernel_timespec ts;
+  unsigned n = _link_timeout(ring, sqe, deadline, ts, _TIMEOUT) ? 2 : 1;
+
+  io_uring_cqe cqes[2];
+  ring.submit_and_wait(n, cqes);
+  int res = -EIO;
+  for (unsigned i = 0; i < n; i++) {
+    if (cqes[i].user_data == _OP) {
+      res = cqes[i].res;
+    }
+  }
+  // an operation cut short by its linked timeout is cancelled
+  return res == -ECANCELED ? -ETIME : res;
+}
+
+std::chrono::steady_clock::time_point
+_deadline_after(const std::chrono::steady_clock::duration &timeout) {
+  if (timeout == std::chrono::steady_clock::duration::max()) {
+    return std::chrono::steady_clock::time_point::max();
+  }
+  return std::chrono::steady_clock::now() + timeout;
+}
+}
+
+IOUring_transport::IOUring_transport(
+    const string &ip, const string &port,
+    const std::chrono::steady_clock::duration &timeout)
+    : _socket(-1), _timeout(timeout), _ring_id(0), _slot(-1) {
+  ALBA_LOG(INFO, "IOUring_transport(" << ip << ", " << port << ")");
+  auto addr = boost::asio::ip::address::from_string(ip);
+  boost::asio::ip::tcp::endpoint endpoint(addr, std::stoi(port));
+
+  _socket = socket(endpoint.protocol().family(), SOCK_STREAM | SOCK_CLOEXEC,
+                   IPPROTO_TCP);
+  if (_socket < 0) {
+    throw transport_exception(_errno_msg("socket", errno));
+  }
+  int rc = _run(_deadline_after(_timeout), [&](Ring &, io_uring_sqe *sqe) {
+    sqe->opcode = IORING_OP_CONNECT;
+    sqe->fd = _socket;
+    sqe->addr = (uint64_t)endpoint.data();
+    sqe->off = endpoint.size();
+  });
+  if (rc < 0) {
+    _close();
+    throw transport_exception(_errno_msg("IOUring_transport connect", -rc));
+  }
+  int one = 1;
+  setsockopt(_socket, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+IOUring_transport::~IOUring_transport() { _close(); }
+
+bool IOUring_transport::supported() {
+  static thread_local bool ok = []() {
+    try {
+      _thread_ring();
+      return true;
+    } catch (transport_exception &e) {
+      ALBA_LOG(WARNING, "io_uring not available: " << e.what());
+      return false;
+    }
+  }();
+  return ok;
+}
+
+void IOUring_transport::_target(Ring &ring, io_uring_sqe *sqe) {
+  if (_ring_id != ring.id()) {
+    // first use on this thread's ring
+    _unregister();
+    _ring_id = ring.id();
+    _slot = ring.register_fd(_socket);
+    if (_slot >= 0) {
+      _ring = ring.shared_from_this();
+    }
+  }
+  if (_slot >= 0) {
+    sqe->fd = _slot;
+    sqe->flags |= IOSQE_FIXED_FILE;
+  } else {
+    sqe->fd = _socket;
+  }
+}
+
+void IOUring_transport::_unregister() {
+  // a registered socket stays open until it's out of the ring's table
+  if (_slot >= 0) {
+    auto ring = _ring.lock();
+    if (ring != nullptr) {
+      ring->unregister_fd(_slot);
+    }
+    _slot = -1;
+    _ring.reset();
+  }
+  _ring_id = 0;
+}
+
+void IOUring_transport::_close() {
+  if (_socket >= 0) {
+    _unregister();
+    close(_socket);
+    _socket = -1;
+  }
+}
+
+void IOUring_transport::expires_from_now(
+    const std::chrono::steady_clock::duration &timeout) {
+  _timeout = timeout;
+}
+
+void IOUring_transport::write_exact(const char *buf, int len) {
+  if (_socket < 0) {
+    throw transport_exception("IOUring_transport write_exact: closed");
+  }
+  auto deadline = _deadline_after(_timeout);
+  int done = 0;
+  while (done < len) {
+    int rc = _run(deadline, [&](Ring &ring, io_uring_sqe *sqe) {
+      sqe->opcode = IORING_OP_SEND;
+      _target(ring, sqe);
+      sqe->addr = (uint64_t)(buf + done);
+      sqe->len = len - done;
+      sqe->msg_flags = MSG_NOSIGNAL;
+    });
+    if (rc <= 0) {
+      // like the other transports, a connection that failed is done
+      _close();
+      throw transport_exception(
+          _errno_msg("IOUring_transport write_exact", rc == 0 ? EPIPE : -rc));
+    }
+    done += rc;
+  }
+}
+
+void IOUring_transport::read_exact(char *buf, int len) {
+  if (_socket < 0) {
+    throw transport_exception("IOUring_transport read_exact: closed");
+  }
+  auto deadline = _deadline_after(_timeout);
+  int done = 0;
+  while (done < len) {
+    int rc = _run(deadline, [&](Ring &ring, io_uring_sqe *sqe) {
+      sqe->opcode = IORING_OP_RECV;
+      _target(ring, sqe);
+      sqe->addr = (uint64_t)(buf + done);
+      sqe->len = len - done;
+      sqe->msg_flags = MSG_WAITALL;
+    });
+    if (rc == 0) {
+      _close();
+      throw transport_exception("IOUring_transport read_exact: eof");
+    }
+    if (rc < 0) {
+      _close();
+      throw transport_exception(
+          _errno_msg("IOUring_transport read_exact", -rc));
+    }
+    done += rc;
+  }
+}
+void IOUring_transport::writev_exact(const struct iovec *iov, int iovcnt) {
+  if (_socket < 0) {
+    throw transport_exception("IOUring_transport writev_exact: closed");
+  }
+  auto deadline = _deadline_after(_timeout);
+  iovec_cursor cursor(iov, iovcnt);
+  while (!cursor.done()) {
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = cursor.data();
+    msg.msg_iovlen = cursor.count();
+    int rc = _run(deadline, [&](Ring &ring, io_uring_sqe *sqe) {
+      sqe->opcode = IORING_OP_SENDMSG;
+      _target(ring, sqe);
+      sqe->addr = (uint64_t)&msg;
+      sqe->len = 1;
+      sqe->msg_flags = MSG_NOSIGNAL;
+    });
+    if (rc <= 0) {
+      _close();
+      throw transport_exception(_errno_msg("IOUring_transport writev_exact",
+                                           rc == 0 ? EPIPE : -rc));
+    }
+    cursor.consume(rc);
+  }
+}
+
+void IOUring_transport::readv_exact(const struct iovec *iov, int iovcnt) {
+  if (_socket < 0) {
+    throw transport_exception("IOUring_transport readv_exact: closed");
+  }
+  auto deadline = _deadline_after(_timeout);
+  iovec_cursor cursor(iov, iovcnt);
+  while (!cursor.done()) {
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = cursor.data();
+    msg.msg_iovlen = cursor.count();
+    int rc = _run(deadline, [&](Ring &ring, io_uring_sqe *sqe) {
+      sqe->opcode = IORING_OP_RECVMSG;
+      _target(ring, sqe);
+      sqe->addr = (uint64_t)&msg;
+      sqe->len = 1;
+      sqe->msg_flags = MSG_WAITALL;
+    });
+    if (rc == 0) {
+      _close();
+      throw transport_exception("IOUring_transport readv_exact: eof");
+    }
+    if (rc < 0) {
+      _close();
+      throw transport_exception(
+          _errno_msg("IOUring_transport readv_exact", -rc));
+    }
+    cursor.consume(rc);
+  }
+}
+
+namespace {
+// a job in a run_batch, with its current transfer
+struct lane {
+  IOUring_job *job = nullptr;
+  bool send = false;
+  std::unique_ptr<iovec_cursor> cursor;
+  std::chrono::steady_clock::time_point deadline;
+  struct msghdr msg;
+  __kernel_timespec ts;
+  int result = -EIO;
+  // completions still to come: the transfer's and its timeout's
+  unsigned outstanding = 0;
+  bool done = false;
+};
+}
+
+void IOUring_transport::run_batch(const std::vector<IOUring_job *> &jobs) {
+  auto &ring = *_thread_ring();
+  std::vector<lane> lanes(jobs.size());
+
+  auto finish = [](lane &l, std::exception_ptr error) {
+    if (error) {
+      l.job->error = error;
+      l.job->transport._close();
+    }
+    l.job->finished = std::chrono::steady_clock::now();
+    l.done = true;
+  };
+  // on to the job's next (non empty) transfer
+  auto advance = [&finish](lane &l) {
+    std::vector<struct iovec> iov;
+    try {
+      do {
+        iov.clear();
+        if (!l.job->next(l.send, iov)) {
+          finish(l, nullptr);
+          return;
+        }
+        l.cursor.reset(new iovec_cursor(iov.data(), iov.size()));
+      } while (l.cursor->done());
+    } catch (...) {
+      finish(l, std::current_exception());
+      return;
+    }
+    l.deadline = _deadline_after(l.job->transport._timeout);
+  };
+
+  for (size_t i = 0; i < jobs.size(); i++) {
+    lanes[i].job = jobs[i];
+    if (jobs[i]->transport._socket < 0) {
+      finish(lanes[i], std::make_exception_ptr(transport_exception(
+                           "IOUring_transport run_batch: closed")));
+    } else {
+      advance(lanes[i]);
+    }
+  }
+
+  size_t in_flight = 0;
+  while (true) {
+    for (size_t i = 0; i < lanes.size() && in_flight < _MAX_IN_FLIGHT; i++) {
+      auto &l = lanes[i];
+      if (l.done || l.outstanding > 0) {
+        continue;
+      }
+      memset(&l.msg, 0, sizeof(l.msg));
+      l.msg.msg_iov = l.cursor->data();
+      l.msg.msg_iovlen = l.cursor->count();
+      io_uring_sqe *sqe = ring.next_sqe();
+      sqe->opcode = l.send ? IORING_OP_SENDMSG : IORING_OP_RECVMSG;
+      l.job->transport._target(ring, sqe);
+      sqe->addr = (uint64_t)&l.msg;
+      sqe->len = 1;
+      sqe->msg_flags = l.send ? MSG_NOSIGNAL : MSG_WAITALL;
+      // the lane's index, and whether it's the timeout, as user_data
+      sqe->user_data = i << 1;
+      l.result = -EIO;
+      l.outstanding =
+          _link_timeout(ring, sqe, l.deadline, l.ts, (i << 1) | 1) ? 2 : 1;
+      in_flight++;
+    }
+    if (in_flight == 0) {
+      return;
+    }
+
+    ring.submit_and_reap([&](const io_uring_cqe &cqe) {
+      auto &l = lanes[cqe.user_data >> 1];
+      if ((cqe.user_data & 1) == 0) {
+        l.result = cqe.res;
+      }
+      if (--l.outstanding > 0) {
+        return;
+      }
+      in_flight--;
+      int rc = l.result == -ECANCELED ? -ETIME : l.result;
+      if (rc <= 0) {
+        string what =
+            l.send ? _errno_msg("IOUring_transport run_batch send",
+                                rc == 0 ? EPIPE : -rc)
+                   : (rc == 0 ? string("IOUring_transport run_batch: eof")
+                              : _errno_msg("IOUring_transport run_batch recv",
+                                           -rc));
+        finish(l, std::make_exception_ptr(transport_exception(what)));
+        return;
+      }
+      l.cursor->consume(rc);
+      if (l.cursor->done()) {
+        advance(l);
+      }
+    });
+  }
+}
+}
+}
@@ -118,6 +118,13 @@ template <> void from(message &m, std::string &s) {
   m.skip(size);
 }
 
+template <> void from(message &m, boost::string_ref &s) {
+  uint32_t size;
+  from<uint32_t>(m, size);
+  s = boost::string_ref(m.current(size), size);
+  m.skip(size);
+}
+
 template <> void to(message_builder &mb, const double &d) noexcept {
   const char *dp = (const char *)(&d);
   mb.add_raw(dp, 8);
@@ -11,7 +11,12 @@
 #include <boost/bimap/set_of.hpp>
 #include <boost/bimap/unordered_set_of.hpp>
 #include <boost/optional.hpp>
+#include <functional>
+#include <list>
+#include <memory>
 #include <mutex>
+#include <unordered_map>
+#include <vector>
 /*
 nicked from volumedriver's LRUCacheToo, but
 
@@ -111,8 +116,261 @@ public:
     return _cache.find(k);
   }
 
+  bool erase(const K &k) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _cache.erase(k);
+  }
+
 private:
   UnsafeLRUCache<K, V> _cache;
   std::mutex _mutex;
 };
+
+/* a cache where every entry has a weight (its size in bytes, say), and
+ * that evicts while it holds more than max_entries entries or more than
+ * max_weight in total. A max of 0 means no limit. What gets evicted is
+ * up to the implementation. Not thread safe. */
+template <typename K, typename V> class UnsafeWeightedCache {
+public:
+  virtual ~UnsafeWeightedCache() = default;
+
+  virtual boost::optional<V> find(const K &k) = 0;
+  // an entry heavier than max_weight on its own isn't kept, and doesn't
+  // push anything else out
+  virtual void insert(const K &k, const V &v, size_t weight) = 0;
+  // the weight of an entry changed, if it's still v
+  virtual void reweigh(const K &k, const V &v, size_t weight) = 0;
+  virtual bool erase(const K &k) = 0;
+  virtual void erase_if(const std::function<bool(const K &)> &p) = 0;
+  virtual void set_limits(size_t max_entries, size_t max_weight) = 0;
+
+  virtual size_t size() const = 0;
+  virtual size_t weight() const = 0;
+};
+
+// evicts the least recently used entries
+template <typename K, typename V, typename Hash = std::hash<K>>
+class UnsafeWeightedLRUCache : public UnsafeWeightedCache<K, V> {
+public:
+  UnsafeWeightedLRUCache(size_t max_entries, size_t max_weight)
+      : _max_entries(max_entries), _max_weight(max_weight) {}
+
+  UnsafeWeightedLRUCache(const UnsafeWeightedLRUCache &) = delete;
+  UnsafeWeightedLRUCache &operator=(const UnsafeWeightedLRUCache &) = delete;
+
+  boost::optional<V> find(const K &k) override {
+    auto it = _index.find(k);
+    if (it == _index.end()) {
+      return boost::none;
+    }
+    _lru.splice(_lru.end(), _lru, it->second);
+    return it->second->value;
+  }
+
+  void insert(const K &k, const V &v, size_t weight) override {
+    erase(k);
+    if (_too_heavy(weight)) {
+      return;
+    }
+    _lru.push_back(entry{k, v, weight});
+    _index.emplace(k, std::prev(_lru.end()));
+    _weight += weight;
+    _evict();
+  }
+
+  void reweigh(const K &k, const V &v, size_t weight) override {
+    auto it = _index.find(k);
+    if (it != _index.end() && it->second->value == v) {
+      if (_too_heavy(weight)) {
+        erase(k);
+        return;
+      }
+      _weight = _weight - it->second->weight + weight;
+      it->second->weight = weight;
+      _evict();
+    }
+  }
+
+  bool erase(const K &k) override {
+    auto it = _index.find(k);
+    if (it == _index.end()) {
+      return false;
+    }
+    _weight -= it->second->weight;
+    _lru.erase(it->second);
+    _index.erase(it);
+    return true;
+  }
+
+  void erase_if(const std::function<bool(const K &)> &p) override {
+    for (auto it = _lru.begin(); it != _lru.end();) {
+      if (p(it->key)) {
+        _weight -= it->weight;
+        _index.erase(it->key);
+        it = _lru.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  void set_limits(size_t max_entries, size_t max_weight) override {
+    _max_entries = max_entries;
+    _max_weight = max_weight;
+    _evict();
+  }
+
+  size_t size() const override { return _index.size(); }
+  size_t weight() const override { return _weight; }
+
+private:
+  struct entry {
+    K key;
+    V value;
+    size_t weight;
+  };
+  std::list<entry> _lru; // least recently used first
+  std::unordered_map<K, typename std::list<entry>::iterator, Hash> _index;
+  size_t _weight = 0;
+  size_t _max_entries;
+  size_t _max_weight;
+
+  bool _too_heavy(size_t weight) const {
+    return _max_weight != 0 && weight > _max_weight;
+  }
+
+  void _evict() {
+    while (!_lru.empty() &&
+           ((_max_entries != 0 && _index.size() > _max_entries) ||
+            (_max_weight != 0 && _weight > _max_weight))) {
+      erase(_lru.front().key);
+    }
+  }
+};
+
+/* keys are spread over n_shards, each an UnsafeWeightedCache with its own
+ * lock: lookups of different keys rarely contend. The limits are split
+ * evenly over the shards, so eviction only approximates what one cache
+ * over all keys would do. */
+template <typename K, typename V, typename Hash = std::hash<K>>
+class ShardedCache {
+public:
+  using shard_cache = UnsafeWeightedCache<K, V>;
+  // makes the cache of one shard, given its limits
+  using factory =
+      std::function<std::unique_ptr<shard_cache>(size_t, size_t)>;
+
+  static std::unique_ptr<shard_cache> make_lru(size_t max_entries,
+                                               size_t max_weight) {
+    return std::unique_ptr<shard_cache>(
+        new UnsafeWeightedLRUCache<K, V, Hash>(max_entries, max_weight));
+  }
+
+  ShardedCache(size_t max_entries, size_t max_weight, size_t n_shards = 16,
+               factory make = make_lru)
+      : _max_entries(max_entries), _max_weight(max_weight),
+        _make(std::move(make)) {
+    if (n_shards == 0) {
+      throw std::logic_error("ShardedCache needs at least one shard");
+    }
+    _shards.reserve(n_shards);
+    for (size_t i = 0; i < n_shards; i++) {
+      _shards.emplace_back(new shard(_make(_per_shard(max_entries, n_shards),
+                                           _per_shard(max_weight, n_shards))));
+    }
+  }
+
+  void insert(const K &k, const V &v, size_t weight) {
+    shard &s = _shard(k);
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.cache->insert(k, v, weight);
+  }
+
+  boost::optional<V> find(const K &k) {
+    shard &s = _shard(k);
+    std::lock_guard<std::mutex> lock(s.mutex);
+    return s.cache->find(k);
+  }
+
+  void reweigh(const K &k, const V &v, size_t weight) {
+    shard &s = _shard(k);
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.cache->reweigh(k, v, weight);
+  }
+
+  bool erase(const K &k) {
+    shard &s = _shard(k);
+    std::lock_guard<std::mutex> lock(s.mutex);
+    return s.cache->erase(k);
+  }
+
+  void erase_if(const std::function<bool(const K &)> &p) {
+    for (auto &s : _shards) {
+      std::lock_guard<std::mutex> lock(s->mutex);
+      s->cache->erase_if(p);
+    }
+  }
+
+  void set_limits(size_t max_entries, size_t max_weight) {
+    std::lock_guard<std::mutex> g(_config_mutex);
+    _max_entries = max_entries;
+    _max_weight = max_weight;
+    for (auto &s : _shards) {
+      std::lock_guard<std::mutex> lock(s->mutex);
+      s->cache->set_limits(_per_shard(max_entries, _shards.size()),
+                           _per_shard(max_weight, _shards.size()));
+    }
+  }
+
+  // starts over, empty, with shard caches made by make
+  void set_factory(factory make) {
+    std::lock_guard<std::mutex> g(_config_mutex);
+    _make = std::move(make);
+    for (auto &s : _shards) {
+      auto cache = _make(_per_shard(_max_entries, _shards.size()),
+                         _per_shard(_max_weight, _shards.size()));
+      std::lock_guard<std::mutex> lock(s->mutex);
+      s->cache.swap(cache);
+    }
+  }
+
+  size_t size() {
+    size_t total = 0;
+    for (auto &s : _shards) {
+      std::lock_guard<std::mutex> lock(s->mutex);
+      total += s->cache->size();
+    }
+    return total;
+  }
+
+  size_t weight() {
+    size_t total = 0;
+    for (auto &s : _shards) {
+      std::lock_guard<std::mutex> lock(s->mutex);
+      total += s->cache->weight();
+    }
+    return total;
+  }
+
+private:
+  // allocated one by one, so the locks don't end up side by side
+  struct shard {
+    explicit shard(std::unique_ptr<shard_cache> cache)
+        : cache(std::move(cache)) {}
+    std::mutex mutex;
+    std::unique_ptr<shard_cache> cache;
+  };
+
+  static size_t _per_shard(size_t max, size_t n_shards) {
+    return max == 0 ? 0 : (max + n_shards - 1) / n_shards;
+  }
+
+  shard &_shard(const K &k) { return *_shards[Hash()(k) % _shards.size()]; }
+
+  std::mutex _config_mutex;
+  size_t _max_entries;
+  size_t _max_weight;
+  factory _make;
+  std::vector<std::unique_ptr<shard>> _shards;
+};
 }
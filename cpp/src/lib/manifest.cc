@@ -51,16 +51,38 @@ template <> void from(message &m, std::unique_ptr<Compression> &p) {
   p.reset(r);
 }
 
-void _from_version1(message &m, Manifest &mf, bool &ok_to_continue) {
-  ALBA_LOG(DEBUG, "_from_version1");
-  std::string compressed;
-  from(m, compressed);
-
-  std::string real;
-  snappy::Uncompress(compressed.data(), compressed.size(), &real);
-  auto buffer = message_buffer::from_string(real);
+/* uncompresses straight into a (pooled) message buffer,
+ * without an intermediate string */
+message_buffer_ptr _uncompress(const char *compressed,
+                               uint32_t compressed_size) {
+  size_t size;
+  if (!snappy::GetUncompressedLength(compressed, compressed_size, &size)) {
+    throw deserialisation_exception("manifest: corrupt snappy header");
+  }
+  bool ok = false;
+  auto buffer = message_buffer::from_reader_sized(
+      [&](char *target, const int) {
+        ok = snappy::RawUncompress(compressed, compressed_size, target);
+      },
+      size);
+  if (!ok) {
+    throw deserialisation_exception("manifest: corrupt snappy data");
+  }
+  return buffer;
+}
+
+// once the compressed bytes are consumed, m can be used for the next value
+message_buffer_ptr _uncompress(message &m, bool &ok_to_continue) {
+  uint32_t compressed_size;
+  from(m, compressed_size);
+  const char *compressed = m.current(compressed_size);
+  m.skip(compressed_size);
   ok_to_continue = true;
-  message m2(buffer);
+  return _uncompress(compressed, compressed_size);
+}
+
+void _decode_version1(message &m2, Manifest &mf) {
+  ALBA_LOG(DEBUG, "_decode_version1");
   from(m2, mf.name);
   from(m2, mf.object_id);
 
@@ -130,7 +152,7 @@ void _from_version1(message &m, Manifest &mf, bool &ok_to_continue) {
     uint32_t n_fragments = fragment_locations[c].size();
     std::vector<std::shared_ptr<Fragment>> chunk;
     for (uint32_t f = 0; f < n_fragments; f++) {
-      std::shared_ptr<Fragment> fragment_ptr(new Fragment());
+      auto fragment_ptr = std::make_shared<Fragment>();
       fragment_ptr->loc = fragment_locations[c][f];
       fragment_ptr->crc = fragment_checksums[c][f];
       fragment_ptr->len = fragment_packed_sizes[c][f];
@@ -144,13 +166,13 @@ void _from_version1(message &m, Manifest &mf, bool &ok_to_continue) {
   from(m2, mf.timestamp);
 }
 
-void _small_string_from(message &m, std::string &s) {
+boost::string_ref _small_string_view(message &m) {
   varint_t v;
   from(m, v);
-  int size = v.j;
-  s.resize(size);
-  s.replace(0, size, m.current(size), size);
+  uint32_t size = v.j;
+  boost::string_ref s(m.current(size), size);
   m.skip(size);
+  return s;
 }
 
 template <> void from(message &m, Fragment &f) {
@@ -178,9 +200,7 @@ template <> void from(message &m, Fragment &f) {
     bool has_ctr;
     from(m2, has_ctr);
     if (has_ctr) {
-      string ctr;
-      _small_string_from(m2, ctr);
-      f.ctr = ctr;
+      f.ctr = _small_string_view(m2).to_string();
     }
   }
   // TODO: need m2.is_done()
@@ -189,28 +209,14 @@ template <> void from(message &m, Fragment &f) {
     bool has_fnr;
     from(m2, has_fnr);
     if (has_fnr) {
-      string fnr;
-      _small_string_from(m2, fnr);
-      f.fnr = fnr;
+      f.fnr = _small_string_view(m2).to_string();
     }
   }
   size_left = m.get_pos() - m2.get_pos();
 }
 
-void _from_version2(message &m, Manifest &mf, bool &ok_to_continue) {
-  ALBA_LOG(DEBUG, "_from_version2");
-  uint32_t compressed_size;
-  from(m, compressed_size);
-  auto m_compressed = m.get_nested_message(compressed_size);
-  m.skip(compressed_size);
-
-  std::string real;
-  snappy::Uncompress(m_compressed.current(compressed_size), compressed_size,
-                     &real);
-
-  auto buffer = message_buffer::from_string(real); // TODO:copies
-  ok_to_continue = true;
-  message m2(buffer);
+void _decode_version2(message &m2, Manifest &mf) {
+  ALBA_LOG(DEBUG, "_decode_version2");
   from(m2, mf.name);
   from(m2, mf.object_id);
   from(m2, mf.chunk_sizes);
@@ -242,7 +248,7 @@ void _from_version2(message &m, Manifest &mf, bool &ok_to_continue) {
     from(m2, n_fragments);
     std::vector<std::shared_ptr<Fragment>> chunk(n_fragments);
     for (int32_t f = n_fragments - 1; f >= 0; --f) {
-      std::shared_ptr<Fragment> fragment_ptr(new Fragment());
+      auto fragment_ptr = std::make_shared<Fragment>();
       from(m2, *fragment_ptr);
       chunk[f] = std::move(fragment_ptr);
     };
@@ -250,22 +256,30 @@ void _from_version2(message &m, Manifest &mf, bool &ok_to_continue) {
   }
 }
 
-template <> void from2(message &m, Manifest &mf, bool &ok_to_continue) {
-  ok_to_continue = false;
-  uint8_t version;
-  from(m, version);
+void _decode(uint8_t version, message &m2, Manifest &mf) {
   switch (version) {
   case 1: {
-    _from_version1(m, mf, ok_to_continue);
+    _decode_version1(m2, mf);
   }; break;
   case 2: {
-    _from_version2(m, mf, ok_to_continue);
+    _decode_version2(m2, mf);
   }; break;
   default:
     throw deserialisation_exception("unexpecteded Manifest version");
   }
 }
 
+template <> void from2(message &m, Manifest &mf, bool &ok_to_continue) {
+  ok_to_continue = false;
+  uint8_t version;
+  from(m, version);
+  if (version != 1 && version != 2) {
+    throw deserialisation_exception("unexpecteded Manifest version");
+  }
+  message m2(_uncompress(m, ok_to_continue));
+  _decode(version, m2, mf);
+}
+
 template <> void from(message &m, Manifest &mf) {
   bool dont_care = false;
   from2(m, mf, dont_care);
@@ -288,6 +302,30 @@ template <> void from(message &m, ManifestWithNamespaceId &mfid) {
   bool dont_care = false;
   from2(m, mfid, dont_care);
 }
+
+template <> void from(message &m, CompressedManifest &cm) {
+  from(m, cm.version);
+  if (cm.version != 1 && cm.version != 2) {
+    throw deserialisation_exception("unexpecteded Manifest version");
+  }
+  from(m, cm.compressed);
+  from(m, cm.namespace_id);
+}
+
+template <>
+void to(message_builder &mb, const CompressedManifest &cm) noexcept {
+  mb.add_raw((const char *)&cm.version, 1);
+  to(mb, cm.compressed);
+  to(mb, cm.namespace_id);
+}
+}
+
+namespace proxy_protocol {
+void decode(const CompressedManifest &cm, ManifestWithNamespaceId &mf) {
+  message m2(llio::_uncompress(cm.compressed.data(), cm.compressed.size()));
+  llio::_decode(cm.version, m2, mf);
+  mf.namespace_id = cm.namespace_id;
+}
 }
 
 namespace proxy_protocol {
@@ -4,6 +4,7 @@
 */
 
 #include "manifest_cache.h"
+#include "tinylfu_cache.h"
 
 namespace alba {
 namespace proxy_client {
@@ -15,82 +16,264 @@ ManifestCache &ManifestCache::getInstance() {
   return instance;
 }
 
+ManifestCache::ManifestCache()
+    : _cache(_manifest_cache_capacity, _manifest_cache_budget),
+      _level1(std::make_shared<const level1>()) {}
+
 void ManifestCache::set_capacity(size_t capacity) {
   std::lock_guard<std::mutex> lock(_level1_mutex);
   _manifest_cache_capacity = capacity;
+  _cache.set_limits(_manifest_cache_capacity, _manifest_cache_budget);
+}
+
+void ManifestCache::set_budget(size_t bytes) {
+  std::lock_guard<std::mutex> lock(_level1_mutex);
+  _manifest_cache_budget = bytes;
+  _cache.set_limits(_manifest_cache_capacity, _manifest_cache_budget);
+}
+
+void ManifestCache::set_policy(manifest_cache_policy policy) {
+  std::lock_guard<std::mutex> lock(_level1_mutex);
+  if (policy == _policy) {
+    return;
+  }
+  ALBA_LOG(INFO, "ManifestCache::set_policy(" << policy << ")");
+  _policy = policy;
+  switch (policy) {
+  case manifest_cache_policy::lru: {
+    _cache.set_factory(manifest_cache::make_lru);
+  }; break;
+  case manifest_cache_policy::w_tinylfu: {
+    _cache.set_factory([](size_t max_entries, size_t max_weight) {
+      return std::unique_ptr<manifest_cache::shard_cache>(
+          new ovs::UnsafeWTinyLFUCache<manifest_key, lazy_manifest_entry,
+                                       manifest_key_hash>(max_entries,
+                                                          max_weight));
+    });
+  }; break;
+  }
+}
+
+void ManifestCache::open_store(const string &path, size_t max_bytes) {
+  std::lock_guard<std::mutex> lock(_level1_mutex);
+  if (_store_owner != nullptr) {
+    return;
+  }
+  try {
+    _store_owner.reset(new ManifestStore(path, max_bytes));
+    _store.store(_store_owner.get());
+  } catch (manifest_store_exception &e) {
+    ALBA_LOG(ERROR, "ManifestCache::open_store: " << e.what()
+                                                 << ", going without");
+  }
+}
+
+void ManifestCache::validate_store(const std::vector<alba_id_t> &alba_levels) {
+  if (_store_valid.load(std::memory_order_acquire)) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(_level1_mutex);
+  auto *store = _store.load();
+  if (store == nullptr || _store_valid.load()) {
+    return;
+  }
+  try {
+    store->retain(alba_levels);
+    _store_valid.store(true, std::memory_order_release);
+  } catch (manifest_store_exception &e) {
+    ALBA_LOG(ERROR, "ManifestCache::validate_store: " << e.what());
+  }
 }
 
 string make_key(const string alba_id, const string object_name) {
   return alba_id + object_name;
 }
 
+bool ManifestCache::_find_namespace(const string &namespace_, uint64_t &id) {
+  struct snapshot {
+    uint64_t generation = UINT64_MAX;
+    std::shared_ptr<const level1> l1;
+  };
+  static thread_local snapshot mine;
+  uint64_t generation = _generation.load(std::memory_order_acquire);
+  if (mine.generation != generation) {
+    std::lock_guard<std::mutex> lock(_level1_mutex);
+    mine.l1 = _level1;
+    mine.generation = _generation.load(std::memory_order_relaxed);
+  }
+  auto it = mine.l1->find(namespace_);
+  if (it == mine.l1->end()) {
+    return false;
+  }
+  id = it->second;
+  return true;
+}
+
+uint64_t ManifestCache::_add_namespace(const string &namespace_) {
+  std::lock_guard<std::mutex> lock(_level1_mutex);
+  // another thread might have beaten us to it
+  auto it1 = _level1->find(namespace_);
+  if (it1 != _level1->end()) {
+    return it1->second;
+  }
+  uint64_t id = _next_namespace_id++;
+  ALBA_LOG(INFO, "ManifestCache namespace:'" << namespace_ << "' : id " << id);
+  auto l1_new = std::make_shared<level1>(*_level1);
+  (*l1_new)[namespace_] = id;
+  _publish(std::move(l1_new));
+  return id;
+}
+
+// with _level1_mutex held
+void ManifestCache::_publish(std::shared_ptr<const level1> l1) {
+  _level1 = std::move(l1);
+  _generation.fetch_add(1, std::memory_order_release);
+}
+
 void ManifestCache::add(string namespace_, string alba_id,
-                        manifest_cache_entry mfp) {
-  ALBA_LOG(DEBUG, "ManifestCache::add namespace=" << namespace_
-                                                  << ", alba_id=" << alba_id
-                                                  << ", mfp=" << *mfp);
+                        lazy_manifest_entry mfp) {
+  ALBA_LOG(DEBUG, "ManifestCache::add namespace="
+                      << namespace_ << ", alba_id=" << alba_id
+                      << ", name=" << mfp->name);
 
-  std::shared_ptr<manifest_cache> mcp = nullptr;
-  std::shared_ptr<std::mutex> mp = nullptr;
-  {
-    std::lock_guard<std::mutex> lock(_level1_mutex);
-    auto it1 = _level1.find(namespace_);
-
-    if (it1 == _level1.end()) {
-      ALBA_LOG(INFO, "ManifestCache::add namespace:'"
-                         << namespace_ << "' : new manifest cache");
-      std::shared_ptr<manifest_cache> mc(
-          new manifest_cache(_manifest_cache_capacity));
-      std::shared_ptr<std::mutex> mm(new std::mutex);
-      auto p = std::make_pair(mc, mm);
-      _level1[namespace_] = std::move(p);
-      it1 = _level1.find(namespace_);
-    } else {
-      ALBA_LOG(DEBUG, "ManifestCache::add namespace:'"
-                          << namespace_ << "' : existing manifest cache");
+  uint64_t id;
+  if (!_find_namespace(namespace_, id)) {
+    id = _add_namespace(namespace_);
+  }
+
+  auto *store = _store.load();
+  if (store != nullptr && mfp->compressed() != nullptr) {
+    try {
+      store->put(namespace_, alba_id, mfp->name, *mfp->compressed());
+    } catch (manifest_store_exception &e) {
+      ALBA_LOG(WARNING, "ManifestCache::add: " << e.what());
     }
-    const auto &v = it1->second;
-    mcp = v.first;
-    mp = v.second;
   }
 
-  manifest_cache &manifest_cache = *mcp;
-  manifest_cache.insert(make_key(alba_id, mfp->name), std::move(mfp));
+  size_t weight = mfp->memory_size();
+  _cache.insert(manifest_key(id, make_key(alba_id, mfp->name)),
+                std::move(mfp), weight);
 }
 
 manifest_cache_entry ManifestCache::find(const string &namespace_,
                                          const string &alba_id,
                                          const string &object_name) {
-  std::pair<std::shared_ptr<manifest_cache>, std::shared_ptr<std::mutex>> vp;
-  {
-    std::lock_guard<std::mutex> g(_level1_mutex);
-    auto it = _level1.find(namespace_);
-    if (it == _level1.end()) {
+  auto *store = _valid_store();
+  uint64_t id;
+  if (!_find_namespace(namespace_, id)) {
+    if (store == nullptr) {
       return nullptr;
-    } else {
-      vp = it->second;
     }
+    id = _add_namespace(namespace_);
   }
-  auto &map = *vp.first;
-  auto &mm = *vp.second;
-  {
-    std::lock_guard<std::mutex> g(mm);
-    const auto &maybe_elem = map.find(make_key(alba_id, object_name));
-    if (boost::none == maybe_elem) {
+  const manifest_key key(id, make_key(alba_id, object_name));
+  auto maybe_elem = _cache.find(key);
+  if (boost::none == maybe_elem) {
+    if (store == nullptr) {
       return nullptr;
-    } else {
-      return *maybe_elem;
     }
+    std::unique_ptr<CompressedManifest> cm;
+    try {
+      cm = store->get(namespace_, alba_id, object_name);
+    } catch (llio::deserialisation_exception &e) {
+      ALBA_LOG(WARNING, "ManifestCache::find name=" << object_name
+                                                    << ": " << e.what());
+    }
+    if (cm == nullptr) {
+      return nullptr;
+    }
+    ALBA_LOG(DEBUG, "ManifestCache::find name=" << object_name
+                                                << " from the store");
+    auto lazy = std::make_shared<LazyManifest>(object_name, std::move(cm));
+    size_t weight = lazy->memory_size();
+    _cache.insert(key, lazy, weight);
+    maybe_elem = std::move(lazy);
+  }
+  auto &lazy = *maybe_elem;
+  bool was_decoded = lazy->decoded();
+  // decoding happens outside of the shard lock
+  try {
+    auto mf = lazy->get();
+    if (!was_decoded) {
+      _cache.reweigh(key, lazy, lazy->memory_size());
+    }
+    return mf;
+  } catch (llio::deserialisation_exception &e) {
+    ALBA_LOG(WARNING, "ManifestCache::find dropping name="
+                          << object_name << " because of " << e.what());
+    _cache.erase(key);
+    if (store != nullptr) {
+      try {
+        store->drop(namespace_, alba_id, object_name);
+      } catch (manifest_store_exception &e) {
+        ALBA_LOG(WARNING, "ManifestCache::find: " << e.what());
+      }
+    }
+    return nullptr;
   }
 }
 
 void ManifestCache::invalidate_namespace(const string &namespace_) {
   ALBA_LOG(DEBUG, "ManifestCache::invalidate_namespace(" << namespace_ << ")");
-  std::lock_guard<std::mutex> g(_level1_mutex);
-  auto it = _level1.find(namespace_);
-  if (it != _level1.end()) {
-    _level1.erase(it);
+  auto *store = _store.load();
+  if (store != nullptr) {
+    try {
+      store->drop_namespace(namespace_);
+    } catch (manifest_store_exception &e) {
+      ALBA_LOG(WARNING, "ManifestCache::invalidate_namespace: " << e.what());
+    }
   }
+  uint64_t id;
+  {
+    std::lock_guard<std::mutex> g(_level1_mutex);
+    auto it = _level1->find(namespace_);
+    if (it == _level1->end()) {
+      return;
+    }
+    id = it->second;
+    auto l1_new = std::make_shared<level1>(*_level1);
+    l1_new->erase(namespace_);
+    _publish(std::move(l1_new));
+  }
+  _cache.erase_if([id](const manifest_key &k) { return k.first == id; });
+}
+
+ManifestCache::fetch_claim
+ManifestCache::claim_fetch(const string &namespace_, const string &alba_id,
+                           const string &object_name) {
+  string key;
+  key.reserve(namespace_.size() + alba_id.size() + object_name.size() + 2);
+  key += namespace_;
+  key += '\0';
+  key += alba_id;
+  key += '\0';
+  key += object_name;
+  std::lock_guard<std::mutex> lock(_fetches_mutex);
+  auto it = _fetches.find(key);
+  if (it != _fetches.end()) {
+    return fetch_claim(std::move(key), nullptr, it->second);
+  }
+  auto promise = std::make_shared<std::promise<void>>();
+  std::shared_future<void> done = promise->get_future().share();
+  _fetches.emplace(key, done);
+  return fetch_claim(std::move(key), std::move(promise), std::move(done));
+}
+
+void ManifestCache::_fetched(const string &key) {
+  std::lock_guard<std::mutex> lock(_fetches_mutex);
+  _fetches.erase(key);
+}
+
+ManifestCache::fetch_claim::~fetch_claim() {
+  if (_promise != nullptr) {
+    getInstance()._fetched(_key);
+    _promise->set_value();
+  }
+}
+
+bool ManifestCache::fetch_claim::wait(
+    std::chrono::steady_clock::duration timeout) const {
+  return _done.wait_for(timeout) == std::future_status::ready;
 }
 }
 }
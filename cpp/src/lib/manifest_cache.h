@@ -4,43 +4,138 @@
 */
 
 #pragma once
+#include "flat_manifest.h"
 #include "lru_cache.h"
-#include "manifest.h"
+#include "manifest_store.h"
+#include "proxy_client.h"
+#include <atomic>
+#include <chrono>
+#include <future>
 #include <map>
 #include <memory>
 #include <mutex>
 #include <string>
+#include <unordered_map>
 #include <utility>
 namespace alba {
 namespace proxy_client {
 
 using namespace proxy_protocol;
-typedef std::shared_ptr<ManifestWithNamespaceId> manifest_cache_entry;
-typedef ovs::SafeLRUCache<std::string, manifest_cache_entry> manifest_cache;
+typedef std::shared_ptr<const FlatManifest> manifest_cache_entry;
+// what's stored: decoded on the first find
+typedef std::shared_ptr<LazyManifest> lazy_manifest_entry;
+
+// (namespace id, alba_id + object name)
+typedef std::pair<uint64_t, std::string> manifest_key;
+struct manifest_key_hash {
+  size_t operator()(const manifest_key &k) const {
+    return std::hash<std::string>()(k.second) ^ (k.first * 0x9e3779b97f4a7c15);
+  }
+};
+typedef ovs::ShardedCache<manifest_key, lazy_manifest_entry,
+                          manifest_key_hash>
+    manifest_cache;
+
+/* one cache for all namespaces, limited in entries and in bytes (as
+ * counted by LazyManifest::memory_size): a namespace that isn't read from
+ * anymore doesn't hold on to memory that another one could use. */
 class ManifestCache {
 public:
   static ManifestCache &getInstance();
+  // 0 for no limit
   void set_capacity(size_t capacity);
+  void set_budget(size_t bytes);
+  // empties the cache if the policy changes
+  void set_policy(manifest_cache_policy);
+
+  /* keeps the manifests in a ManifestStore at path too, and fills the
+   * cache from it on a miss, once validate_store confirmed which albas
+   * its manifests may be of. The first path opened is the one used. */
+  void open_store(const std::string &path, size_t max_bytes);
+  void validate_store(const std::vector<alba_id_t> &alba_levels);
 
   ManifestCache(ManifestCache const &) = delete;
   void operator=(ManifestCache const &) = delete;
 
   void add(std::string namespace_, std::string alba_id,
-           manifest_cache_entry rora_map);
+           lazy_manifest_entry rora_map);
 
+  // nullptr if not there, or if the manifest doesn't decode
   manifest_cache_entry find(const std::string &namespace_,
                             const std::string &alba_id,
                             const std::string &object_name);
 
   void invalidate_namespace(const std::string &);
 
+  /* single flight for misses: the first to claim the fetch of a manifest
+   * leads, and fetches it while it holds the claim. Whoever claims it in
+   * the meantime follows, and can wait() until the leader lets go before
+   * looking in the cache again. */
+  class fetch_claim {
+  public:
+    fetch_claim(fetch_claim &&) = default;
+    ~fetch_claim();
+
+    bool leader() const { return _promise != nullptr; }
+    // false if the leader still holds it after timeout
+    bool wait(std::chrono::steady_clock::duration timeout) const;
+
+  private:
+    friend class ManifestCache;
+    fetch_claim(std::string key, std::shared_ptr<std::promise<void>> promise,
+                std::shared_future<void> done)
+        : _key(std::move(key)), _promise(std::move(promise)),
+          _done(std::move(done)) {}
+
+    std::string _key;
+    std::shared_ptr<std::promise<void>> _promise; // the leader's
+    std::shared_future<void> _done;
+  };
+
+  fetch_claim claim_fetch(const std::string &namespace_,
+                          const std::string &alba_id,
+                          const std::string &object_name);
+
+  size_t size() { return _cache.size(); }
+  size_t memory_size() { return _cache.weight(); }
+
 private:
-  ManifestCache() {}
+  ManifestCache();
   size_t _manifest_cache_capacity = 10000;
+  size_t _manifest_cache_budget = 0;
+  manifest_cache_policy _policy = manifest_cache_policy::lru;
+  manifest_cache _cache;
+
+  /* namespaces get a fresh id when they're (re)created in the cache, so
+   * entries added while a namespace is invalidated can't be found anymore.
+   *
+   * The namespace table is copied on write (new namespace, invalidation),
+   * which is rare. Every thread keeps a snapshot of it, and only takes
+   * _level1_mutex to refresh that snapshot when _generation moved on:
+   * lookups don't write to any shared cache line. */
+  typedef std::map<std::string, uint64_t> level1;
   std::mutex _level1_mutex;
-  std::map<std::string, std::pair<std::shared_ptr<manifest_cache>,
-                                  std::shared_ptr<std::mutex>>>
-      _level1;
+  std::shared_ptr<const level1> _level1;
+  uint64_t _next_namespace_id = 0;
+  std::atomic<uint64_t> _generation{0};
+
+  bool _find_namespace(const std::string &, uint64_t &);
+  uint64_t _add_namespace(const std::string &);
+  void _publish(std::shared_ptr<const level1>);
+
+  std::mutex _fetches_mutex;
+  // the fetches in flight
+  std::unordered_map<std::string, std::shared_future<void>> _fetches;
+  void _fetched(const std::string &key);
+
+  std::unique_ptr<ManifestStore> _store_owner;
+  std::atomic<ManifestStore *> _store{nullptr};
+  std::atomic<bool> _store_valid{false};
+  // the store, if there is one and it's ready for lookups
+  ManifestStore *_valid_store() {
+    return _store_valid.load(std::memory_order_acquire) ? _store.load()
+                                                        : nullptr;
+  }
 };
 }
 }
@@ -0,0 +1,537 @@
+/*
+  Copyright (C) iNuron - info@openvstorage.com
+  This file is part of Open vStorage. For license information, see <LICENSE.txt>
+*/
+
+#include "manifest_store.h"
+#include "alba_logger.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <gcrypt.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace alba {
+namespace proxy_client {
+
+using std::string;
+using llio::message;
+using llio::message_buffer;
+using llio::message_builder;
+
+namespace {
+enum record_kind : uint8_t { PUT = 1, DROP = 2, DROP_NAMESPACE = 3 };
+
+const uint32_t _header_size = 8;
+
+uint32_t _crc(const char *data, size_t size) {
+  unsigned char digest[4];
+  gcry_md_hash_buffer(GCRY_MD_CRC32, digest, data, size);
+  uint32_t crc;
+  memcpy(&crc, digest, 4);
+  return crc;
+}
+
+string _errno_msg(const string &prefix, int err) {
+  return prefix + ": " + strerror(err);
+}
+
+void _to_kind(message_builder &mb, record_kind kind) {
+  mb.add_raw((const char *)&kind, 1);
+}
+}
+
+ManifestStore::ManifestStore(const string &path, size_t max_bytes)
+    : _path(path), _max_bytes(max_bytes) {
+  _open();
+  _load();
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _maybe_compact(lock);
+  }
+  ALBA_LOG(INFO, "ManifestStore(" << _path << "): " << _index.size()
+                                  << " manifests, " << _end << " bytes");
+  _writer = std::thread([this]() { _write_loop(); });
+}
+
+ManifestStore::~ManifestStore() {
+  {
+    std::lock_guard<std::mutex> g(_mutex);
+    _stopping = true;
+  }
+  // what's queued is still written
+  _queue_cond.notify_one();
+  _writer.join();
+  _close();
+}
+
+string ManifestStore::_key(const string &namespace_, const string &alba_id,
+                           const string &name) {
+  string key;
+  key.reserve(namespace_.size() + alba_id.size() + name.size() + 2);
+  key += namespace_;
+  key += '\0';
+  key += alba_id;
+  key += '\0';
+  key += name;
+  return key;
+}
+
+void ManifestStore::_open() {
+  _fd = ::open(_path.c_str(), O_RDWR | O_CREAT, 0644);
+  if (_fd < 0) {
+    throw manifest_store_exception(_errno_msg("open " + _path, errno));
+  }
+  struct stat st;
+  if (fstat(_fd, &st) != 0) {
+    int err = errno;
+    _close();
+    throw manifest_store_exception(_errno_msg("fstat " + _path, err));
+  }
+  _map_size = st.st_size;
+  if (_map_size > 0) {
+    void *p = mmap(nullptr, _map_size, PROT_READ, MAP_SHARED, _fd, 0);
+    if (p == MAP_FAILED) {
+      int err = errno;
+      _close();
+      throw manifest_store_exception(_errno_msg("mmap " + _path, err));
+    }
+    _map = (const char *)p;
+  }
+}
+
+void ManifestStore::_close() {
+  if (_map != nullptr) {
+    munmap((void *)_map, _map_size);
+    _map = nullptr;
+  }
+  _map_size = 0;
+  if (_fd >= 0) {
+    ::close(_fd);
+    _fd = -1;
+  }
+}
+
+void ManifestStore::_load() {
+  uint64_t pos = 0;
+  while (pos + _header_size <= _map_size) {
+    uint32_t size, crc;
+    memcpy(&size, _map + pos, 4);
+    memcpy(&crc, _map + pos + 4, 4);
+    uint64_t payload = pos + _header_size;
+    if (size == 0 || payload + size > _map_size ||
+        _crc(_map + payload, size) != crc) {
+      break;
+    }
+    try {
+      string record(_map + payload, size);
+      message m(message_buffer::from_string(record));
+      uint8_t kind;
+      llio::from(m, kind);
+      string namespace_;
+      llio::from(m, namespace_);
+      if (kind == DROP_NAMESPACE) {
+        for (auto it = _index.begin(); it != _index.end();) {
+          if (it->second.namespace_ == namespace_) {
+            _live_bytes -= it->second.size;
+            it = _index.erase(it);
+          } else {
+            ++it;
+          }
+        }
+      } else {
+        string alba_id, name;
+        llio::from(m, alba_id);
+        llio::from(m, name);
+        string key = _key(namespace_, alba_id, name);
+        auto it = _index.find(key);
+        if (it != _index.end()) {
+          _live_bytes -= it->second.size;
+          _index.erase(it);
+        }
+        if (kind == PUT) {
+          _index.emplace(key,
+                         entry{namespace_, alba_id, name, payload, size, crc});
+          _live_bytes += size;
+        }
+      }
+    } catch (llio::deserialisation_exception &e) {
+      ALBA_LOG(WARNING, "ManifestStore(" << _path << "): bad record at "
+                                         << pos << ": " << e.what());
+      break;
+    }
+    pos = payload + size;
+  }
+  if (pos != _map_size) {
+    ALBA_LOG(WARNING, "ManifestStore(" << _path << "): dropping "
+                                       << _map_size - pos
+                                       << " bytes at the end");
+    if (ftruncate(_fd, pos) != 0) {
+      throw manifest_store_exception(_errno_msg("ftruncate " + _path, errno));
+    }
+    _close();
+    _open();
+  }
+  _end = pos;
+}
+
+void ManifestStore::_maybe_compact(std::unique_lock<std::mutex> &lock) {
+  uint64_t used = _live_bytes + _header_size * _index.size();
+  if (_end < _compact_retry_end) {
+    return;
+  }
+  if ((_end > (1 << 20) && _end > 2 * used) ||
+      (_max_bytes != 0 && _live_bytes > _max_bytes)) {
+    _compact(lock);
+  }
+}
+
+void ManifestStore::_compact(std::unique_lock<std::mutex> &lock) {
+  // only the writer compacts (or the constructor, before there is one), so
+  // while the lock is released nothing else adds manifests or remaps the
+  // file: get and put go on, drop only takes entries away.
+  const uint64_t old_end = _end;
+  std::vector<std::pair<string, entry>> live(_index.begin(), _index.end());
+  lock.unlock();
+
+  // the most recently written first
+  std::sort(live.begin(), live.end(),
+            [](const std::pair<string, entry> &a,
+               const std::pair<string, entry> &b) {
+              return a.second.offset > b.second.offset;
+            });
+
+  const string tmp = _path + ".tmp";
+  int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    int err = errno;
+    lock.lock();
+    throw manifest_store_exception(_errno_msg("open " + tmp, err));
+  }
+  // some slack, so the next puts don't need a compaction right away
+  const size_t keep_bytes = _max_bytes - _max_bytes / 4;
+  std::unordered_map<string, entry> index;
+  size_t live_bytes = 0;
+  uint64_t pos = 0;
+  bool ok = true;
+  string record;
+  for (auto &kv : live) {
+    auto &e = kv.second;
+    if (_max_bytes != 0 && live_bytes + e.size > keep_bytes) {
+      break;
+    }
+    size_t record_size = _header_size + e.size;
+    if (!_read(e.offset - _header_size, record_size, record) ||
+        write(fd, record.data(), record_size) != (ssize_t)record_size) {
+      ok = false;
+      break;
+    }
+    entry moved = e;
+    moved.offset = pos + _header_size;
+    index.emplace(kv.first, std::move(moved));
+    live_bytes += e.size;
+    pos += record_size;
+  }
+  ok = ok && fsync(fd) == 0;
+
+  lock.lock();
+  // what was dropped meanwhile has to stay dropped in the new file
+  for (auto it = index.begin(); ok && it != index.end();) {
+    if (_index.find(it->first) != _index.end()) {
+      ++it;
+      continue;
+    }
+    auto &e = it->second;
+    string drop = _frame(_drop_payload(e.namespace_, e.alba_id, e.name));
+    ok = write(fd, drop.data(), drop.size()) == (ssize_t)drop.size();
+    pos += drop.size();
+    live_bytes -= e.size;
+    it = index.erase(it);
+  }
+  ::close(fd);
+  if (!ok || rename(tmp.c_str(), _path.c_str()) != 0) {
+    ALBA_LOG(WARNING, "ManifestStore(" << _path << "): compaction failed");
+    unlink(tmp.c_str());
+    _compact_retry_end = 2 * old_end;
+    return;
+  }
+  ALBA_LOG(INFO, "ManifestStore(" << _path << "): compacted " << _end
+                                  << " bytes to " << pos);
+  _close();
+  _open();
+  _index = std::move(index);
+  _live_bytes = live_bytes;
+  _end = pos;
+}
+
+bool ManifestStore::_read(uint64_t offset, uint32_t size, string &payload) {
+  if (offset + size <= _map_size) {
+    payload.assign(_map + offset, size);
+    return true;
+  }
+  // appended after the file was mapped
+  payload.resize(size);
+  return pread(_fd, &payload[0], size, offset) == (ssize_t)size;
+}
+
+string ManifestStore::_frame(const string &payload, uint32_t crc) {
+  uint32_t size = payload.size();
+  string record;
+  record.reserve(_header_size + size);
+  record.append((const char *)&size, 4);
+  record.append((const char *)&crc, 4);
+  record.append(payload);
+  return record;
+}
+
+string ManifestStore::_frame(const string &payload) {
+  return _frame(payload, _crc(payload.data(), payload.size()));
+}
+
+string ManifestStore::_record(const string &payload, uint32_t crc,
+                             uint64_t &offset) {
+  string record = _frame(payload, crc);
+  offset = _end;
+  _end += record.size();
+  return record;
+}
+
+void ManifestStore::_append(const string &payload) {
+  uint64_t offset;
+  string record = _record(payload, _crc(payload.data(), payload.size()),
+                          offset);
+  ssize_t written = pwrite(_fd, record.data(), record.size(), offset);
+  if (written != (ssize_t)record.size()) {
+    throw manifest_store_exception(_errno_msg("pwrite " + _path, errno));
+  }
+}
+
+string ManifestStore::_drop_payload(const string &namespace_,
+                                   const string &alba_id,
+                                   const string &name) {
+  message_builder mb;
+  _to_kind(mb, DROP);
+  llio::to(mb, namespace_);
+  llio::to(mb, alba_id);
+  llio::to(mb, name);
+  return mb.as_string_no_size();
+}
+
+void ManifestStore::_append_drop(const string &namespace_,
+                                 const string &alba_id, const string &name) {
+  _append(_drop_payload(namespace_, alba_id, name));
+}
+
+void ManifestStore::put(const string &namespace_, const string &alba_id,
+                        const string &name, const CompressedManifest &cm) {
+  message_builder mb;
+  _to_kind(mb, PUT);
+  llio::to(mb, namespace_);
+  llio::to(mb, alba_id);
+  llio::to(mb, name);
+  llio::to(mb, cm);
+  auto put = std::make_shared<pending_put>();
+  put->key = _key(namespace_, alba_id, name);
+  put->payload = mb.as_string_no_size();
+  uint32_t size = put->payload.size();
+  put->e = entry{namespace_, alba_id, name, 0, size,
+                 _crc(put->payload.data(), size)};
+
+  std::lock_guard<std::mutex> g(_mutex);
+  auto p = _pending.find(put->key);
+  if (p != _pending.end()) {
+    if (p->second->e.size == size && p->second->e.crc == put->e.crc) {
+      return;
+    }
+  } else {
+    auto it = _index.find(put->key);
+    if (it != _index.end() && it->second.size == size &&
+        it->second.crc == put->e.crc) {
+      return;
+    }
+  }
+  if (_pending_bytes + size > _max_pending_bytes) {
+    ALBA_LOG(DEBUG, "ManifestStore(" << _path << "): writer behind, not "
+                                     << "storing " << name);
+    return;
+  }
+  _pending[put->key] = put;
+  _queue.push_back(put);
+  _pending_bytes += size;
+  _queue_cond.notify_one();
+}
+
+void ManifestStore::flush() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  _flushed_cond.wait(lock, [this]() { return _queue.empty() && !_writing; });
+}
+
+void ManifestStore::_write_loop() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  while (true) {
+    _queue_cond.wait(lock, [this]() { return _stopping || !_queue.empty(); });
+    if (_queue.empty()) {
+      return;
+    }
+    auto put = _queue.front();
+    _queue.pop_front();
+    _pending_bytes -= put->payload.size();
+    auto p = _pending.find(put->key);
+    if (p != _pending.end() && p->second == put) {
+      // the disk is written to without holding up get
+      uint64_t offset;
+      string record = _record(put->payload, put->e.crc, offset);
+      _writing = true;
+      lock.unlock();
+      bool ok = pwrite(_fd, record.data(), record.size(), offset) ==
+                (ssize_t)record.size();
+      int err = errno;
+      lock.lock();
+      _writing = false;
+      if (!ok) {
+        ALBA_LOG(WARNING, _errno_msg("ManifestStore: pwrite " + _path, err));
+      }
+      // unless it was dropped or put again meanwhile
+      p = _pending.find(put->key);
+      if (p != _pending.end() && p->second == put) {
+        _pending.erase(p);
+        if (ok) {
+          auto it = _index.find(put->key);
+          if (it != _index.end()) {
+            _live_bytes -= it->second.size;
+            _index.erase(it);
+          }
+          put->e.offset = offset + _header_size;
+          _index.emplace(put->key, put->e);
+          _live_bytes += put->e.size;
+        }
+      }
+      try {
+        _maybe_compact(lock);
+      } catch (manifest_store_exception &e) {
+        ALBA_LOG(WARNING, "ManifestStore: " << e.what());
+      }
+    }
+    _flushed_cond.notify_all();
+  }
+}
+
+std::unique_ptr<CompressedManifest> ManifestStore::get(const string &namespace_,
+                                                       const string &alba_id,
+                                                       const string &name) {
+  const string key = _key(namespace_, alba_id, name);
+  string payload;
+  {
+    std::lock_guard<std::mutex> g(_mutex);
+    auto p = _pending.find(key);
+    if (p != _pending.end()) {
+      payload = p->second->payload;
+    } else {
+      auto it = _index.find(key);
+      if (it == _index.end() ||
+          !_read(it->second.offset, it->second.size, payload)) {
+        return nullptr;
+      }
+    }
+  }
+  message m(message_buffer::from_string(payload));
+  uint8_t kind;
+  string ns, a, n;
+  llio::from(m, kind);
+  llio::from(m, ns);
+  llio::from(m, a);
+  llio::from(m, n);
+  std::unique_ptr<CompressedManifest> cm(new CompressedManifest());
+  llio::from(m, *cm);
+  return cm;
+}
+
+void ManifestStore::drop(const string &namespace_, const string &alba_id,
+                         const string &name) {
+  const string key = _key(namespace_, alba_id, name);
+  std::lock_guard<std::mutex> g(_mutex);
+  // a put that is being written lands before the drop record
+  bool pending = _pending.erase(key) > 0;
+  auto it = _index.find(key);
+  if (it != _index.end() || pending) {
+    _append_drop(namespace_, alba_id, name);
+  }
+  if (it != _index.end()) {
+    _live_bytes -= it->second.size;
+    _index.erase(it);
+  }
+}
+
+void ManifestStore::drop_namespace(const string &namespace_) {
+  message_builder mb;
+  _to_kind(mb, DROP_NAMESPACE);
+  llio::to(mb, namespace_);
+
+  std::lock_guard<std::mutex> g(_mutex);
+  _append(mb.as_string_no_size());
+  for (auto it = _pending.begin(); it != _pending.end();) {
+    if (it->second->e.namespace_ == namespace_) {
+      it = _pending.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  for (auto it = _index.begin(); it != _index.end();) {
+    if (it->second.namespace_ == namespace_) {
+      _live_bytes -= it->second.size;
+      it = _index.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void ManifestStore::retain(const std::vector<string> &alba_levels) {
+  auto gone = [&alba_levels](const entry &e) {
+    return std::find(alba_levels.begin(), alba_levels.end(), e.alba_id) ==
+           alba_levels.end();
+  };
+  std::lock_guard<std::mutex> g(_mutex);
+  size_t dropped = 0;
+  for (auto it = _pending.begin(); it != _pending.end();) {
+    auto &e = it->second->e;
+    if (gone(e)) {
+      if (_index.find(it->first) == _index.end()) {
+        _append_drop(e.namespace_, e.alba_id, e.name);
+      }
+      it = _pending.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  for (auto it = _index.begin(); it != _index.end();) {
+    auto &e = it->second;
+    if (gone(e)) {
+      _append_drop(e.namespace_, e.alba_id, e.name);
+      _live_bytes -= e.size;
+      it = _index.erase(it);
+      dropped++;
+    } else {
+      ++it;
+    }
+  }
+  ALBA_LOG(INFO, "ManifestStore(" << _path << ")::retain: dropped " << dropped
+                                  << ", kept " << _index.size());
+}
+
+size_t ManifestStore::size() {
+  std::lock_guard<std::mutex> g(_mutex);
+  size_t n = _index.size();
+  for (auto &p : _pending) {
+    if (_index.find(p.first) == _index.end()) {
+      n++;
+    }
+  }
+  return n;
+}
+}
+}
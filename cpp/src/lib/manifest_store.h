@@ -0,0 +1,148 @@
+/*
+  Copyright (C) iNuron - info@openvstorage.com
+  This file is part of Open vStorage. For license information, see <LICENSE.txt>
+*/
+
+#pragma once
+#include "manifest.h"
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace alba {
+namespace proxy_client {
+
+using proxy_protocol::CompressedManifest;
+
+struct manifest_store_exception : std::exception {
+  manifest_store_exception(std::string what) : _what(what) {}
+
+  std::string _what;
+
+  virtual const char *what() const noexcept { return _what.c_str(); }
+};
+
+/* the manifests of the manifest cache, on disk, so a restarted client
+ * doesn't have to fetch them all again. Manifests are kept as they came
+ * from the proxy (compressed).
+ *
+ * The file is a log of records: a manifest for (namespace, alba_id,
+ * object name), or the removal of one, or of a whole namespace. Each
+ * record is [size:uint32][crc32:uint32][payload]; the log ends at the
+ * first record that doesn't check out (a write that didn't make it).
+ *
+ * Opening scans the record headers and keys into an index; the
+ * manifests themselves are read (from the mapped file) when asked for.
+ * New manifests are appended by a writer thread, so put doesn't wait for
+ * the disk; one that is already stored as is isn't written again.
+ * Whenever less than half of the file is still in use, or it holds more
+ * than max_bytes of manifests, the file is rewritten with the live
+ * records only (if max_bytes is exceeded, the most recent ones that fit
+ * in 3/4 of it). The writer does that without holding up get and put:
+ * the lock is only taken to swap in the new file.
+ */
+class ManifestStore {
+public:
+  // max_bytes: 0 for no limit
+  ManifestStore(const std::string &path, size_t max_bytes);
+  ~ManifestStore();
+
+  ManifestStore(const ManifestStore &) = delete;
+  ManifestStore &operator=(const ManifestStore &) = delete;
+
+  // queues the manifest for the writer; get sees it right away
+  void put(const std::string &namespace_, const std::string &alba_id,
+           const std::string &name, const CompressedManifest &);
+
+  // waits until the writer wrote what was put so far
+  void flush();
+
+  // nullptr if it's not there
+  std::unique_ptr<CompressedManifest> get(const std::string &namespace_,
+                                          const std::string &alba_id,
+                                          const std::string &name);
+
+  void drop(const std::string &namespace_, const std::string &alba_id,
+            const std::string &name);
+  void drop_namespace(const std::string &namespace_);
+  // drops the manifests of albas that aren't (any longer) in alba_levels
+  void retain(const std::vector<std::string> &alba_levels);
+
+  size_t size();
+
+private:
+  struct entry {
+    std::string namespace_;
+    std::string alba_id;
+    std::string name;
+    uint64_t offset; // of the payload
+    uint32_t size;
+    uint32_t crc;
+  };
+
+  // a put the writer hasn't written yet
+  struct pending_put {
+    std::string key;
+    entry e; // without an offset
+    std::string payload;
+  };
+  typedef std::shared_ptr<pending_put> pending_put_ptr;
+
+  // puts beyond this many bytes waiting for the writer are dropped
+  static const size_t _max_pending_bytes = 16 << 20;
+
+  const std::string _path;
+  const size_t _max_bytes;
+  std::mutex _mutex;
+  int _fd = -1;
+  const char *_map = nullptr;
+  size_t _map_size = 0;
+  uint64_t _end = 0;
+  size_t _live_bytes = 0;
+  // a compaction that failed is tried again once the file doubled
+  uint64_t _compact_retry_end = 0;
+  // _key(namespace, alba_id, name) -> entry
+  std::unordered_map<std::string, entry> _index;
+
+  // in put order. _pending has the most recent put per key, the others
+  // in the queue are skipped.
+  std::deque<pending_put_ptr> _queue;
+  std::unordered_map<std::string, pending_put_ptr> _pending;
+  size_t _pending_bytes = 0;
+  bool _writing = false;
+  bool _stopping = false;
+  std::condition_variable _queue_cond;
+  std::condition_variable _flushed_cond;
+  std::thread _writer;
+
+  static std::string _key(const std::string &namespace_,
+                          const std::string &alba_id, const std::string &name);
+
+  void _open();
+  void _close();
+  void _load();
+  // called with the lock held; _compact releases it while it copies
+  void _maybe_compact(std::unique_lock<std::mutex> &);
+  void _compact(std::unique_lock<std::mutex> &);
+  bool _read(uint64_t offset, uint32_t size, std::string &payload);
+  // [size][crc][payload]
+  static std::string _frame(const std::string &payload, uint32_t crc);
+  static std::string _frame(const std::string &payload);
+  static std::string _drop_payload(const std::string &namespace_,
+                                   const std::string &alba_id,
+                                   const std::string &name);
+  // reserves the room for the record at the end of the file
+  std::string _record(const std::string &payload, uint32_t crc,
+                      uint64_t &offset);
+  void _append(const std::string &payload);
+  void _append_drop(const std::string &namespace_, const std::string &alba_id,
+                    const std::string &name);
+  void _write_loop();
+};
+}
+}
@@ -8,6 +8,7 @@
 #include "alba_logger.h"
 
 #include "stuff.h"
+#include <algorithm>
 #include <assert.h>
 
 namespace alba {
@@ -72,29 +73,259 @@ bool OsdAccess::update(Proxy_client &client) {
 }
 
 std::vector<alba_id_t> OsdAccess::get_alba_levels(Proxy_client &client) {
-  if (_alba_levels.size() == 0) {
+  bool empty;
+  {
+    std::lock_guard<std::mutex> lock(_osd_maps_mutex);
+    empty = _alba_levels.empty();
+  }
+  if (empty) {
     if (!this->update(client)) {
       throw osd_access_exception(
           -1, "initial update of osd infos in osd_access failed");
     }
   }
+  std::lock_guard<std::mutex> lock(_osd_maps_mutex);
   return _alba_levels;
 }
 
+void OsdAccess::set_asd_transport(transport::Kind kind) {
+  asd_connection_pools.set_tcp_kind(kind);
+  _asd_transport.store(kind);
+}
+
+void OsdAccess::set_fan_out_concurrency(int concurrency) {
+  std::lock_guard<std::mutex> lock(_fan_out_mutex);
+  if (concurrency < 1) {
+    concurrency = 1;
+  }
+  if (concurrency != _fan_out_concurrency) {
+    ALBA_LOG(INFO, "OsdAccess::set_fan_out_concurrency " << _fan_out_concurrency
+                                                         << " => "
+                                                         << concurrency);
+    _fan_out_concurrency = concurrency;
+    // requests in flight keep the old pool alive
+    _fan_out_pool = nullptr;
+  }
+}
+
+namespace {
+const size_t _LATENCY_WINDOW = 128;
+const size_t _LATENCY_MIN_SAMPLES = 16;
+}
+
+void OsdAccess::_record_latency(osd_t osd,
+                                std::chrono::steady_clock::duration d) {
+  std::lock_guard<std::mutex> lock(_latency_mutex);
+  auto &w = _latencies[osd];
+  if (w.samples.size() < _LATENCY_WINDOW) {
+    w.samples.push_back(d);
+  } else {
+    w.samples[w.next] = d;
+    w.next = (w.next + 1) % _LATENCY_WINDOW;
+  }
+}
+
+std::chrono::steady_clock::duration
+OsdAccess::latency_percentile(const std::set<osd_t> &osds, double percentile) {
+  std::chrono::steady_clock::duration result(0);
+  std::vector<std::chrono::steady_clock::duration> samples;
+  std::lock_guard<std::mutex> lock(_latency_mutex);
+  for (auto osd : osds) {
+    auto it = _latencies.find(osd);
+    if (it == _latencies.end() ||
+        it->second.samples.size() < _LATENCY_MIN_SAMPLES) {
+      return _timeout;
+    }
+    samples = it->second.samples;
+    size_t n = std::min(samples.size() - 1,
+                        (size_t)(percentile * samples.size()));
+    std::nth_element(samples.begin(), samples.begin() + n, samples.end());
+    result = std::max(result, samples[n]);
+  }
+  return result;
+}
+
 int OsdAccess::read_osds_slices(
     std::map<osd_t, std::vector<asd_slice>> &per_osd) {
+  std::set<osd_t> unread_osds;
+  return read_osds_slices(per_osd, unread_osds);
+}
+
+namespace {
+bool _is_set(const std::atomic<bool> *flag) {
+  return flag != nullptr && flag->load();
+}
+}
 
+int OsdAccess::read_osds_slices(
+    std::map<osd_t, std::vector<asd_slice>> &per_osd,
+    std::set<osd_t> &unread_osds, const std::atomic<bool> *cancelled) {
+
+  if (_is_set(cancelled)) {
+    for (auto &item : per_osd) {
+      unread_osds.insert(item.first);
+    }
+    return 0;
+  }
+
+  if (_asd_transport.load() == transport::Kind::io_uring &&
+      per_osd.size() > 1) {
+    return _read_osds_slices_batched(per_osd, unread_osds);
+  }
+
+  int concurrency;
+  std::shared_ptr<workers::WorkerPool> pool;
+  {
+    std::lock_guard<std::mutex> lock(_fan_out_mutex);
+    concurrency = _fan_out_concurrency;
+    if (concurrency > 1 && per_osd.size() > 1) {
+      if (nullptr == _fan_out_pool) {
+        _fan_out_pool =
+            std::make_shared<workers::WorkerPool>(concurrency - 1);
+      }
+      pool = _fan_out_pool;
+    }
+  }
+
+  if (nullptr == pool) {
+    int rc = 0;
+    for (auto &item : per_osd) {
+      osd_t osd = item.first;
+      if (rc || _is_set(cancelled)) {
+        unread_osds.insert(osd);
+        continue;
+      }
+      auto &osd_slices = item.second;
+      rc = _read_osd_slices_asd_direct_path(osd, osd_slices);
+      if (rc) {
+        unread_osds.insert(osd);
+      }
+    }
+    return rc;
+  } else {
+    std::vector<std::pair<osd_t, std::vector<asd_slice> *>> work;
+    work.reserve(per_osd.size());
+    for (auto &item : per_osd) {
+      work.emplace_back(item.first, &item.second);
+    }
+    return _read_osds_slices_parallel(work, pool, concurrency, unread_osds,
+                                      cancelled);
+  }
+}
+
+namespace {
+struct fan_out_state {
+  std::vector<std::pair<osd_t, std::vector<asd_slice> *>> work;
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::vector<bool> ok;
+  size_t next = 0;
+  size_t in_flight = 0;
   int rc = 0;
-  for (auto &item : per_osd) {
-    osd_t osd = item.first;
-    auto &osd_slices = item.second;
-    // TODO this could be done in parallel
-    rc = _read_osd_slices_asd_direct_path(osd, osd_slices);
-    if (rc) {
-      break;
+  // a lane saw the read was cancelled
+  bool stopped = false;
+
+  bool finished() const { return rc != 0 || next >= work.size() || stopped; }
+  bool done() const { return finished() && in_flight == 0; }
+};
+}
+
+int OsdAccess::_read_osds_slices_parallel(
+    std::vector<std::pair<osd_t, std::vector<asd_slice> *>> &work,
+    std::shared_ptr<workers::WorkerPool> &pool, int concurrency,
+    std::set<osd_t> &unread_osds, const std::atomic<bool> *cancelled) {
+
+  // lanes claim the next osd under the state's mutex; the calling thread is a
+  // lane too, so progress is guaranteed even when the pool is saturated.
+  // Helpers that only get scheduled after we returned find nothing left to
+  // claim, and the shared state keeps them from touching our stack.
+  auto state = std::make_shared<fan_out_state>();
+  state->work = std::move(work);
+  state->ok.resize(state->work.size(), false);
+
+  // cancelled belongs to the caller: a lane only looks at it while the
+  // caller can't have returned yet (nothing finished)
+  auto lane = [this, state, cancelled]() {
+    while (true) {
+      std::pair<osd_t, std::vector<asd_slice> *> item;
+      size_t i;
+      {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        if (state->finished()) {
+          return;
+        }
+        if (_is_set(cancelled)) {
+          state->stopped = true;
+          state->cond.notify_all();
+          return;
+        }
+        i = state->next;
+        item = state->work[i];
+        state->next++;
+        state->in_flight++;
+      }
+      int rc_i = _read_osd_slices_asd_direct_path(item.first, *item.second);
+      {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->in_flight--;
+        state->ok[i] = (rc_i == 0);
+        if (rc_i != 0 && state->rc == 0) {
+          // first failure wins, the other lanes stop picking up work
+          state->rc = rc_i;
+        }
+      }
+      state->cond.notify_all();
     }
+  };
+
+  size_t n_lanes = std::min((size_t)concurrency, state->work.size());
+  for (size_t i = 1; i < n_lanes; i++) {
+    pool->submit(lane);
   }
-  return rc;
+  lane();
+
+  std::unique_lock<std::mutex> lock(state->mutex);
+  state->cond.wait(lock, [&state] { return state->done(); });
+  for (size_t i = 0; i < state->work.size(); i++) {
+    if (!state->ok[i]) {
+      unread_osds.insert(state->work[i].first);
+    }
+  }
+  return state->rc;
+}
+
+namespace {
+// group the slices per fragment: 1 partial get per key,
+// one after the other on one connection
+std::vector<asd_client::key_slices> _by_key(std::vector<asd_slice> &slices) {
+  std::vector<asd_client::key_slices> batch;
+  std::map<std::string, size_t> key_index;
+  for (auto &slice_ : slices) {
+    alba::asd_protocol::slice slice__;
+    slice__.offset = slice_.offset;
+    slice__.length = slice_.len;
+    slice__.target = slice_.target;
+    auto it = key_index.find(slice_.key);
+    if (it == key_index.end()) {
+      key_index.emplace(slice_.key, batch.size());
+      batch.emplace_back(slice_.key,
+                         std::vector<alba::asd_protocol::slice>{slice__});
+    } else {
+      batch[it->second].second.push_back(slice__);
+    }
+  }
+  return batch;
+}
+
+std::string _what(std::exception_ptr error) {
+  try {
+    std::rethrow_exception(error);
+  } catch (std::exception &e) {
+    return e.what();
+  } catch (...) {
+    return "unknown exception";
+  }
+}
 }
 
 int OsdAccess::_read_osd_slices_asd_direct_path(
@@ -112,30 +343,120 @@ int OsdAccess::_read_osd_slices_asd_direct_path(
   auto connection = p->get_connection();
 
   if (connection) {
-    try {
-      // TODO 1 batch call...
-      for (auto &slice_ : slices) {
-        alba::asd_protocol::slice slice__;
-        slice__.offset = slice_.offset;
-        slice__.length = slice_.len;
-        slice__.target = slice_.target;
-        std::vector<alba::asd_protocol::slice> slices_{slice__};
-        connection->partial_get(slice_.key, slices_);
-      }
-      p->release_connection(std::move(connection));
-      return 0;
-    } catch (std::exception &e) {
-      p->report_failure();
-      ALBA_LOG(INFO, "exception in _read_osd_slices_asd_direct_path for osd "
-                         << osd << " " << e.what());
-      return -1;
-    }
+    auto batch = _by_key(slices);
+    return _partial_get(osd, *p, std::move(connection), batch);
   } else {
     // asd was disqualified
     return -2;
   }
 }
 
+int OsdAccess::_partial_get(osd_t osd, asd::ConnectionPool &pool,
+                            std::unique_ptr<asd::Asd_client> connection,
+                            std::vector<asd_client::key_slices> &batch) {
+  try {
+    auto t0 = std::chrono::steady_clock::now();
+    connection->partial_get(batch);
+    _record_latency(osd, std::chrono::steady_clock::now() - t0);
+    pool.release_connection(std::move(connection));
+    return 0;
+  } catch (std::exception &e) {
+    pool.report_failure();
+    ALBA_LOG(INFO, "exception in _read_osd_slices_asd_direct_path for osd "
+                       << osd << " " << e.what());
+    return -1;
+  }
+}
+
+int OsdAccess::_read_osds_slices_batched(
+    std::map<osd_t, std::vector<asd_slice>> &per_osd,
+    std::set<osd_t> &unread_osds) {
+
+  struct leg {
+    osd_t osd;
+    asd::ConnectionPool *pool;
+    std::unique_ptr<asd::Asd_client> connection;
+    std::vector<asd_client::key_slices> batch;
+    std::unique_ptr<transport::IOUring_job> job;
+  };
+
+  int rc = 0;
+  auto fail = [&](osd_t osd, int rc_osd) {
+    unread_osds.insert(osd);
+    if (rc == 0) {
+      rc = rc_osd;
+    }
+  };
+
+  // the jobs point into the legs, which mustn't move
+  std::vector<leg> legs;
+  legs.reserve(per_osd.size());
+  std::vector<transport::IOUring_job *> jobs;
+  for (auto &item : per_osd) {
+    osd_t osd = item.first;
+    auto maybe_ic = _find_osd(osd);
+    if (nullptr == maybe_ic) {
+      ALBA_LOG(WARNING, "have context, but no info?");
+      fail(osd, -1);
+      continue;
+    }
+    auto p = asd_connection_pools.get_connection_pool(
+        maybe_ic->first, _connection_pool_size, _timeout);
+    if (nullptr == p) {
+      fail(osd, -1);
+      continue;
+    }
+    auto connection = p->get_connection();
+    if (!connection) {
+      // asd was disqualified
+      fail(osd, -2);
+      continue;
+    }
+    legs.emplace_back();
+    auto &l = legs.back();
+    l.osd = osd;
+    l.pool = p;
+    l.connection = std::move(connection);
+    l.batch = _by_key(item.second);
+    l.job = l.connection->partial_get_job(l.batch);
+    if (l.job != nullptr) {
+      jobs.push_back(l.job.get());
+    }
+  }
+
+  auto t0 = std::chrono::steady_clock::now();
+  bool ring_failed = false;
+  try {
+    transport::IOUring_transport::run_batch(jobs);
+  } catch (std::exception &e) {
+    // not the asds' fault, but their connections are in an unknown state
+    ALBA_LOG(WARNING, "OsdAccess::_read_osds_slices_batched: " << e.what());
+    ring_failed = true;
+  }
+
+  for (auto &l : legs) {
+    if (l.job == nullptr) {
+      // an asd that isn't on io_uring (rdma) takes the plain path
+      int rc_osd =
+          _partial_get(l.osd, *l.pool, std::move(l.connection), l.batch);
+      if (rc_osd) {
+        fail(l.osd, rc_osd);
+      }
+    } else if (ring_failed) {
+      fail(l.osd, -1);
+    } else if (l.job->error) {
+      l.pool->report_failure();
+      ALBA_LOG(INFO, "exception in _read_osds_slices_batched for osd "
+                         << l.osd << " " << _what(l.job->error));
+      fail(l.osd, -1);
+    } else {
+      _record_latency(l.osd, l.job->finished - t0);
+      l.pool->release_connection(std::move(l.connection));
+    }
+  }
+  return rc;
+}
+
 std::ostream &operator<<(std::ostream &os, const asd_slice &s) {
   os << "asd_slice{ _"
      << ", " << s.offset << ", " << s.len << ", _"
@@ -20,11 +20,10 @@ template <> void from(message &m, proxy_protocol::OsdInfo &info) {
     throw deserialisation_exception(
         "unexpected version while deserializing OsdInfo");
   }
-  std::string inner_s;
-  from(m, inner_s);
-  auto mb = message_buffer::from_string(inner_s);
-  std::vector<char> inner_v(inner_s.begin(), inner_s.end());
-  message inner(mb);
+  uint32_t inner_size;
+  from(m, inner_size);
+  message inner = m.get_nested_message(inner_size);
+  m.skip(inner_size);
 
   uint8_t kind;
   from(inner, kind);
@@ -85,15 +84,14 @@ template <> void from(message &m, proxy_protocol::OsdCapabilities &caps) {
       caps.rora_port.emplace(port);
     }; break;
     case 4: {
-      std::vector<std::string> rora_ips;
-      from(m, rora_ips);
-      caps.rora_ips.emplace(rora_ips);
+      caps.rora_ips.emplace();
+      from(m, *caps.rora_ips);
       uint32_t port;
       from(m, port);
       caps.rora_port.emplace(port);
-      std::string transport;
+      boost::string_ref transport;
       from(m, transport);
-      caps.rora_transport.emplace(transport);
+      caps.rora_transport.emplace(transport.data(), transport.size());
     }
     default: {
       if (length == 0) {
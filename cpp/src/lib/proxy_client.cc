@@ -7,6 +7,7 @@
 #include "rora_proxy_client.h"
 
 #include "transport_helper.h"
+#include "worker_pool.h"
 
 #include "alba_logger.h"
 
@@ -40,8 +41,12 @@ make_proxy_client(const std::string &ip, const std::string &port,
     return std::unique_ptr<Proxy_client>(inner_client.release());
   } else {
     ALBA_LOG(INFO, "make_proxy_client( rora_config=" << *rora_config << " )");
-    return std::unique_ptr<Proxy_client>(
-        new RoraProxy_client(std::move(inner_client), *rora_config));
+    // the legs that run in the background get their own connections
+    proxy_connector connect = [ip, port, timeout, transport]() {
+      return _make_proxy_client(ip, port, timeout, transport);
+    };
+    return std::unique_ptr<Proxy_client>(new RoraProxy_client(
+        std::move(inner_client), *rora_config, std::move(connect)));
   }
 }
 
@@ -51,11 +56,100 @@ void Proxy_client::apply_sequence(const std::string &namespace_,
   this->apply_sequence(namespace_, write_barrier, seq._asserts, seq._updates);
 }
 
+std::future<void> Proxy_client::_run_async(std::function<void()> read,
+                                           read_done_callback on_done) {
+  {
+    std::lock_guard<std::mutex> lock(_outstanding_mutex);
+    _outstanding++;
+  }
+  return workers::event_loop().submit([this, read, on_done]() {
+    std::exception_ptr error;
+    try {
+      read();
+    } catch (...) {
+      error = std::current_exception();
+    }
+    if (on_done) {
+      on_done(error);
+    }
+    {
+      // the last we touch of this: the client can be gone right after
+      std::lock_guard<std::mutex> lock(_outstanding_mutex);
+      _outstanding--;
+      _outstanding_cond.notify_all();
+    }
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  });
+}
+
+void Proxy_client::_drain_async() {
+  std::unique_lock<std::mutex> lock(_outstanding_mutex);
+  _outstanding_cond.wait(lock, [this]() { return _outstanding == 0; });
+}
+
+std::future<void> Proxy_client::read_objects_slices_async(
+    const std::string &namespace_,
+    const std::vector<proxy_protocol::ObjectSlices> &slices,
+    const consistent_read consistent_read_,
+    alba::statistics::RoraCounter &cntr, read_done_callback on_done) {
+  return _run_async(
+      [this, namespace_, slices, consistent_read_, &cntr]() {
+        std::lock_guard<std::mutex> lock(_async_mutex);
+        read_objects_slices(namespace_, slices, consistent_read_, cntr);
+      },
+      std::move(on_done));
+}
+
+std::future<void>
+Proxy_client::prefetch_manifests(const std::string &,
+                                 const std::vector<std::string> &) {
+  std::promise<void> done;
+  done.set_value();
+  return done.get_future();
+}
+
 std::ostream &operator<<(std::ostream &os, const RoraConfig &cfg) {
   os << "RoraConfig{"
      << " manifest_cache_size= " << cfg.manifest_cache_size
-     << ", asd_connection_pool_size= " << cfg.asd_connection_pool_size << " }";
+     << ", asd_connection_pool_size= " << cfg.asd_connection_pool_size
+     << ", asd_fan_out_concurrency= " << cfg.asd_fan_out_concurrency
+     << ", hedge_percentile= " << cfg.hedge_percentile
+     << ", tcp_reactor_threads= " << cfg.tcp_reactor_threads
+     << ", asd_transport= " << cfg.asd_transport
+     << ", manifest_cache_bytes= " << cfg.manifest_cache_bytes
+     << ", manifest_cache_policy= " << cfg.manifest_cache_policy_
+     << ", manifest_store_path= " << cfg.manifest_store_path
+     << ", manifest_store_bytes= " << cfg.manifest_store_bytes << " }";
   return os;
 }
+
+std::ostream &operator<<(std::ostream &os, manifest_cache_policy p) {
+  switch (p) {
+  case manifest_cache_policy::lru:
+    os << "LRU";
+    break;
+  case manifest_cache_policy::w_tinylfu:
+    os << "W_TINYLFU";
+    break;
+  }
+
+  return os;
+}
+
+std::istream &operator>>(std::istream &is, manifest_cache_policy &p) {
+  std::string s;
+  is >> s;
+  if (s == "LRU") {
+    p = manifest_cache_policy::lru;
+  } else if (s == "W_TINYLFU") {
+    p = manifest_cache_policy::w_tinylfu;
+  } else {
+    is.setstate(std::ios_base::failbit);
+  }
+
+  return is;
+}
 }
 }
@@ -40,6 +40,12 @@ using llio::from;
 
 void write_tag(message_builder &mb, uint32_t tag) { to<uint32_t>(mb, tag); }
 
+// the tag and the arguments, in a builder that grows at most once
+template <typename... Ts>
+void write_request(message_builder &mb, uint32_t tag, const Ts &... ts) {
+  llio::to_all(mb, tag, ts...);
+}
+
 void read_status(message &m, Status &status) {
   uint32_t rc;
   from(m, rc);
@@ -52,22 +58,13 @@ void read_status(message &m, Status &status) {
   }
 }
 
-void write_range_params(message_builder &mb, const string &first,
-                        const bool finc, const optional<string> &last,
-                        const bool linc, const int max, const bool reverse) {
-  to(mb, first);
-  to(mb, finc);
-
+boost::optional<std::pair<string, bool>>
+_range_last(const optional<string> &last, const bool linc) {
   boost::optional<std::pair<string, bool>> lasto;
-  if (boost::none == last) {
-    lasto = boost::none;
-  } else {
+  if (boost::none != last) {
     lasto = std::pair<string, bool>(*last, linc);
   }
-  to(mb, lasto);
-
-  to<uint32_t>(mb, max);
-  to(mb, reverse);
+  return lasto;
 }
 
 void write_list_namespaces_request(message_builder &mb, const string &first,
@@ -75,8 +72,8 @@ void write_list_namespaces_request(message_builder &mb, const string &first,
                                    const optional<string> &last,
                                    const bool linc, const int max,
                                    const bool reverse) {
-  write_tag(mb, _LIST_NAMESPACES);
-  write_range_params(mb, first, finc, last, linc, max, reverse);
+  write_request(mb, _LIST_NAMESPACES, first, finc, _range_last(last, linc),
+                (uint32_t)max, reverse);
 }
 void read_list_namespaces_response(message &m, Status &status,
                                    std::vector<string> &namespaces,
@@ -89,8 +86,7 @@ void read_list_namespaces_response(message &m, Status &status,
 }
 
 void write_namespace_exists_request(message_builder &mb, const string &name) {
-  write_tag(mb, _NAMESPACE_EXISTS);
-  to(mb, name);
+  write_request(mb, _NAMESPACE_EXISTS, name);
 }
 void read_namespace_exists_response(message &m, Status &status, bool &exists) {
   read_status(m, status);
@@ -101,17 +97,14 @@ void read_namespace_exists_response(message &m, Status &status, bool &exists) {
 
 void write_create_namespace_request(message_builder &mb, const string &name,
                                     const optional<string> &preset_name) {
-  write_tag(mb, _CREATE_NAMESPACE);
-  to(mb, name);
-  to(mb, preset_name);
+  write_request(mb, _CREATE_NAMESPACE, name, preset_name);
 }
 void read_create_namespace_response(message &m, Status &status) {
   read_status(m, status);
 }
 
 void write_delete_namespace_request(message_builder &mb, const string &name) {
-  write_tag(mb, _DELETE_NAMESPACE);
-  to(mb, name);
+  write_request(mb, _DELETE_NAMESPACE, name);
 }
 void read_delete_namespace_response(message &m, Status &status) {
   read_status(m, status);
@@ -121,9 +114,8 @@ void write_list_objects_request(message_builder &mb, const string &namespace_,
                                 const string &first, const bool finc,
                                 const optional<string> &last, const bool linc,
                                 const int max, const bool reverse) {
-  write_tag(mb, _LIST_OBJECTS);
-  to(mb, namespace_);
-  write_range_params(mb, first, finc, last, linc, max, reverse);
+  write_request(mb, _LIST_OBJECTS, namespace_, first, finc,
+                _range_last(last, linc), (uint32_t)max, reverse);
 }
 
 void read_list_objects_response(message &m, Status &status,
@@ -140,12 +132,8 @@ void write_read_object_fs_request(message_builder &mb, const string &namespace_,
                                   const string &dest_file,
                                   const bool consistent_read,
                                   const bool should_cache) {
-  write_tag(mb, _READ_OBJECT_FS);
-  to(mb, namespace_);
-  to(mb, object_name);
-  to(mb, dest_file);
-  to(mb, consistent_read);
-  to(mb, should_cache);
+  write_request(mb, _READ_OBJECT_FS, namespace_, object_name, dest_file,
+                consistent_read, should_cache);
 }
 
 void read_read_object_fs_response(message &m, Status &status) {
@@ -158,11 +146,8 @@ void _write_write_object_fs_request(message_builder &mb, uint32_t tag,
                                     const string &input_file,
                                     const bool allow_overwrite,
                                     const Checksum *checksum) {
-  write_tag(mb, tag);
-  to(mb, namespace_);
-  to(mb, object_name);
-  to(mb, input_file);
-  to(mb, allow_overwrite);
+  // the checksum serializes itself, it's not part of the size up front
+  write_request(mb, tag, namespace_, object_name, input_file, allow_overwrite);
   if (nullptr == checksum) {
     to<boost::optional<const Checksum *>>(mb, boost::none);
   } else {
@@ -208,10 +193,7 @@ void read_write_object_fs2_response(message &m, Status &status,
 void write_delete_object_request(message_builder &mb, const string &namespace_,
                                  const string &object_name,
                                  const bool may_not_exist) {
-  write_tag(mb, _DELETE_OBJECT);
-  to(mb, namespace_);
-  to(mb, object_name);
-  to(mb, may_not_exist);
+  write_request(mb, _DELETE_OBJECT, namespace_, object_name, may_not_exist);
 }
 
 void read_delete_object_response(message &m, Status &status) {
@@ -223,11 +205,8 @@ void write_get_object_info_request(message_builder &mb,
                                    const string &object_name,
                                    const bool consistent_read,
                                    const bool should_cache) {
-  write_tag(mb, _GET_OBJECT_INFO);
-  to(mb, namespace_);
-  to(mb, object_name);
-  to(mb, consistent_read);
-  to(mb, should_cache);
+  write_request(mb, _GET_OBJECT_INFO, namespace_, object_name, consistent_read,
+                should_cache);
 }
 
 void read_get_object_info_response(message &m, Status &status, uint64_t &size,
@@ -243,10 +222,7 @@ void _write_read_objects_slices_request(const int tag, message_builder &mb,
                                         const string &namespace_,
                                         const std::vector<ObjectSlices> &slices,
                                         const bool consistent_read) {
-  write_tag(mb, tag);
-  to(mb, namespace_);
-  to(mb, slices);
-  to(mb, consistent_read);
+  write_request(mb, tag, namespace_, slices, consistent_read);
 }
 
 void write_read_objects_slices_request(message_builder &mb,
@@ -295,21 +271,11 @@ void _read_object_infos(message &m, std::vector<object_info> &object_infos) {
     from(m, name);
     std::string future;
     from(m, future);
-    bool ok_to_continue = false;
-    try {
-      unique_ptr<ManifestWithNamespaceId> umf(new ManifestWithNamespaceId());
-      from2(m, *umf, ok_to_continue);
-      assert(name == umf->name);
-      auto t = make_tuple(move(name), move(future), move(umf));
-      object_infos.push_back(move(t));
-    } catch (alba::llio::deserialisation_exception &e) {
-      if (ok_to_continue) {
-        ALBA_LOG(WARNING, "skipping name=" << name << " because of "
-                                           << e.what());
-      } else {
-        throw;
-      }
-    }
+    // decoding is left to whoever needs the manifest
+    unique_ptr<CompressedManifest> cmf(new CompressedManifest());
+    from(m, *cmf);
+    auto t = make_tuple(move(name), move(future), move(cmf));
+    object_infos.push_back(move(t));
   }
 }
 
@@ -332,12 +298,90 @@ void read_read_objects_slices2_response(
   }
 }
 
+namespace {
+llio::message_buffer_ptr _read_buffer(transport::Transport &t,
+                                                   uint32_t size) {
+  return llio::message_buffer::from_reader_sized(
+      [&](char *buffer, const int len) { t.read_exact(buffer, len); }, size);
+}
+
+/* reads the response up to and including the slice data.
+ * returns the size of the rest of the message. */
+uint32_t _read_slices(transport::Transport &t, Status &status,
+                      const std::vector<ObjectSlices> &objects_slices) {
+  uint32_t size;
+  t.read_exact((char *)&size, 4);
+  if (size < 4) {
+    throw llio::deserialisation_exception(
+        "read_objects_slices response: too short");
+  }
+  uint32_t rc;
+  t.read_exact((char *)&rc, 4);
+  uint32_t left = size - 4;
+  status.set_rc(rc);
+  if (rc != 0) {
+    message m(_read_buffer(t, left));
+    from(m, status._what);
+    return 0;
+  }
+
+  if (left < 4) {
+    if (left > 0) {
+      _read_buffer(t, left);
+    }
+    throw llio::deserialisation_exception(
+        "read_objects_slices response: no data size");
+  }
+  uint32_t data_size;
+  t.read_exact((char *)&data_size, 4);
+  left -= 4;
+
+  std::vector<struct iovec> iov;
+  uint64_t total = 0;
+  for (auto &object_slices : objects_slices) {
+    for (auto &slice : object_slices.slices) {
+      iov.push_back(iovec{slice.buf, slice.size});
+      total += slice.size;
+    }
+  }
+  if (total != data_size || data_size > left) {
+    // consume the rest, so the connection stays usable
+    if (left > 0) {
+      _read_buffer(t, left);
+    }
+    throw llio::deserialisation_exception(
+        "read_objects_slices response: unexpected data size");
+  }
+  t.readv_exact(iov.data(), iov.size());
+  return left - data_size;
+}
+}
+
+void read_read_objects_slices_response(
+    transport::Transport &t, Status &status,
+    const std::vector<ObjectSlices> &objects_slices) {
+  uint32_t left = _read_slices(t, status, objects_slices);
+  if (left > 0) {
+    _read_buffer(t, left);
+  }
+}
+
+void read_read_objects_slices2_response(
+    transport::Transport &t, Status &status,
+    const std::vector<ObjectSlices> &objects_slices,
+    std::vector<object_info> &object_infos) {
+  uint32_t left = _read_slices(t, status, objects_slices);
+  if (status.is_ok()) {
+    message m(_read_buffer(t, left));
+    _read_object_infos(m, object_infos);
+  }
+}
+
 void write_update_session_request(
     message_builder &mb,
     const std::vector<std::pair<std::string, boost::optional<std::string>>>
         &args) {
-  write_tag(mb, _UPDATE_SESSION);
-  to(mb, args);
+  write_request(mb, _UPDATE_SESSION, args);
 }
 
 void read_update_session_response(
@@ -354,9 +398,8 @@ void write_apply_sequence_request(
         &asserts,
     const std::vector<std::shared_ptr<alba::proxy_client::sequences::Update>>
         &updates) {
-  write_tag(mb, _APPLY_SEQUENCE);
-  to(mb, namespace_);
-  to(mb, write_barrier);
+  // asserts and updates serialize themselves
+  write_request(mb, _APPLY_SEQUENCE, namespace_, write_barrier);
   to(mb, asserts);
   to(mb, updates);
 }
@@ -372,8 +415,7 @@ void read_apply_sequence_response(message &m, Status &status,
 
 void write_invalidate_cache_request(message_builder &mb,
                                     const string &namespace_) {
-  write_tag(mb, _INVALIDATE_CACHE);
-  to(mb, namespace_);
+  write_request(mb, _INVALIDATE_CACHE, namespace_);
 }
 
 void read_invalidate_cache_response(message &m, Status &status) {
@@ -381,8 +423,7 @@ void read_invalidate_cache_response(message &m, Status &status) {
 }
 
 void write_drop_cache_request(message_builder &mb, const string &namespace_) {
-  write_tag(mb, _DROP_CACHE);
-  to(mb, namespace_);
+  write_request(mb, _DROP_CACHE, namespace_);
 }
 
 void read_drop_cache_response(message &m, Status &status) {
@@ -406,8 +447,7 @@ void read_get_proxy_version_response(message &m, Status &status, int32_t &major,
 }
 
 void write_ping_request(message_builder &mb, const double delay) {
-  write_tag(mb, _PING);
-  to(mb, delay);
+  write_request(mb, _PING, delay);
 }
 
 void read_ping_response(message &m, Status &status, double &timestamp) {
@@ -429,12 +469,10 @@ void _read_osd_infos(message &m, osd_map_t &result) {
     from(m, info_s_size);
     auto m2 = m.get_nested_message(info_s_size);
     m.skip(info_s_size);
-    OsdInfo info;
-    from(m2, info);
-    OsdCapabilities caps;
-    from(m, caps);
-    auto p = std::shared_ptr<info_caps>(
-        new info_caps(std::move(info), std::move(caps)));
+    // decode in place: one allocation for the pair and its control block
+    auto p = std::make_shared<info_caps>();
+    from(m2, p->first);
+    from(m, p->second);
 
     result[osd_id] = std::move(p);
   }
@@ -485,9 +523,7 @@ void read_has_local_fragment_cache_response(message &m, Status &status,
 void write_get_fragment_encryption_key_request(message_builder &mb,
                                                const string &alba_id,
                                                const namespace_t namespace_id) {
-  write_tag(mb, _GET_FRAGMENT_ENCRYPTION_KEY);
-  to(mb, alba_id);
-  to(mb, namespace_id.i);
+  write_request(mb, _GET_FRAGMENT_ENCRYPTION_KEY, alba_id, namespace_id.i);
 }
 
 void read_get_fragment_encryption_key_response(
@@ -519,14 +555,12 @@ namespace llio {
 template <>
 void to(message_builder &mb,
         const proxy_protocol::SliceDescriptor &desc) noexcept {
-  to(mb, desc.offset);
-  to(mb, desc.size);
+  to_fields(mb, desc);
 }
 template <>
 void to(message_builder &mb,
         const proxy_protocol::ObjectSlices &slices) noexcept {
-  to(mb, slices.object_name);
-  to(mb, slices.slices);
+  to_fields(mb, slices);
 }
 }
 }
@@ -123,6 +123,52 @@ void RDMA_transport::read_exact(char *buf, const int len) {
           0);
 }
 
+void RDMA_transport::_poll(short events, const char *what) {
+  auto time_remaining = _deadline - std::chrono::steady_clock::now();
+  if (time_remaining.count() <= 0) {
+    throw transport_exception(string(what) + " timeout");
+  }
+  struct pollfd pollfd;
+  pollfd.fd = _socket;
+  pollfd.events = events;
+  pollfd.revents = 0;
+  int rc = rpoll(
+      &pollfd, 1,
+      std::chrono::duration_cast<std::chrono::milliseconds>(time_remaining)
+          .count());
+  if (rc < 0) {
+    throw transport_exception(_build_msg(string(what) + ".rpoll"));
+  }
+  if (rc == 0) {
+    throw transport_exception(string(what) + ".rpoll timeout");
+  }
+}
+
+void RDMA_transport::writev_exact(const struct iovec *iov, int iovcnt) {
+  iovec_cursor cursor(iov, iovcnt);
+  while (!cursor.done()) {
+    _poll(POLLOUT, "writev_exact");
+    ssize_t sent = rwritev(_socket, cursor.data(), cursor.count());
+    if (sent < 0) {
+      throw transport_exception(_build_msg("writev_exact.rwritev"));
+    }
+    cursor.consume(sent);
+  }
+}
+
+void RDMA_transport::readv_exact(const struct iovec *iov, int iovcnt) {
+  iovec_cursor cursor(iov, iovcnt);
+  while (!cursor.done()) {
+    _poll(POLLIN, "readv_exact");
+    ssize_t read = rreadv(_socket, cursor.data(), cursor.count());
+    if (read <= 0) {
+      throw transport_exception(
+          _build_msg("readv_exact.rreadv= " + std::to_string(read)));
+    }
+    cursor.consume(read);
+  }
+}
+
 RDMA_transport::RDMA_transport(
     const string &ip, const string &port,
     const std::chrono::steady_clock::duration &timeout) {
@@ -0,0 +1,134 @@
+/*
+  Copyright (C) iNuron - info@openvstorage.com
+  This file is part of Open vStorage. For license information, see <LICENSE.txt>
+*/
+
+#include "reactor.h"
+#include "alba_logger.h"
+
+namespace alba {
+namespace transport {
+
+TimerWheel::TimerWheel(boost::asio::io_service &io_service,
+                       const std::chrono::milliseconds &tick, size_t n_slots)
+    : _timer(io_service), _tick(tick), _slots(n_slots) {}
+
+TimerWheel::timer_id
+TimerWheel::schedule(const std::chrono::steady_clock::duration &after,
+                     std::function<void()> callback) {
+  // round up, so a timer never fires early
+  uint64_t ticks = (after + _tick - std::chrono::nanoseconds(1)) / _tick;
+  if (ticks == 0) {
+    ticks = 1;
+  }
+  std::lock_guard<std::mutex> lock(_mutex);
+  size_t slot_index = (_current + ticks) % _slots.size();
+  uint64_t rounds = (ticks - 1) / _slots.size();
+  timer_id id = _next_id++;
+  auto &s = _slots[slot_index];
+  s.push_back(entry{id, rounds, std::move(callback)});
+  _index.emplace(id, std::make_pair(slot_index, std::prev(s.end())));
+  if (!_ticking) {
+    _ticking = true;
+    _timer.expires_from_now(_tick);
+    _arm();
+  }
+  return id;
+}
+
+bool TimerWheel::cancel(timer_id id) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  auto it = _index.find(id);
+  if (it == _index.end()) {
+    return false;
+  }
+  _slots[it->second.first].erase(it->second.second);
+  _index.erase(it);
+  return true;
+}
+
+size_t TimerWheel::pending() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _index.size();
+}
+
+void TimerWheel::_arm() {
+  _timer.async_wait(
+      [this](const boost::system::error_code &ec) { _on_tick(ec); });
+}
+
+void TimerWheel::_on_tick(const boost::system::error_code &ec) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (ec == boost::asio::error::operation_aborted) {
+    _ticking = false;
+    return;
+  }
+  _current = (_current + 1) % _slots.size();
+  auto &s = _slots[_current];
+  for (auto it = s.begin(); it != s.end();) {
+    if (it->rounds > 0) {
+      it->rounds--;
+      ++it;
+    } else {
+      _index.erase(it->id);
+      it->callback();
+      it = s.erase(it);
+    }
+  }
+  if (_index.empty()) {
+    _ticking = false;
+  } else {
+    // relative to the previous expiry, so the wheel doesn't drift
+    _timer.expires_at(_timer.expires_at() + _tick);
+    _arm();
+  }
+}
+
+Reactor::Reactor(const std::chrono::milliseconds &tick)
+    : _work(new boost::asio::io_service::work(_io_service)),
+      _timers(_io_service, tick) {
+  _thread = std::thread([this]() { _io_service.run(); });
+}
+
+Reactor::~Reactor() {
+  _work.reset();
+  _io_service.stop();
+  _thread.join();
+}
+
+Reactors &Reactors::getInstance() {
+  static Reactors instance;
+  return instance;
+}
+
+void Reactors::set_size(size_t n) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (n == _reactors.size()) {
+    return;
+  }
+  ALBA_LOG(INFO, "Reactors::set_size(" << n << ")");
+  // connections made earlier keep their reactor alive
+  _reactors.clear();
+  for (size_t i = 0; i < n; i++) {
+    _reactors.push_back(
+        std::make_shared<Reactor>(std::chrono::milliseconds(10)));
+  }
+  _next = 0;
+}
+
+size_t Reactors::size() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _reactors.size();
+}
+
+std::shared_ptr<Reactor> Reactors::next() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (_reactors.empty()) {
+    return nullptr;
+  }
+  auto r = _reactors[_next];
+  _next = (_next + 1) % _reactors.size();
+  return r;
+}
+}
+}
@@ -6,24 +6,38 @@
 #include "rora_proxy_client.h"
 #include "alba_logger.h"
 #include "asd_client.h"
+#include "erasure.h"
 #include "manifest.h"
 #include "manifest_cache.h"
 #include "osd_access.h"
+#include "reactor.h"
 
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
 #include <gcrypt.h>
 
 namespace alba {
 namespace proxy_client {
 using std::string;
 
+int asd_leg_result::fast_path_rc() const {
+  if (std::none_of(failed.begin(), failed.end(), [](bool f) { return f; })) {
+    return 0;
+  }
+  return rc != 0 ? rc : -1;
+}
+
 RoraProxy_client::RoraProxy_client(
     std::unique_ptr<GenericProxy_client> delegate,
-    const RoraConfig &rora_config)
-    : _delegate(std::move(delegate)), _use_null_io(rora_config.use_null_io),
+    const RoraConfig &rora_config, proxy_connector connect)
+    : _delegate(std::move(delegate)), _connect(std::move(connect)),
+      _use_null_io(rora_config.use_null_io),
       _asd_connection_pool_size(rora_config.asd_connection_pool_size),
       _asd_partial_read_timeout(std::chrono::milliseconds(
           rora_config.asd_partial_read_timeout_milliseconds)),
-      _ser_version(boost::none) {
+      _ser_version(boost::none),
+      _hedge_percentile(rora_config.hedge_percentile) {
 
   if (!gcry_control(GCRYCTL_INITIALIZATION_FINISHED_P)) {
     ALBA_LOG(ERROR, "libgcrypt has not been initialized");
@@ -33,6 +47,17 @@ RoraProxy_client::RoraProxy_client(
   ALBA_LOG(INFO, "RoraProxy_client( _asd_connection_pool_size = "
                      << _asd_connection_pool_size << " ...)");
   ManifestCache::getInstance().set_capacity(rora_config.manifest_cache_size);
+  ManifestCache::getInstance().set_budget(rora_config.manifest_cache_bytes);
+  ManifestCache::getInstance().set_policy(rora_config.manifest_cache_policy_);
+  if (!rora_config.manifest_store_path.empty()) {
+    ManifestCache::getInstance().open_store(rora_config.manifest_store_path,
+                                            rora_config.manifest_store_bytes);
+  }
+  auto &osd_access = OsdAccess::getInstance(_asd_connection_pool_size,
+                                            _asd_partial_read_timeout);
+  osd_access.set_fan_out_concurrency(rora_config.asd_fan_out_concurrency);
+  osd_access.set_asd_transport(rora_config.asd_transport);
+  transport::Reactors::getInstance().set_size(rora_config.tcp_reactor_threads);
   _fast_path_failures = 0;
   try {
     _has_local_fragment_cache = _delegate->has_local_fragment_cache();
@@ -45,6 +70,10 @@ RoraProxy_client::RoraProxy_client(
     }
   }
 
+  _init_session(*_delegate);
+}
+
+void RoraProxy_client::_init_session(GenericProxy_client &delegate) {
   try {
     using namespace std;
     vector<pair<string, boost::optional<string>>> args;
@@ -52,7 +81,7 @@ RoraProxy_client::RoraProxy_client(
                        boost::optional<string>(string("\02")));
     args.push_back(p);
     vector<pair<string, string>> processed_kvs;
-    _delegate->update_session(args, processed_kvs);
+    delegate.update_session(args, processed_kvs);
     for (auto &it : processed_kvs) {
       string &key = std::get<0>(it);
       string &v = std::get<1>(it);
@@ -75,16 +104,25 @@ RoraProxy_client::RoraProxy_client(
   }
 }
 
+std::unique_ptr<GenericProxy_client> RoraProxy_client::_open_connection() {
+  auto delegate = _connect();
+  _init_session(*delegate);
+  return delegate;
+}
+
 bool RoraProxy_client::namespace_exists(const string &name) {
+  std::lock_guard<std::mutex> lock(_delegate_mutex);
   return _delegate->namespace_exists(name);
 };
 
 void RoraProxy_client::create_namespace(
     const string &name, const boost::optional<string> &preset_name) {
+  std::lock_guard<std::mutex> lock(_delegate_mutex);
   _delegate->create_namespace(name, preset_name);
 };
 
 void RoraProxy_client::delete_namespace(const string &name) {
+  std::lock_guard<std::mutex> lock(_delegate_mutex);
   _delegate->delete_namespace(name);
 };
 
@@ -92,6 +130,7 @@ std::tuple<std::vector<string>, has_more> RoraProxy_client::list_namespaces(
     const string &first, const include_first include_first_,
     const boost::optional<string> &last, const include_last include_last_,
     const int max, const reverse reverse_) {
+  std::lock_guard<std::mutex> lock(_delegate_mutex);
   return _delegate->list_namespaces(first, include_first_, last, include_last_,
                                     max, reverse_);
 }
@@ -121,6 +160,7 @@ void RoraProxy_client::read_object_fs(const string &namespace_,
                                       const string &dest_file,
                                       const consistent_read consistent_read_,
                                       const should_cache should_cache_) {
+  std::lock_guard<std::mutex> lock(_delegate_mutex);
   _delegate->read_object_fs(namespace_, object_name, dest_file,
                             consistent_read_, should_cache_);
 }
@@ -128,6 +168,7 @@ void RoraProxy_client::read_object_fs(const string &namespace_,
 void RoraProxy_client::delete_object(const string &namespace_,
                                      const string &object_name,
                                      const may_not_exist may_not_exist_) {
+  std::lock_guard<std::mutex> lock(_delegate_mutex);
   _delegate->delete_object(namespace_, object_name, may_not_exist_);
 }
 
@@ -135,6 +176,7 @@ std::tuple<std::vector<string>, has_more> RoraProxy_client::list_objects(
     const string &namespace_, const string &first,
     const include_first include_first_, const boost::optional<string> &last,
     const include_last include_last_, const int max, const reverse reverse_) {
+  std::lock_guard<std::mutex> lock(_delegate_mutex);
   return _delegate->list_objects(namespace_, first, include_first_, last,
                                  include_last_, max, reverse_);
 }
@@ -143,21 +185,23 @@ string RoraProxy_client::_fragment_key(const namespace_t namespace_id,
                                        const string &object_id,
                                        uint32_t version_id, uint32_t chunk_id,
                                        uint32_t fragment_id) {
+  // hedged asd legs can build keys concurrently
+  static thread_local message_builder fkb;
   char instance_content_prefix = 'p';
-  _fkb.add_raw(&instance_content_prefix, 1);
+  fkb.add_raw(&instance_content_prefix, 1);
   uint32_t zero = 0;
-  to(_fkb, zero);
+  to(fkb, zero);
   char namespace_char = 'n';
-  _fkb.add_raw(&namespace_char, 1);
-  alba::to_be(_fkb, namespace_id);
+  fkb.add_raw(&namespace_char, 1);
+  alba::to_be(fkb, namespace_id);
   char prefix = 'o';
-  _fkb.add_raw(&prefix, 1);
-  to(_fkb, object_id);
-  to(_fkb, chunk_id);
-  to(_fkb, fragment_id);
-  to(_fkb, version_id);
-  string r = _fkb.as_string_no_size();
-  _fkb.reset();
+  fkb.add_raw(&prefix, 1);
+  to(fkb, object_id);
+  to(fkb, chunk_id);
+  to(fkb, fragment_id);
+  to(fkb, version_id);
+  string r = fkb.as_string_no_size();
+  fkb.reset();
   return r;
 }
 
@@ -199,58 +243,38 @@ void RoraProxy_client::_maybe_update_osd_infos(
   }
 }
 
-Location get_location(ManifestWithNamespaceId &mf, uint64_t pos, uint32_t len) {
-  int chunk_index = -1;
-  uint64_t total = 0;
-
-  {
-    auto it = mf.chunk_sizes.begin();
-    while (total <= pos) {
-      chunk_index++;
-      auto chunk_size = *it;
-      total += chunk_size;
-      it++;
-    }
-  }
-
-  auto &chunk_fragments = mf.fragments[chunk_index];
-
-  uint32_t chunk_size = mf.chunk_sizes[chunk_index];
-  total -= chunk_size;
-  uint32_t fragment_length = chunk_size / mf.encoding_scheme.k;
-  uint32_t pos_in_chunk = pos - total;
-
-  uint32_t fragment_index = pos_in_chunk / fragment_length;
-  auto &fragment = chunk_fragments[fragment_index];
-
-  total += fragment_length * fragment_index;
-  uint32_t pos_in_fragment = pos - total;
-
-  Location l;
-  l.namespace_id = mf.namespace_id;
-  l.object_id = mf.object_id;
-  l.chunk_id = chunk_index;
-  l.fragment_id = fragment_index;
-  l.fragment_location = fragment->loc;
-  l.offset = pos_in_fragment;
-  l.length = std::min(len, fragment_length - pos_in_fragment);
-  l.uses_compression =
-      mf.compression->get_compressor() != compressor_t::NO_COMPRESSION;
-  l.encrypt_info = mf.encrypt_info;
-  l.ctr = fragment->ctr;
-  return l;
-}
-
-void _resolve_slice_one_level(std::vector<std::pair<byte *, Location>> &results,
-                              ManifestWithNamespaceId &manifest,
-                              uint64_t offset, uint32_t length, byte *target) {
-  while (length > 0) {
-    results.emplace_back(target, get_location(manifest, offset, length));
-    auto len = results.back().second.length;
-    length -= len;
-    offset += len;
-    target += len;
-  };
+/* resolves all the slices in one sweep up the object, in offset order:
+ * the chunk of the previous piece is tried first, so only jumps need a
+ * lookup. The locations come out in that order too. */
+void _resolve_slices_one_level(
+    std::vector<std::pair<byte *, Location>> &results,
+    const manifest_cache_entry &manifest,
+    const std::vector<SliceDescriptor> &slices) {
+  std::vector<uint32_t> order(slices.size());
+  for (uint32_t i = 0; i < order.size(); i++) {
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+    return slices[a].offset < slices[b].offset;
+  });
+
+  uint32_t chunk = 0;
+  for (auto i : order) {
+    auto &slice = slices[i];
+    uint64_t offset = slice.offset;
+    uint32_t length = slice.size;
+    byte *target = slice.buf;
+    while (length > 0) {
+      results.emplace_back(target,
+                           get_location(*manifest, offset, length, chunk));
+      auto &l = results.back().second;
+      l.manifest = manifest;
+      chunk = l.chunk_id;
+      length -= l.length;
+      offset += l.length;
+      target += l.length;
+    };
+  }
 }
 
 boost::optional<std::vector<std::pair<byte *, Location>>>
@@ -266,10 +290,7 @@ _resolve_one_level(const alba_id_t &alba_id, const std::string &namespace_,
     ALBA_LOG(DEBUG, "manifest for alba_id=" << alba_id << ", obj_slices="
                                             << obj_slices << " found");
     std::vector<std::pair<byte *, Location>> results;
-    for (auto &slice : obj_slices.slices) {
-      _resolve_slice_one_level(results, *mf, slice.offset, slice.size,
-                               slice.buf);
-    }
+    _resolve_slices_one_level(results, mf, obj_slices.slices);
     return results;
   }
 }
@@ -320,7 +341,8 @@ _resolve_one_many_levels(const std::vector<alba_id_t> &alba_levels,
 }
 
 int RoraProxy_client::_short_path(
-    const std::vector<std::pair<byte *, Location>> &locations) {
+    const std::vector<std::pair<byte *, Location>> &locations,
+    std::set<osd_t> &unread_osds, const std::atomic<bool> *cancelled) {
 
   ALBA_LOG(DEBUG, "_short_path locations.size()=" << locations.size());
 
@@ -329,6 +351,10 @@ int RoraProxy_client::_short_path(
   for (auto &bl : locations) {
     auto &target = std::get<0>(bl);
     auto &l = std::get<1>(bl);
+    if (l.fragment_location.first == boost::none) {
+      // nothing to read, it will have to be rebuilt
+      continue;
+    }
 
     osd_t osd_id = *l.fragment_location.first;
     uint32_t version_id = l.fragment_location.second;
@@ -359,7 +385,7 @@ int RoraProxy_client::_short_path(
   } else {
     return OsdAccess::getInstance(_asd_connection_pool_size,
                                   _asd_partial_read_timeout)
-        .read_osds_slices(per_osd);
+        .read_osds_slices(per_osd, unread_osds, cancelled);
   }
 }
 
@@ -370,9 +396,9 @@ void RoraProxy_client::_process(std::vector<object_info> &object_infos,
   for (auto &object_info : object_infos) {
     using alba::stuff::operator<<;
 
-    manifest_cache_entry manifest_cache_entry_ =
-        std::shared_ptr<alba::proxy_protocol::ManifestWithNamespaceId>(
-            std::get<2>(object_info).release());
+    // decoded when a read first needs it
+    lazy_manifest_entry manifest_cache_entry_ = std::make_shared<LazyManifest>(
+        std::get<0>(object_info), std::move(std::get<2>(object_info)));
     string alba_id = std::get<1>(object_info);
     if (alba_id == "") {
       alba_id = OsdAccess::getInstance(_asd_connection_pool_size,
@@ -390,10 +416,399 @@ void RoraProxy_client::_slow_path(const std::string &namespace_,
                                   const consistent_read consistent_read_,
                                   std::vector<object_info> &object_infos,
                                   alba::statistics::RoraCounter &cntr) {
+  std::lock_guard<std::mutex> lock(_delegate_mutex);
   _delegate->read_objects_slices2(namespace_, slices, consistent_read_,
                                   object_infos, cntr);
 }
 
+void RoraProxy_client::_proxy_leg(const std::string &namespace_,
+                                  const std::vector<ObjectSlices> &slices,
+                                  const consistent_read consistent_read_,
+                                  std::vector<object_info> &object_infos,
+                                  alba::statistics::RoraCounter &cntr) {
+  // only ever called from _proxy_leg_worker
+  try {
+    if (_proxy_leg_delegate == nullptr) {
+      _proxy_leg_delegate = _open_connection();
+    }
+    _proxy_leg_delegate->read_objects_slices2(namespace_, slices,
+                                              consistent_read_, object_infos,
+                                              cntr);
+  } catch (...) {
+    // don't trust what's left of the connection
+    _proxy_leg_delegate.reset();
+    throw;
+  }
+}
+
+workers::WorkerPool &RoraProxy_client::_proxy_leg_worker() {
+  std::call_once(_proxy_leg_pool_once, [this]() {
+    _proxy_leg_pool.reset(new workers::WorkerPool(1));
+  });
+  return *_proxy_leg_pool;
+}
+
+transport::TimerWheel &RoraProxy_client::_hedge_timers() {
+  std::call_once(_hedge_reactor_once, [this]() {
+    _hedge_reactor.reset(new transport::Reactor(std::chrono::milliseconds(1)));
+  });
+  return _hedge_reactor->timers();
+}
+
+workers::WorkerPool &RoraProxy_client::_hedge_proxy_worker() {
+  std::call_once(_hedge_proxy_pool_once, [this]() {
+    _hedge_proxy_pool.reset(new workers::WorkerPool(1));
+  });
+  return *_hedge_proxy_pool;
+}
+
+workers::WorkerPool &RoraProxy_client::_prefetch_worker() {
+  std::call_once(_prefetch_pool_once, [this]() {
+    _prefetch_pool.reset(new workers::WorkerPool(1));
+  });
+  return *_prefetch_pool;
+}
+
+bool RoraProxy_client::_partial_decrypt(const alba_id_t &alba_id,
+                                        unsigned char *buf, Location &l) {
+  try {
+    switch (l.encrypt_info->get_encryption()) {
+    case encryption_t::NO_ENCRYPTION:
+      break;
+    case encryption_t::ENCRYPTED:
+      auto encrypt_info =
+          static_cast<encryption::Encrypted *>(l.encrypt_info.get());
+
+      if (l.ctr == boost::none) {
+        ALBA_LOG(ERROR, "ctr==boost::none while doing ctr partial decrypt");
+        return false;
+      }
+
+      auto enc_key = get_encryption_key(alba_id, l.namespace_id,
+                                        encrypt_info->key_identification);
+
+      if (!encrypt_info->partial_decrypt(buf, l.length, enc_key, *l.ctr,
+                                         l.offset)) {
+        ALBA_LOG(ERROR,
+                 "Could not partially decrypt data, which is unexpected!");
+        return false;
+      }
+      break;
+    }
+  } catch (std::exception &e) {
+    ALBA_LOG(ERROR, "partial decrypt failed due to an exception: " << e.what());
+    return false;
+  } catch (...) {
+    return false;
+  }
+  return true;
+}
+
+void RoraProxy_client::_degraded_read(
+    const alba_id_t &alba_id,
+    const std::vector<std::pair<byte *, Location>> &locations,
+    const std::vector<size_t> &lost, const std::set<osd_t> &unread_osds,
+    std::vector<bool> &rebuilt) {
+
+  ALBA_LOG(DEBUG, "_degraded_read lost.size()=" << lost.size());
+
+  struct rebuild {
+    size_t j;
+    std::vector<uint32_t> sources;
+    std::vector<std::vector<byte>> buffers;
+  };
+  std::vector<rebuild> rebuilds;
+  rebuilds.reserve(lost.size());
+  std::map<osd_t, std::vector<asd_slice>> per_osd;
+
+  for (auto j : lost) {
+    auto &l = locations[j].second;
+    auto &mf = *l.manifest;
+    const uint32_t k = mf.encoding_scheme.k;
+    if (mf.encoding_scheme.m == 0) {
+      continue;
+    }
+    const uint32_t n_fragments = mf.n_fragments(l.chunk_id);
+    rebuild r;
+    r.j = j;
+    for (uint32_t f = 0; f < n_fragments && r.sources.size() < k; f++) {
+      auto osd = mf.fragment_location(l.chunk_id, f).first;
+      if (f == l.fragment_id || osd == boost::none ||
+          unread_osds.find(*osd) != unread_osds.end()) {
+        continue;
+      }
+      r.sources.push_back(f);
+    }
+    if (r.sources.size() < k) {
+      ALBA_LOG(DEBUG, "_degraded_read: not enough fragments for chunk "
+                          << l.chunk_id << " of " << l.object_id);
+      continue;
+    }
+    r.buffers.resize(k, std::vector<byte>(l.length));
+    for (uint32_t i = 0; i < k; i++) {
+      auto loc = mf.fragment_location(l.chunk_id, r.sources[i]);
+      asd_slice slice;
+      slice.offset = l.offset;
+      slice.len = l.length;
+      slice.target = r.buffers[i].data();
+      slice.key = _fragment_key(l.namespace_id, l.object_id, loc.second,
+                                l.chunk_id, r.sources[i]);
+      per_osd[*loc.first].push_back(slice);
+    }
+    rebuilds.push_back(std::move(r));
+  }
+
+  if (rebuilds.empty()) {
+    return;
+  }
+
+  std::set<osd_t> failed;
+  if (!_use_null_io) {
+    _maybe_update_osd_infos(per_osd);
+    OsdAccess::getInstance(_asd_connection_pool_size, _asd_partial_read_timeout)
+        .read_osds_slices(per_osd, failed);
+  }
+
+  for (auto &r : rebuilds) {
+    auto &target = locations[r.j].first;
+    auto &l = locations[r.j].second;
+    auto &mf = *l.manifest;
+
+    bool ok = true;
+    std::vector<const uint8_t *> inputs;
+    for (uint32_t i = 0; ok && i < r.sources.size(); i++) {
+      auto loc = mf.fragment_location(l.chunk_id, r.sources[i]);
+      if (failed.find(*loc.first) != failed.end()) {
+        ok = false;
+        continue;
+      }
+      // every fragment has its own ctr
+      Location source = l;
+      source.fragment_id = r.sources[i];
+      source.fragment_location = loc;
+      source.ctr = mf.ctr(l.chunk_id, r.sources[i]);
+      ok = _partial_decrypt(alba_id, r.buffers[i].data(), source);
+      inputs.push_back(r.buffers[i].data());
+    }
+    if (ok) {
+      auto &rs = erasure::ReedSolomon::get(mf.encoding_scheme.k,
+                                           mf.encoding_scheme.m);
+      rebuilt[r.j] =
+          rs.decode(l.fragment_id, r.sources, inputs, target, l.length);
+    }
+  }
+}
+
+void RoraProxy_client::_asd_leg(
+    const alba_id_t &alba_id, std::vector<std::pair<byte *, Location>> &locations,
+    asd_leg_result &result, const std::atomic<bool> *cancelled) {
+
+  std::set<osd_t> unread_osds;
+  result.rc = _short_path(locations, unread_osds, cancelled);
+  result.failed.assign(locations.size(), false);
+  ALBA_LOG(DEBUG, "_short_path result => " << result.rc);
+  if (cancelled != nullptr && cancelled->load()) {
+    // whoever cancelled has the data: don't bother rebuilding or decrypting
+    result.rc = -1;
+    result.failed.assign(locations.size(), true);
+    return;
+  }
+
+  std::vector<size_t> lost;
+  for (size_t j = 0; j < locations.size(); j++) {
+    auto &osd = locations[j].second.fragment_location.first;
+    if (osd == boost::none || unread_osds.find(*osd) != unread_osds.end()) {
+      lost.push_back(j);
+    }
+  }
+
+  // rebuild what we couldn't read out of the other fragments of the chunk
+  // (these come back decrypted)
+  std::vector<bool> rebuilt(locations.size(), false);
+  if (!lost.empty()) {
+    _degraded_read(alba_id, locations, lost, unread_osds, rebuilt);
+  }
+  for (auto j : lost) {
+    if (rebuilt[j]) {
+      result.degraded++;
+    } else {
+      result.failed[j] = true;
+    }
+  }
+
+  // maybe decrypt data
+  for (size_t j = 0; j < locations.size(); j++) {
+    if (!result.failed[j] && !rebuilt[j]) {
+      auto &s = locations[j];
+      if (!_partial_decrypt(alba_id, s.first, s.second)) {
+        result.rc = -1;
+        result.failed[j] = true;
+      }
+    }
+  }
+}
+
+namespace {
+// shared between a hedged read and its proxy read, which can outlive it
+struct hedge_state {
+  std::mutex mutex;
+  std::condition_variable cond;
+  // set when the proxy answered: the asd leg can stop
+  std::atomic<bool> cancelled{false};
+  bool issued = false;
+
+  // what to ask the proxy for: per object its name and (offset, size)s
+  std::vector<string> object_names;
+  std::vector<std::vector<std::pair<uint64_t, uint32_t>>> ranges;
+
+  std::vector<byte> proxy_staging;
+  std::vector<object_info> proxy_infos;
+  alba::statistics::RoraCounter proxy_cntr;
+  bool proxy_done = false;
+  bool proxy_ok = false;
+};
+}
+
+bool RoraProxy_client::_hedged_asd_leg(
+    const string &namespace_, const std::vector<ObjectSlices> &slices,
+    std::vector<std::pair<byte *, Location>> &locations,
+    const std::vector<size_t> &location_objects,
+    const consistent_read consistent_read_, const alba_id_t &alba_id,
+    asd_leg_result &result, alba::statistics::RoraCounter &cntr) {
+
+  auto &access = OsdAccess::getInstance(_asd_connection_pool_size,
+                                        _asd_partial_read_timeout);
+  std::set<osd_t> osds;
+  for (auto &bl : locations) {
+    auto &osd = bl.second.fragment_location.first;
+    if (osd != boost::none) {
+      osds.insert(*osd);
+    }
+  }
+  auto delay = access.latency_percentile(osds, _hedge_percentile);
+
+  // the objects the hedge would ask the proxy for
+  auto state = std::make_shared<hedge_state>();
+  std::vector<size_t> objects;
+  for (size_t j = 0; j < location_objects.size(); j++) {
+    if (j == 0 || location_objects[j - 1] != location_objects[j]) {
+      auto &object_slices = slices[location_objects[j]];
+      objects.push_back(location_objects[j]);
+      state->object_names.push_back(object_slices.object_name);
+      state->ranges.emplace_back();
+      for (auto &slice : object_slices.slices) {
+        state->ranges.back().emplace_back(slice.offset, slice.size);
+      }
+    }
+  }
+
+  // the timer only hands the proxy read to the hedge's worker; the asd leg
+  // stays on this thread and reads straight into the caller's buffers
+  auto timer = _hedge_timers().schedule(delay, [this, state, namespace_,
+                                                consistent_read_]() {
+    if (_hedge_proxy_busy.exchange(true)) {
+      ALBA_LOG(DEBUG, "not hedging fast path read: the previous hedge is "
+                      "still busy with the proxy");
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(state->mutex);
+      state->issued = true;
+    }
+    _hedge_proxy_worker().submit([this, state, namespace_,
+                                  consistent_read_]() {
+      size_t total = 0;
+      for (auto &r : state->ranges) {
+        for (auto &range : r) {
+          total += range.second;
+        }
+      }
+      state->proxy_staging.resize(total);
+      std::vector<ObjectSlices> proxy_slices;
+      byte *target = state->proxy_staging.data();
+      for (size_t i = 0; i < state->ranges.size(); i++) {
+        std::vector<SliceDescriptor> descriptors;
+        for (auto &range : state->ranges[i]) {
+          descriptors.push_back(
+              SliceDescriptor{target, range.first, range.second});
+          target += range.second;
+        }
+        proxy_slices.push_back(
+            ObjectSlices{state->object_names[i], descriptors});
+      }
+
+      bool ok = true;
+      try {
+        if (_hedge_delegate == nullptr) {
+          _hedge_delegate = _open_connection();
+        }
+        _hedge_delegate->read_objects_slices2(namespace_, proxy_slices,
+                                              consistent_read_,
+                                              state->proxy_infos,
+                                              state->proxy_cntr);
+      } catch (std::exception &e) {
+        ALBA_LOG(INFO, "hedged proxy read failed: " << e.what());
+        // don't trust what's left of the connection
+        _hedge_delegate.reset();
+        ok = false;
+      }
+      _hedge_proxy_busy = false;
+      {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->proxy_done = true;
+        state->proxy_ok = ok;
+        if (ok) {
+          state->cancelled = true;
+        }
+      }
+      state->cond.notify_all();
+    });
+  });
+
+  _asd_leg(alba_id, locations, result, &state->cancelled);
+  // once cancel returns, the hedge either went out or never will
+  if (_hedge_timers().cancel(timer)) {
+    return false;
+  }
+
+  std::unique_lock<std::mutex> lock(state->mutex);
+  if (!state->issued) {
+    return false;
+  }
+  cntr.hedges_issued++;
+  ALBA_LOG(DEBUG, "hedged fast path read after "
+                      << duration_cast<microseconds>(delay).count() << "us");
+  bool asd_clean = !state->cancelled && result.rc == 0 &&
+                   std::none_of(result.failed.begin(), result.failed.end(),
+                                [](bool f) { return f; });
+  if (asd_clean) {
+    // the proxy read runs to completion into its own staging: stopping it
+    // would break the protocol on its connection
+    return false;
+  }
+  // if the asd leg failed, the proxy decides
+  state->cond.wait(lock, [&state] { return state->proxy_done; });
+  if (!state->proxy_ok) {
+    return false;
+  }
+  lock.unlock();
+
+  cntr.hedges_won++;
+  cntr.slow_path += state->proxy_cntr.slow_path;
+  const byte *source = state->proxy_staging.data();
+  for (auto i : objects) {
+    for (auto &slice : slices[i].slices) {
+      std::memcpy(slice.buf, source, slice.size);
+      source += slice.size;
+    }
+  }
+  _process(state->proxy_infos, namespace_);
+  result.rc = 0;
+  result.degraded = 0;
+  result.failed.assign(locations.size(), false);
+  return true;
+}
+
 void RoraProxy_client::read_objects_slices(
     const string &namespace_, const std::vector<ObjectSlices> &slices,
     const consistent_read consistent_read_,
@@ -401,13 +816,16 @@ void RoraProxy_client::read_objects_slices(
 
   bool use_slow_path =
       (consistent_read_ == consistent_read::T) && _has_local_fragment_cache;
-  if (_fast_path_failures > 100) {
-    if (duration_cast<seconds>(steady_clock::now() - _failure_time).count() >
-        120) {
-      // try to start using fast path again after 2 minutes
-      _fast_path_failures = 0;
-    } else {
-      use_slow_path = true;
+  {
+    std::lock_guard<std::mutex> lock(_failure_mutex);
+    if (_fast_path_failures > 100) {
+      if (duration_cast<seconds>(steady_clock::now() - _failure_time)
+              .count() > 120) {
+        // try to start using fast path again after 2 minutes
+        _fast_path_failures = 0;
+      } else {
+        use_slow_path = true;
+      }
     }
   }
 
@@ -418,19 +836,42 @@ void RoraProxy_client::read_objects_slices(
 
   } else {
     std::vector<std::pair<byte *, Location>> short_path;
+    // for every entry in short_path: the index of its object in slices
+    std::vector<size_t> short_path_objects;
     std::vector<ObjectSlices> via_proxy;
     auto alba_levels = OsdAccess::getInstance(_asd_connection_pool_size,
                                               _asd_partial_read_timeout)
                            .get_alba_levels(*this);
-    for (auto &object_slices : slices) {
+    auto &cache = ManifestCache::getInstance();
+    // stored manifests are only used once they're known to be of these
+    cache.validate_store(alba_levels);
+    // the manifests this read fetches for everyone: let go of once they're
+    // in the cache
+    std::vector<ManifestCache::fetch_claim> fetching;
+    // objects whose manifest another read is fetching
+    std::vector<std::pair<size_t, ManifestCache::fetch_claim>> waiting;
+    auto classify = [&](size_t i, bool may_claim) {
+      auto &object_slices = slices[i];
       auto locations =
           _resolve_one_many_levels(alba_levels, 0, namespace_, object_slices);
+      if (locations == boost::none && may_claim &&
+          cache.find(namespace_, alba_levels[0], object_slices.object_name) ==
+              nullptr) {
+        auto claim = cache.claim_fetch(namespace_, alba_levels[0],
+                                       object_slices.object_name);
+        if (!claim.leader()) {
+          waiting.emplace_back(i, std::move(claim));
+          return;
+        }
+        fetching.push_back(std::move(claim));
+      }
       if (locations == boost::none ||
           std::any_of(
               locations->begin(), locations->end(),
               [](std::pair<byte *, Location> &l) {
                 auto &location = std::get<1>(l);
-                return location.fragment_location.first == boost::none ||
+                return (location.fragment_location.first == boost::none &&
+                        location.manifest->encoding_scheme.m == 0) ||
                        location.uses_compression ||
                        !location.encrypt_info->supports_partial_decrypt();
               })) {
@@ -438,135 +879,306 @@ void RoraProxy_client::read_objects_slices(
       } else {
         for (auto &l : *locations) {
           short_path.push_back(l);
+          short_path_objects.push_back(i);
         }
       }
+    };
+    for (size_t i = 0; i < slices.size(); i++) {
+      classify(i, true);
+    }
+    // waiting while we lead fetches ourselves could wait on a read that
+    // waits on us
+    for (auto &w : waiting) {
+      if (fetching.empty()) {
+        w.second.wait(_manifest_fetch_wait);
+      }
+      classify(w.first, false);
     }
 
-    // TODO: different paths could go in parallel
-    int result_front = _short_path(short_path);
-    ALBA_LOG(DEBUG, "_short_path result => " << result_front);
-
-    if (!result_front) {
-      // maybe decrypt data
-      try {
-        for (auto &s : short_path) {
-          unsigned char *buf = s.first;
-          alba::proxy_protocol::Location &l = s.second;
-          switch (l.encrypt_info->get_encryption()) {
-          case encryption_t::NO_ENCRYPTION:
-            break;
-          case encryption_t::ENCRYPTED:
-            auto encrypt_info =
-                static_cast<encryption::Encrypted *>(l.encrypt_info.get());
-
-            if (l.ctr == boost::none) {
-              ALBA_LOG(ERROR, "ctr==boost::none while doing ctr partial decrypt");
-              throw 0;
-            }
-
-            auto enc_key =
-                get_encryption_key(alba_levels.back(), l.namespace_id,
-                                   encrypt_info->key_identification);
-
-            if (!encrypt_info->partial_decrypt(buf, l.length, enc_key, *l.ctr,
-                                               l.offset)) {
-              ALBA_LOG(
-                  ERROR,
-                  "Could not partially decrypt data, which is unexpected!");
-              throw 0;
-            }
-            break;
-          }
+    // the proxy leg runs on a worker while we read from the asds
+    std::vector<object_info> proxy_leg_infos;
+    std::future<void> proxy_leg;
+    if (!short_path.empty() && !via_proxy.empty()) {
+      ALBA_LOG(DEBUG, "rora read_objects_slices proxy leg, size="
+                          << via_proxy.size());
+      proxy_leg = _proxy_leg_worker().submit([&]() {
+        _proxy_leg(namespace_, via_proxy, consistent_read_, proxy_leg_infos,
+                   cntr);
+      });
+    }
+    // whatever happens, the proxy leg should not outlive this frame
+    struct join_proxy_leg {
+      std::future<void> &f;
+      ~join_proxy_leg() {
+        if (f.valid()) {
+          f.wait();
         }
-      } catch (std::exception &e) {
-        result_front = -1;
-        ALBA_LOG(ERROR,
-                 "partial decrypt failed due to an exception: " << e.what());
-      } catch (...) {
-        result_front = -1;
+      }
+    } join{proxy_leg};
+
+    asd_leg_result leg;
+    bool hedge_won = false;
+    if (_hedge_percentile > 0 && !short_path.empty()) {
+      hedge_won = _hedged_asd_leg(namespace_, slices, short_path,
+                                  short_path_objects, consistent_read_,
+                                  alba_levels.back(), leg, cntr);
+    } else {
+      _asd_leg(alba_levels.back(), short_path, leg);
+    }
+    cntr.degraded += leg.degraded;
+
+    std::vector<bool> affected(slices.size(), false);
+    for (size_t j = 0; j < short_path.size(); j++) {
+      if (leg.failed[j]) {
+        affected[short_path_objects[j]] = true;
       }
     }
 
+    // a read the fast path rebuilt is no reason to give up on it
+    int result_front = leg.fast_path_rc();
+    std::unique_lock<std::mutex> failure_lock(_failure_mutex);
     if (result_front) {
       _failure_time = std::chrono::steady_clock::now();
       if (result_front != -2) {
         // disqualified osds shouldn't result in disqualifying the fast path
         _fast_path_failures++;
       }
-      via_proxy.clear();
-      for (auto &s : slices) {
-        via_proxy.push_back(s);
-      }
     } else {
       _fast_path_failures = 0;
-      cntr.fast_path += short_path.size();
+    }
+    failure_lock.unlock();
+
+    std::vector<ObjectSlices> retry;
+    if (!proxy_leg.valid()) {
+      // nothing went out in parallel
+      for (auto &s : via_proxy) {
+        retry.push_back(s);
+      }
+    }
+    uint64_t fast_path_done = 0;
+    for (size_t j = 0; j < short_path.size(); j++) {
+      size_t object_index = short_path_objects[j];
+      if (affected[object_index]) {
+        // only resend the objects that actually suffered
+        if (j == 0 || short_path_objects[j - 1] != object_index) {
+          retry.push_back(slices[object_index]);
+        }
+      } else {
+        fast_path_done++;
+      }
+    }
+    if (!hedge_won) {
+      cntr.fast_path += fast_path_done;
     }
 
-    if (via_proxy.size() > 0) {
+    if (proxy_leg.valid()) {
+      proxy_leg.get();
+      _process(proxy_leg_infos, namespace_);
+    }
+
+    if (retry.size() > 0) {
       ALBA_LOG(DEBUG, "rora read_objects_slices going via proxy, size="
-                          << via_proxy.size());
+                          << retry.size());
       std::vector<object_info> object_infos;
-      _slow_path(namespace_, via_proxy, consistent_read_, object_infos, cntr);
+      _slow_path(namespace_, retry, consistent_read_, object_infos, cntr);
       _process(object_infos, namespace_);
     }
   }
 }
 
+std::future<void> RoraProxy_client::read_objects_slices_async(
+    const string &namespace_, const std::vector<ObjectSlices> &slices,
+    const consistent_read consistent_read_,
+    alba::statistics::RoraCounter &cntr, read_done_callback on_done) {
+  return _run_async(
+      [this, namespace_, slices, consistent_read_, &cntr]() {
+        read_objects_slices(namespace_, slices, consistent_read_, cntr);
+      },
+      std::move(on_done));
+}
+
+namespace {
+// the caller owns what get_object_info returns
+Checksum *_copy(const Checksum &checksum) {
+  message_builder mb;
+  checksum.to(mb);
+  string s = mb.as_string_no_size();
+  llio::message m(llio::message_buffer::from_string(s));
+  Checksum *copy;
+  llio::from(m, copy);
+  return copy;
+}
+}
+
 std::tuple<uint64_t, Checksum *> RoraProxy_client::get_object_info(
     const string &namespace_, const string &object_name,
     const consistent_read consistent_read_, const should_cache should_cache_) {
+  if (consistent_read_ == consistent_read::F) {
+    auto alba_levels = OsdAccess::getInstance(_asd_connection_pool_size,
+                                              _asd_partial_read_timeout)
+                           .get_alba_levels(*this);
+    auto &cache = ManifestCache::getInstance();
+    cache.validate_store(alba_levels);
+    auto mf = cache.find(namespace_, alba_levels[0], object_name);
+    if (mf == nullptr) {
+      auto claim = cache.claim_fetch(namespace_, alba_levels[0], object_name);
+      if (!claim.leader() && claim.wait(_manifest_fetch_wait)) {
+        mf = cache.find(namespace_, alba_levels[0], object_name);
+      }
+      if (mf == nullptr) {
+        // the whole manifest instead, so the reads that follow have it too
+        std::vector<ObjectSlices> slices{ObjectSlices{object_name, {}}};
+        std::vector<object_info> object_infos;
+        alba::statistics::RoraCounter cntr;
+        _slow_path(namespace_, slices, consistent_read_, object_infos, cntr);
+        _process(object_infos, namespace_);
+        mf = cache.find(namespace_, alba_levels[0], object_name);
+      }
+    }
+    if (mf != nullptr && mf->checksum != nullptr) {
+      return std::tuple<uint64_t, Checksum *>(mf->size, _copy(*mf->checksum));
+    }
+  }
+  std::lock_guard<std::mutex> lock(_delegate_mutex);
   return _delegate->get_object_info(namespace_, object_name, consistent_read_,
                                     should_cache_);
 }
 
+std::future<void> RoraProxy_client::prefetch_manifests(
+    const string &namespace_, const std::vector<string> &object_names) {
+  return _prefetch_worker().submit([this, namespace_, object_names]() {
+    _prefetch(namespace_, object_names);
+  });
+}
+
+void RoraProxy_client::_prefetch(const string &namespace_,
+                                 const std::vector<string> &object_names) {
+  // a read_objects_slices2 without slices only gets the manifests
+  const size_t batch_size = 100;
+  auto alba_levels = OsdAccess::getInstance(_asd_connection_pool_size,
+                                            _asd_partial_read_timeout)
+                         .get_alba_levels(*this);
+  auto &cache = ManifestCache::getInstance();
+  cache.validate_store(alba_levels);
+  std::vector<ObjectSlices> batch;
+  size_t wanted = 0;
+  size_t fetched = 0;
+  auto fetch = [&]() {
+    wanted += batch.size();
+    fetched += _prefetch_batch(namespace_, batch.cbegin(), batch.cend());
+    batch.clear();
+  };
+  for (auto &object_name : object_names) {
+    if (cache.find(namespace_, alba_levels[0], object_name) != nullptr) {
+      continue;
+    }
+    batch.push_back(ObjectSlices{object_name, {}});
+    if (batch.size() == batch_size) {
+      fetch();
+    }
+  }
+  if (!batch.empty()) {
+    fetch();
+  }
+  ALBA_LOG(INFO, "RoraProxy_client::prefetch_manifests "
+                     << namespace_ << ": " << object_names.size()
+                     << " objects, fetched " << fetched << ", failed "
+                     << (wanted - fetched));
+}
+
+size_t RoraProxy_client::_prefetch_batch(
+    const string &namespace_, std::vector<ObjectSlices>::const_iterator first,
+    std::vector<ObjectSlices>::const_iterator last) {
+  std::vector<ObjectSlices> batch(first, last);
+  std::vector<object_info> object_infos;
+  alba::statistics::RoraCounter cntr;
+  try {
+    if (_prefetch_delegate == nullptr) {
+      _prefetch_delegate = _open_connection();
+    }
+    _prefetch_delegate->read_objects_slices2(namespace_, batch,
+                                             consistent_read::F, object_infos,
+                                             cntr);
+  } catch (proxy_exception &e) {
+    // one object that isn't there fails the whole batch
+    if (batch.size() == 1) {
+      ALBA_LOG(WARNING, "RoraProxy_client::prefetch_manifests "
+                            << namespace_ << " " << batch[0].object_name
+                            << ": " << e.what());
+      return 0;
+    }
+    auto middle = first + batch.size() / 2;
+    return _prefetch_batch(namespace_, first, middle) +
+           _prefetch_batch(namespace_, middle, last);
+  } catch (...) {
+    // don't trust what's left of the connection
+    _prefetch_delegate.reset();
+    throw;
+  }
+  size_t fetched = object_infos.size();
+  _process(object_infos, namespace_);
+  return fetched;
+}
+
 void RoraProxy_client::apply_sequence(
     const std::string &namespace_, const write_barrier write_barrier,
     const std::vector<std::shared_ptr<sequences::Assert>> &asserts,
     const std::vector<std::shared_ptr<sequences::Update>> &updates) {
   std::vector<proxy_protocol::object_info> object_infos;
-  _delegate->apply_sequence_(namespace_, write_barrier, asserts, updates,
-                             object_infos);
+  {
+    std::lock_guard<std::mutex> lock(_delegate_mutex);
+    _delegate->apply_sequence_(namespace_, write_barrier, asserts, updates,
+                               object_infos);
+  }
 
   _process(object_infos, namespace_);
 }
 
 void RoraProxy_client::invalidate_cache(const std::string &namespace_) {
   ManifestCache::getInstance().invalidate_namespace(namespace_);
+  std::lock_guard<std::mutex> lock(_delegate_mutex);
   _delegate->invalidate_cache(namespace_);
 }
 
 void RoraProxy_client::drop_cache(const string &namespace_) {
+  std::lock_guard<std::mutex> lock(_delegate_mutex);
   _delegate->drop_cache(namespace_);
 }
 
 std::tuple<int32_t, int32_t, int32_t, string>
 RoraProxy_client::get_proxy_version() {
+  std::lock_guard<std::mutex> lock(_delegate_mutex);
   return _delegate->get_proxy_version();
 }
 
 double RoraProxy_client::ping(const double delay) {
+  std::lock_guard<std::mutex> lock(_delegate_mutex);
   return _delegate->ping(delay);
 }
 
 void RoraProxy_client::osd_info(osd_map_t &result) {
   ALBA_LOG(DEBUG, "RoraProxy_client::osd_info");
+  std::lock_guard<std::mutex> lock(_delegate_mutex);
   _delegate->osd_info(result);
 }
 
 void RoraProxy_client::osd_info2(osd_maps_t &result) {
   ALBA_LOG(DEBUG, "RoraProxy_client::osd_info2");
+  std::lock_guard<std::mutex> lock(_delegate_mutex);
   _delegate->osd_info2(result);
 }
 
 boost::optional<string>
 RoraProxy_client::get_fragment_encryption_key(const string &alba_id,
                                               const namespace_t namespace_id) {
+  std::lock_guard<std::mutex> lock(_delegate_mutex);
   return _delegate->get_fragment_encryption_key(alba_id, namespace_id);
 }
 
 string RoraProxy_client::get_encryption_key(const string &alba_id,
                                             const namespace_t namespace_id,
                                             const string &key_identification) {
+  std::lock_guard<std::mutex> lock(_enc_keys_mutex);
   auto find_key = _enc_keys.find(key_identification);
   if (find_key == _enc_keys.end()) {
     auto enc_key = *get_fragment_encryption_key(alba_id, namespace_id);
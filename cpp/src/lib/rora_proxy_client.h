@@ -9,7 +9,12 @@
 #include "osd_access.h"
 #include "osd_info.h"
 #include "proxy_client.h"
+#include "reactor.h"
+#include "worker_pool.h"
 
+#include <atomic>
+#include <mutex>
+#include <set>
 #include <unordered_map>
 
 namespace alba {
@@ -18,10 +23,27 @@ namespace proxy_client {
 using namespace proxy_protocol;
 using namespace std::chrono;
 
+// outcome of reading a set of locations straight from the asds
+struct asd_leg_result {
+  int rc = 0;
+  // per location: not read, not rebuilt or not decrypted
+  std::vector<bool> failed;
+  uint64_t degraded = 0;
+
+  /* what the read says about the fast path: 0 when every location was read
+   * or rebuilt, whatever the asds ran into on the way. Otherwise rc, or -1
+   * if that's 0.
+   */
+  int fast_path_rc() const;
+};
+
+// opens another connection to the same proxy
+typedef std::function<std::unique_ptr<GenericProxy_client>()> proxy_connector;
+
 class RoraProxy_client : public Proxy_client {
 public:
   RoraProxy_client(std::unique_ptr<GenericProxy_client> delegate,
-                   const RoraConfig &);
+                   const RoraConfig &, proxy_connector connect);
 
   virtual bool namespace_exists(const std::string &name);
 
@@ -61,10 +83,23 @@ public:
                                    const consistent_read,
                                    alba::statistics::RoraCounter &);
 
+  // reads on this client can overlap, up to one per event loop thread
+  virtual std::future<void>
+  read_objects_slices_async(const std::string &namespace_,
+                            const std::vector<ObjectSlices> &,
+                            const consistent_read,
+                            alba::statistics::RoraCounter &,
+                            read_done_callback on_done = nullptr);
+
+  // with consistent_read::F, from the manifest cache (which a miss fills)
   virtual std::tuple<uint64_t, Checksum *>
   get_object_info(const std::string &namespace_, const std::string &object_name,
                   const consistent_read, const should_cache);
 
+  virtual std::future<void>
+  prefetch_manifests(const std::string &namespace_,
+                     const std::vector<std::string> &object_names);
+
   virtual void
   apply_sequence(const std::string &namespace_, const write_barrier,
                  const std::vector<std::shared_ptr<sequences::Assert>> &,
@@ -85,10 +120,22 @@ public:
   get_fragment_encryption_key(const string &alba_id,
                               const namespace_t namespace_id);
 
-  virtual ~RoraProxy_client(){};
+  virtual ~RoraProxy_client() {
+    _drain_async();
+    // the workers can still be busy with the loser of a hedged read
+    _prefetch_pool.reset();
+    _hedge_reactor.reset();
+    _hedge_proxy_pool.reset();
+    _proxy_leg_pool.reset();
+  };
 
 private:
   std::unique_ptr<GenericProxy_client> _delegate;
+  proxy_connector _connect;
+
+  // asks the proxy for the manifest serialization we understand
+  void _init_session(GenericProxy_client &);
+  std::unique_ptr<GenericProxy_client> _open_connection();
 
   void _process(std::vector<object_info> &object_infos,
                 const string &namespace_);
@@ -96,19 +143,48 @@ private:
   void
   _maybe_update_osd_infos(std::map<osd_t, std::vector<asd_slice>> &per_osd);
 
-  int _short_path(const std::vector<std::pair<byte *, Location>> &);
+  int _short_path(const std::vector<std::pair<byte *, Location>> &,
+                  std::set<osd_t> &unread_osds,
+                  const std::atomic<bool> *cancelled = nullptr);
+
+  bool _partial_decrypt(const alba_id_t &alba_id, unsigned char *buf,
+                        Location &);
+
+  // rebuilds locations[j] for j in lost, reading k other fragments of the
+  // chunk. rebuilt[j] is set for every success.
+  void _degraded_read(const alba_id_t &alba_id,
+                      const std::vector<std::pair<byte *, Location>> &locations,
+                      const std::vector<size_t> &lost,
+                      const std::set<osd_t> &unread_osds,
+                      std::vector<bool> &rebuilt);
+
+  // reads, rebuilds and decrypts the locations. Once cancelled is set, it
+  // stops at the next osd, and what it didn't get to is marked failed.
+  void _asd_leg(const alba_id_t &alba_id,
+                std::vector<std::pair<byte *, Location>> &locations,
+                asd_leg_result &, const std::atomic<bool> *cancelled = nullptr);
+
+  // _asd_leg on the calling thread, but when it's slower than the hedge
+  // delay the objects are also read via the proxy. Returns true if the proxy
+  // answered first.
+  bool _hedged_asd_leg(const std::string &namespace_,
+                       const std::vector<ObjectSlices> &,
+                       std::vector<std::pair<byte *, Location>> &,
+                       const std::vector<size_t> &location_objects,
+                       const consistent_read, const alba_id_t &alba_id,
+                       asd_leg_result &, alba::statistics::RoraCounter &);
 
   bool _use_null_io;
 
   bool _has_local_fragment_cache;
 
+  std::mutex _failure_mutex;
   int _fast_path_failures;
   steady_clock::time_point _failure_time;
 
   int _asd_connection_pool_size;
   std::chrono::steady_clock::duration _asd_partial_read_timeout;
 
-  message_builder _fkb;
   string _fragment_key(const namespace_t namespace_id, const string &object_id,
                        uint32_t version_id, uint32_t chunk_id,
                        uint32_t fragment_id);
@@ -119,6 +195,54 @@ private:
                   std::vector<object_info> &object_infos,
                   alba::statistics::RoraCounter &);
 
+  // the proxy leg of a mixed read_objects_slices runs here, next to the asd
+  // leg, over its own connection: it never shares _delegate with the caller.
+  std::once_flag _proxy_leg_pool_once;
+  std::unique_ptr<workers::WorkerPool> _proxy_leg_pool;
+  workers::WorkerPool &_proxy_leg_worker();
+  std::unique_ptr<GenericProxy_client> _proxy_leg_delegate;
+  void _proxy_leg(const std::string &namespace_,
+                  const std::vector<ObjectSlices> &slices,
+                  const consistent_read, std::vector<object_info> &,
+                  alba::statistics::RoraCounter &);
+
+  // reads on this client can overlap, so every call on _delegate takes this
+  std::mutex _delegate_mutex;
+
+  // fires the proxy read of a hedged read once its delay has passed
+  double _hedge_percentile;
+  std::once_flag _hedge_reactor_once;
+  std::unique_ptr<transport::Reactor> _hedge_reactor;
+  transport::TimerWheel &_hedge_timers();
+
+  // the proxy read of a hedge goes over its own connection, so a hedge that
+  // lost doesn't hold up the next read's proxy calls. While it is still
+  // busy no new hedge is issued.
+  std::once_flag _hedge_proxy_pool_once;
+  std::unique_ptr<workers::WorkerPool> _hedge_proxy_pool;
+  workers::WorkerPool &_hedge_proxy_worker();
+  std::atomic<bool> _hedge_proxy_busy{false};
+  std::unique_ptr<GenericProxy_client> _hedge_delegate;
+
+  // prefetch_manifests runs here, one batch of object names at a time,
+  // over its own connection
+  std::once_flag _prefetch_pool_once;
+  std::unique_ptr<workers::WorkerPool> _prefetch_pool;
+  workers::WorkerPool &_prefetch_worker();
+  std::unique_ptr<GenericProxy_client> _prefetch_delegate;
+  void _prefetch(const std::string &namespace_,
+                 const std::vector<std::string> &object_names);
+  // a batch the proxy refuses is split until the culprits are on their own.
+  // Returns the number of manifests fetched.
+  size_t _prefetch_batch(const std::string &namespace_,
+                         std::vector<ObjectSlices>::const_iterator first,
+                         std::vector<ObjectSlices>::const_iterator last);
+
+  // how long a read waits for another one to fetch the manifest it misses
+  const std::chrono::steady_clock::duration _manifest_fetch_wait =
+      std::chrono::seconds(5);
+
+  std::mutex _enc_keys_mutex;
   std::unordered_map<string, string> _enc_keys;
   string get_encryption_key(const string &alba_id,
                             const namespace_t namespace_id,
@@ -5,6 +5,7 @@
 
 #include "statistics.h"
 #include "stuff.h"
+#include <algorithm>
 
 namespace alba {
 namespace statistics {
@@ -18,11 +19,15 @@ Statistics::Statistics()
 }
 
 void Statistics::new_start() { _t0 = high_resolution_clock::now(); }
-void Statistics::new_stop() {
+void Statistics::new_stop() { add_sample(_t0, high_resolution_clock::now()); }
 
-  _t1 = high_resolution_clock::now();
+void Statistics::add_sample(high_resolution_clock::time_point t0,
+                            high_resolution_clock::time_point t1) {
+  if (t1 > _t1) {
+    _t1 = t1;
+  }
 
-  int duration = duration_cast<microseconds>(_t1 - _t0).count();
+  int duration = duration_cast<microseconds>(t1 - t0).count();
 
   if (duration < _min_dur) {
     _min_dur = duration;
@@ -47,6 +52,17 @@ void Statistics::new_stop() {
   }
   _avg = ((_avg * _n_samples) + duration) / (_n_samples + 1);
   _n_samples++;
+  _samples.push_back(duration);
+}
+
+double Statistics::percentile(double p) const {
+  if (_samples.empty()) {
+    return 0.0;
+  }
+  std::vector<double> sorted(_samples);
+  size_t index = (size_t)(p * (sorted.size() - 1));
+  std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+  return sorted[index];
 }
 
 void Statistics::pretty(std::ostream &os) const {
@@ -54,6 +70,8 @@ void Statistics::pretty(std::ostream &os) const {
   os << "min_dur: " << _min_dur << std::endl;
   os << "max_dur: " << _max_dur << std::endl;
   os << "average: " << _avg << std::endl;
+  os << "p50: " << percentile(0.50) << std::endl;
+  os << "p99: " << percentile(0.99) << std::endl;
 
   double duration =
       (duration_cast<milliseconds>(_t1 - _creation).count()) / 1000.0;
@@ -66,10 +66,29 @@ void TCP_transport::expires_from_now(
   _timeout = _convert(timeout);
 }
 
-void TCP_transport::write_exact(const char *buf, int len) {
-  boost::asio::const_buffers_1 buffer(buf, len);
-  // boost::asio::write(_socket, buffer);
+namespace {
+template <typename Buffer>
+std::vector<Buffer> _as_buffers(const struct iovec *iov, int iovcnt) {
+  std::vector<Buffer> buffers;
+  buffers.reserve(iovcnt);
+  for (int i = 0; i < iovcnt; i++) {
+    buffers.emplace_back(iov[i].iov_base, iov[i].iov_len);
+  }
+  return buffers;
+}
 
+size_t _total_length(const struct iovec *iov, int iovcnt) {
+  size_t total = 0;
+  for (int i = 0; i < iovcnt; i++) {
+    total += iov[i].iov_len;
+  }
+  return total;
+}
+}
+
+template <typename Buffers>
+void TCP_transport::_write(const Buffers &buffers, size_t len,
+                           const char *what) {
   //_io_service.reset();
   _deadline.expires_from_now(_timeout);
   boost::system::error_code ec = boost::asio::error::would_block;
@@ -78,13 +97,13 @@ void TCP_transport::write_exact(const char *buf, int len) {
                      std::size_t len2) -> void {
     ec = x;
     if (!ec && len2 < len) {
-      ALBA_LOG(INFO, "tcp_transport write_exact: len2<len ("
-                         << len2 << "<" << len << ") aka EOF (" << ec.message()
-                         << ")");
+      ALBA_LOG(INFO, "tcp_transport " << what << ": len2<len (" << len2 << "<"
+                                      << len << ") aka EOF (" << ec.message()
+                                      << ")");
       ec = boost::asio::error::eof;
     }
   };
-  boost::asio::async_write(_socket, buffer, handler);
+  boost::asio::async_write(_socket, buffers, handler);
 
   do {
     _io_service.run_one();
@@ -94,10 +113,9 @@ void TCP_transport::write_exact(const char *buf, int len) {
     throw boost::system::system_error(ec);
 }
 
-void TCP_transport::read_exact(char *buf, int len) {
-  boost::asio::mutable_buffers_1 buffer(buf, len);
-  // boost::asio::read(_socket, buffer);
-
+template <typename Buffers>
+void TCP_transport::_read(const Buffers &buffers, size_t len,
+                          const char *what) {
   //_io_service.reset();
   _deadline.expires_from_now(_timeout);
   boost::system::error_code ec = boost::asio::error::would_block;
@@ -106,13 +124,13 @@ void TCP_transport::read_exact(char *buf, int len) {
                      std::size_t len2) -> void {
     ec = x;
     if (!ec && len2 < len) {
-      ALBA_LOG(INFO, "tcp_transport read_exact: len2<len ("
-                         << len2 << "<" << len << ") aka EOF (" << ec.message()
-                         << ")");
+      ALBA_LOG(INFO, "tcp_transport " << what << ": len2<len (" << len2 << "<"
+                                      << len << ") aka EOF (" << ec.message()
+                                      << ")");
       ec = boost::asio::error::eof;
     }
   };
-  boost::asio::async_read(_socket, buffer, handler);
+  boost::asio::async_read(_socket, buffers, handler);
 
   // Block until the asynchronous operation has completed.
 
@@ -124,6 +142,24 @@ void TCP_transport::read_exact(char *buf, int len) {
     throw boost::system::system_error(ec);
 }
 
+void TCP_transport::write_exact(const char *buf, int len) {
+  _write(boost::asio::const_buffers_1(buf, len), len, "write_exact");
+}
+
+void TCP_transport::read_exact(char *buf, int len) {
+  _read(boost::asio::mutable_buffers_1(buf, len), len, "read_exact");
+}
+
+void TCP_transport::writev_exact(const struct iovec *iov, int iovcnt) {
+  _write(_as_buffers<const_buffer>(iov, iovcnt), _total_length(iov, iovcnt),
+         "writev_exact");
+}
+
+void TCP_transport::readv_exact(const struct iovec *iov, int iovcnt) {
+  _read(_as_buffers<mutable_buffer>(iov, iovcnt), _total_length(iov, iovcnt),
+        "readv_exact");
+}
+
 void TCP_transport::_check_deadline() {
   if (_deadline.expires_at() <= deadline_timer::traits_type::now()) {
     boost::system::error_code ignored_ec;
@@ -138,5 +174,193 @@ TCP_transport::~TCP_transport() {
   boost::system::error_code ec;
   _socket.close(ec); // does not throw
 }
+TCP_reactor_transport::TCP_reactor_transport(
+    const string &ip, const string &port,
+    const std::chrono::steady_clock::duration &timeout,
+    std::shared_ptr<Reactor> reactor)
+    : _reactor(std::move(reactor)), _socket(_reactor->io_service()),
+      _timeout(timeout), _done(false), _expired(false) {
+  ALBA_LOG(INFO, "TCP_reactor_transport(" << ip << ", " << port << ")");
+
+  int port_as_int = std::stoi(port);
+  auto addr = ip::address::from_string(ip);
+  auto sa = ip::tcp::endpoint(addr, port_as_int);
+
+  _wait_for(
+      [&](io_handler handler) {
+        _socket.async_connect(
+            sa, [handler](const boost::system::error_code &ec) {
+              handler(ec, 0);
+            });
+      },
+      "connect");
+
+  const ip::tcp::no_delay no_delay(true);
+  _socket.set_option(no_delay);
+  _socket.non_blocking(true);
+}
+
+void TCP_reactor_transport::expires_from_now(
+    const std::chrono::steady_clock::duration &timeout) {
+  _timeout = timeout;
+}
+
+void TCP_reactor_transport::write_exact(const char *buf, int len) {
+  size_t done = 0;
+  while (done < (size_t)len) {
+    boost::system::error_code ec;
+    done += _socket.write_some(buffer(buf + done, len - done), ec);
+    if (ec == error::would_block || ec == error::try_again) {
+      break;
+    }
+    if (ec) {
+      throw boost::system::system_error(ec);
+    }
+  }
+  if (done == (size_t)len) {
+    return;
+  }
+  _wait_for(
+      [&](io_handler handler) {
+        async_write(_socket, buffer(buf + done, len - done), handler);
+      },
+      "write_exact");
+}
+
+void TCP_reactor_transport::read_exact(char *buf, int len) {
+  size_t done = 0;
+  while (done < (size_t)len) {
+    boost::system::error_code ec;
+    done += _socket.read_some(buffer(buf + done, len - done), ec);
+    if (ec == error::would_block || ec == error::try_again) {
+      break;
+    }
+    if (ec) {
+      throw boost::system::system_error(ec);
+    }
+  }
+  if (done == (size_t)len) {
+    return;
+  }
+  _wait_for(
+      [&](io_handler handler) {
+        async_read(_socket, buffer(buf + done, len - done), handler);
+      },
+      "read_exact");
+}
+
+void TCP_reactor_transport::writev_exact(const struct iovec *iov, int iovcnt) {
+  iovec_cursor cursor(iov, iovcnt);
+  while (!cursor.done()) {
+    boost::system::error_code ec;
+    size_t n = _socket.write_some(
+        _as_buffers<const_buffer>(cursor.data(), cursor.count()), ec);
+    if (ec == error::would_block || ec == error::try_again) {
+      break;
+    }
+    if (ec) {
+      throw boost::system::system_error(ec);
+    }
+    cursor.consume(n);
+  }
+  while (!cursor.done()) {
+    const int count = cursor.count();
+    _wait_for(
+        [&](io_handler handler) {
+          async_write(_socket,
+                      _as_buffers<const_buffer>(cursor.data(), count),
+                      handler);
+        },
+        "writev_exact");
+    cursor.consume(_total_length(cursor.data(), count));
+  }
+}
+
+void TCP_reactor_transport::readv_exact(const struct iovec *iov, int iovcnt) {
+  iovec_cursor cursor(iov, iovcnt);
+  while (!cursor.done()) {
+    boost::system::error_code ec;
+    size_t n = _socket.read_some(
+        _as_buffers<mutable_buffer>(cursor.data(), cursor.count()), ec);
+    if (ec == error::would_block || ec == error::try_again) {
+      break;
+    }
+    if (ec) {
+      throw boost::system::system_error(ec);
+    }
+    cursor.consume(n);
+  }
+  while (!cursor.done()) {
+    const int count = cursor.count();
+    _wait_for(
+        [&](io_handler handler) {
+          async_read(_socket,
+                     _as_buffers<mutable_buffer>(cursor.data(), count),
+                     handler);
+        },
+        "readv_exact");
+    cursor.consume(_total_length(cursor.data(), count));
+  }
+}
+
+void TCP_reactor_transport::_wait_for(
+    const std::function<void(io_handler)> &start, const char *what) {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _done = false;
+    _expired = false;
+  }
+  // the operation is started and the expiry runs on the reactor's one
+  // thread, so the socket is never used from two threads at once.
+  const bool has_deadline =
+      _timeout != std::chrono::steady_clock::duration::max();
+  TimerWheel::timer_id deadline = 0;
+  if (has_deadline) {
+    deadline = _reactor->timers().schedule(_timeout, [this]() {
+      std::lock_guard<std::mutex> lock(_mutex);
+      if (_done) {
+        // too late to matter: the operation made it
+        return;
+      }
+      _expired = true;
+      boost::system::error_code ignored_ec;
+      _socket.close(ignored_ec);
+    });
+  }
+
+  _reactor->io_service().post([this, &start]() {
+    start([this](const boost::system::error_code &ec, std::size_t) {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _ec = ec;
+      _done = true;
+      _done_cond.notify_one();
+    });
+  });
+
+  boost::system::error_code ec;
+  bool expired;
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _done_cond.wait(lock, [this]() { return _done; });
+    ec = _ec;
+    expired = _expired;
+  }
+
+  if (has_deadline) {
+    _reactor->timers().cancel(deadline);
+  }
+  if (expired) {
+    ALBA_LOG(INFO, "TCP_reactor_transport " << what << ": timed out");
+    throw boost::system::system_error(error::timed_out);
+  }
+  if (ec) {
+    throw boost::system::system_error(ec);
+  }
+}
+
+TCP_reactor_transport::~TCP_reactor_transport() {
+  boost::system::error_code ec;
+  _socket.close(ec);
+}
 }
 }
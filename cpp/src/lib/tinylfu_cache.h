@@ -0,0 +1,325 @@
+/*
+  Copyright (C) iNuron - info@openvstorage.com
+  This file is part of Open vStorage. For license information, see <LICENSE.txt>
+*/
+
+#pragma once
+
+#include "lru_cache.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+namespace ovs {
+
+/* approximate access counts (0..15) of many keys in little space: a
+ * count-min sketch of 4 rows. All counts are halved every 10 * width
+ * additions, so what was popular long ago fades. */
+class FrequencySketch {
+public:
+  explicit FrequencySketch(size_t width = 64) { resize(width); }
+
+  // starts over with room for about width keys
+  void resize(size_t width) {
+    _log_width = 6;
+    while (((size_t)1 << _log_width) < width) {
+      _log_width++;
+    }
+    _counters.assign(_rows << _log_width, 0);
+    _additions = 0;
+  }
+
+  size_t width() const { return (size_t)1 << _log_width; }
+
+  void add(uint64_t h) {
+    for (uint32_t r = 0; r < _rows; r++) {
+      uint8_t &c = _counters[_index(h, r)];
+      if (c < 15) {
+        c++;
+      }
+    }
+    if (++_additions >= 10 * width()) {
+      for (auto &c : _counters) {
+        c >>= 1;
+      }
+      _additions = 0;
+    }
+  }
+
+  uint8_t estimate(uint64_t h) const {
+    uint8_t m = 15;
+    for (uint32_t r = 0; r < _rows; r++) {
+      m = std::min(m, _counters[_index(h, r)]);
+    }
+    return m;
+  }
+
+private:
+  static const uint32_t _rows = 4;
+  uint32_t _log_width;
+  std::vector<uint8_t> _counters;
+  size_t _additions;
+
+  size_t _index(uint64_t h, uint32_t r) const {
+    static const uint64_t seeds[_rows] = {
+        0x9e3779b97f4a7c15ull, 0xc2b2ae3d27d4eb4full, 0x165667b19e3779f9ull,
+        0xd6e8feb86659fd93ull};
+    uint64_t x = (h + r) * seeds[r];
+    return ((size_t)r << _log_width) + (x >> (64 - _log_width));
+  }
+};
+
+/* W-TinyLFU: new entries go to a small LRU window (1% of the limits).
+ * What falls out of the window only makes it into the main cache if it
+ * was asked for more often than what the main cache would evict for it,
+ * as counted by a FrequencySketch over all lookups, hits and misses. So a
+ * scan over keys that are used once passes through the window without
+ * flushing the entries that are used all the time.
+ *
+ * The main cache is a segmented LRU: an entry found again moves from
+ * probation to the protected segment (80% of the main cache), and is
+ * demoted to probation when the protected segment overflows.
+ */
+template <typename K, typename V, typename Hash = std::hash<K>>
+class UnsafeWTinyLFUCache : public UnsafeWeightedCache<K, V> {
+public:
+  UnsafeWTinyLFUCache(size_t max_entries, size_t max_weight) {
+    set_limits(max_entries, max_weight);
+  }
+
+  UnsafeWTinyLFUCache(const UnsafeWTinyLFUCache &) = delete;
+  UnsafeWTinyLFUCache &operator=(const UnsafeWTinyLFUCache &) = delete;
+
+  boost::optional<V> find(const K &k) override {
+    _sketch.add(Hash()(k));
+    auto it = _index.find(k);
+    if (it == _index.end()) {
+      return boost::none;
+    }
+    auto e = it->second;
+    switch (e->segment) {
+    case WINDOW:
+      _move(e, WINDOW);
+      break;
+    case PROBATION:
+    case PROTECTED:
+      _move(e, PROTECTED);
+      _demote();
+      break;
+    }
+    return e->value;
+  }
+
+  void insert(const K &k, const V &v, size_t weight) override {
+    erase(k);
+    _sketch.add(Hash()(k));
+    if (_too_heavy(weight)) {
+      return;
+    }
+    auto &window = _segments[WINDOW];
+    window.entries.push_back(entry{k, v, weight, WINDOW});
+    window.weight += weight;
+    _index.emplace(k, std::prev(window.entries.end()));
+    if (_index.size() > _sketch.width() / 2) {
+      _sketch.resize(2 * _index.size());
+    }
+    _evict();
+  }
+
+  void reweigh(const K &k, const V &v, size_t weight) override {
+    auto it = _index.find(k);
+    if (it != _index.end() && it->second->value == v) {
+      if (_too_heavy(weight)) {
+        _drop(it->second);
+        return;
+      }
+      auto e = it->second;
+      auto &s = _segments[e->segment];
+      s.weight = s.weight - e->weight + weight;
+      e->weight = weight;
+      _demote();
+      _evict();
+    }
+  }
+
+  bool erase(const K &k) override {
+    auto it = _index.find(k);
+    if (it == _index.end()) {
+      return false;
+    }
+    _drop(it->second);
+    return true;
+  }
+
+  void erase_if(const std::function<bool(const K &)> &p) override {
+    for (auto &s : _segments) {
+      for (auto it = s.entries.begin(); it != s.entries.end();) {
+        auto next = std::next(it);
+        if (p(it->key)) {
+          _drop(it);
+        }
+        it = next;
+      }
+    }
+  }
+
+  void set_limits(size_t max_entries, size_t max_weight) override {
+    _window_entries = _share(max_entries, 1);
+    _window_weight = _share(max_weight, 1);
+    _main_max_entries = _share(max_entries, 100) - _window_entries;
+    _main_max_weight = _share(max_weight, 100) - _window_weight;
+    if (max_entries != 0) {
+      _main_max_entries = std::max<size_t>(1, _main_max_entries);
+    }
+    if (max_weight != 0) {
+      _main_max_weight = std::max<size_t>(1, _main_max_weight);
+    }
+    _protected_entries = _share(_main_max_entries, 80);
+    _protected_weight = _share(_main_max_weight, 80);
+    if (max_entries != 0 && _sketch.width() < 2 * max_entries) {
+      _sketch.resize(2 * max_entries);
+    }
+    _demote();
+    _evict();
+  }
+
+  size_t size() const override { return _index.size(); }
+
+  size_t weight() const override {
+    return _segments[WINDOW].weight + _main_weight();
+  }
+
+private:
+  enum segment_t { WINDOW = 0, PROBATION = 1, PROTECTED = 2 };
+  struct entry {
+    K key;
+    V value;
+    size_t weight;
+    segment_t segment;
+  };
+  typedef typename std::list<entry>::iterator entry_it;
+  struct segment {
+    std::list<entry> entries; // least recently used first
+    size_t weight = 0;
+  };
+
+  segment _segments[3];
+  std::unordered_map<K, entry_it, Hash> _index;
+  FrequencySketch _sketch;
+  size_t _window_entries;
+  size_t _window_weight;
+  size_t _main_max_entries;
+  size_t _main_max_weight;
+  size_t _protected_entries;
+  size_t _protected_weight;
+
+  // percent of max, at least 1 if there is a max
+  static size_t _share(size_t max, size_t percent) {
+    return max == 0 ? 0 : std::max<size_t>(1, max * percent / 100);
+  }
+
+  static bool _over(size_t entries, size_t weight, size_t max_entries,
+                    size_t max_weight) {
+    return (max_entries != 0 && entries > max_entries) ||
+           (max_weight != 0 && weight > max_weight);
+  }
+
+  // too heavy for the main cache on its own
+  bool _too_heavy(size_t weight) const {
+    return _main_max_weight != 0 && weight > _main_max_weight;
+  }
+
+  size_t _main_weight() const {
+    return _segments[PROBATION].weight + _segments[PROTECTED].weight;
+  }
+
+  size_t _main_entries() const {
+    return _segments[PROBATION].entries.size() +
+           _segments[PROTECTED].entries.size();
+  }
+
+  // to the most recently used end of segment to
+  void _move(entry_it e, segment_t to) {
+    auto &from = _segments[e->segment];
+    auto &s = _segments[to];
+    from.weight -= e->weight;
+    s.weight += e->weight;
+    s.entries.splice(s.entries.end(), from.entries, e);
+    e->segment = to;
+  }
+
+  void _drop(entry_it e) {
+    auto &s = _segments[e->segment];
+    s.weight -= e->weight;
+    _index.erase(e->key);
+    s.entries.erase(e);
+  }
+
+  void _demote() {
+    auto &p = _segments[PROTECTED];
+    while (!p.entries.empty() && _over(p.entries.size(), p.weight,
+                                       _protected_entries, _protected_weight)) {
+      _move(p.entries.begin(), PROBATION);
+    }
+  }
+
+  bool _main_over() const {
+    return _over(_main_entries(), _main_weight(), _main_max_entries,
+                 _main_max_weight);
+  }
+
+  // the main cache's choice of what to evict next
+  entry_it _victim() {
+    auto &probation = _segments[PROBATION].entries;
+    if (!probation.empty()) {
+      return probation.begin();
+    }
+    return _segments[PROTECTED].entries.begin();
+  }
+
+  // idem, but not the candidate, unless it's all there is
+  entry_it _victim(entry_it candidate) {
+    auto &probation = _segments[PROBATION].entries;
+    if (probation.begin() != candidate) {
+      return probation.begin();
+    }
+    auto &protected_ = _segments[PROTECTED].entries;
+    if (!protected_.empty()) {
+      return protected_.begin();
+    }
+    return candidate;
+  }
+
+  void _evict() {
+    auto &window = _segments[WINDOW];
+    while (!window.entries.empty() &&
+           _over(window.entries.size(), window.weight, _window_entries,
+                 _window_weight)) {
+      auto candidate = window.entries.begin();
+      if (_too_heavy(candidate->weight)) {
+        // the limits shrank under it
+        _drop(candidate);
+        continue;
+      }
+      _move(candidate, PROBATION);
+      uint8_t candidate_frequency = _sketch.estimate(Hash()(candidate->key));
+      while (_main_over()) {
+        auto victim = _victim(candidate);
+        if (victim != candidate &&
+            candidate_frequency > _sketch.estimate(Hash()(victim->key))) {
+          _drop(victim);
+        } else {
+          _drop(candidate);
+          break;
+        }
+      }
+    }
+    while (_main_entries() != 0 && _main_over()) {
+      _drop(_victim());
+    }
+  }
+};
+}
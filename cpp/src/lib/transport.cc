@@ -5,6 +5,9 @@
 
 #include "transport.h"
 
+#include <algorithm>
+#include <climits>
+
 namespace alba {
 namespace transport {
 
@@ -16,6 +19,9 @@ std::ostream &operator<<(std::ostream &os, Kind t) {
   case Kind::rdma:
     os << "RDMA";
     break;
+  case Kind::io_uring:
+    os << "IO_URING";
+    break;
   }
 
   return os;
@@ -28,6 +34,8 @@ std::istream &operator>>(std::istream &is, Kind &t) {
     t = Kind::tcp;
   } else if (s == "RDMA") {
     t = Kind::rdma;
+  } else if (s == "IO_URING") {
+    t = Kind::io_uring;
   } else {
     is.setstate(std::ios_base::failbit);
   }
@@ -35,6 +43,52 @@ std::istream &operator>>(std::istream &is, Kind &t) {
   return is;
 }
 
+iovec_cursor::iovec_cursor(const struct iovec *iov, int iovcnt) : _first(0) {
+  _iov.reserve(iovcnt);
+  for (int i = 0; i < iovcnt; i++) {
+    if (iov[i].iov_len > 0) {
+      _iov.push_back(iov[i]);
+    }
+  }
+}
+
+size_t iovec_cursor::remaining() const {
+  size_t r = 0;
+  for (size_t i = _first; i < _iov.size(); i++) {
+    r += _iov[i].iov_len;
+  }
+  return r;
+}
+
+int iovec_cursor::count() const {
+  return std::min(_iov.size() - _first, (size_t)IOV_MAX);
+}
+
+void iovec_cursor::consume(size_t n) {
+  while (n > 0 && _first < _iov.size()) {
+    auto &v = _iov[_first];
+    if (n < v.iov_len) {
+      v.iov_base = (char *)v.iov_base + n;
+      v.iov_len -= n;
+      return;
+    }
+    n -= v.iov_len;
+    _first++;
+  }
+}
+
+void Transport::writev_exact(const struct iovec *iov, int iovcnt) {
+  for (int i = 0; i < iovcnt; i++) {
+    this->write_exact((const char *)iov[i].iov_base, iov[i].iov_len);
+  }
+}
+
+void Transport::readv_exact(const struct iovec *iov, int iovcnt) {
+  for (int i = 0; i < iovcnt; i++) {
+    this->read_exact((char *)iov[i].iov_base, iov[i].iov_len);
+  }
+}
+
 llio::message Transport::read_message() {
   auto mb = llio::message_buffer::from_reader(
       [&](char *buffer, const int len) -> void {
@@ -44,9 +98,18 @@ llio::message Transport::read_message() {
 }
 
 void Transport::output(llio::message_builder &mb) {
+  if (!mb.has_external()) {
+    mb.output_using([&](const char *buffer, const int len) -> void {
+      this->write_exact(buffer, len);
+    });
+    return;
+  }
+  // gather the builder's own buffer and the external parts in one go
+  std::vector<struct iovec> iov;
   mb.output_using([&](const char *buffer, const int len) -> void {
-    this->write_exact(buffer, len);
+    iov.push_back(iovec{(void *)buffer, (size_t)len});
   });
+  this->writev_exact(iov.data(), iov.size());
 }
 }
 }
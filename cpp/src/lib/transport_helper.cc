@@ -4,6 +4,7 @@
 */
 
 #include "transport_helper.h"
+#include "io_uring_transport.h"
 #include "rdma_transport.h"
 #include "tcp_transport.h"
 
@@ -14,8 +15,21 @@ std::unique_ptr<Transport>
 make_transport(const Kind k, const std::string &ip, const std::string &port,
                const std::chrono::steady_clock::duration &timeout) {
   switch (k) {
-  case Kind::tcp:
+  case Kind::io_uring:
+    if (IOUring_transport::supported()) {
+      return std::make_unique<IOUring_transport>(ip, port, timeout);
+    }
+    ALBA_LOG(INFO, "make_transport(" << ip << ", " << port
+                                     << "): falling back to tcp");
+  // fall through
+  case Kind::tcp: {
+    auto reactor = Reactors::getInstance().next();
+    if (reactor) {
+      return std::make_unique<TCP_reactor_transport>(ip, port, timeout,
+                                                     reactor);
+    }
     return std::make_unique<TCP_transport>(ip, port, timeout);
+  }
   case Kind::rdma:
     return std::make_unique<RDMA_transport>(ip, port, timeout);
   default:
@@ -0,0 +1,34 @@
+/*
+  Copyright (C) iNuron - info@openvstorage.com
+  This file is part of Open vStorage. For license information, see <LICENSE.txt>
+*/
+
+#include "worker_pool.h"
+#include "alba_logger.h"
+
+#include <algorithm>
+
+namespace alba {
+namespace workers {
+
+WorkerPool::WorkerPool(size_t n_threads)
+    : _work(new boost::asio::io_service::work(_io_service)) {
+  ALBA_LOG(INFO, "WorkerPool(" << n_threads << ")");
+  for (size_t i = 0; i < n_threads; i++) {
+    _threads.emplace_back([this]() { _io_service.run(); });
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  _work.reset();
+  for (auto &t : _threads) {
+    t.join();
+  }
+}
+
+WorkerPool &event_loop() {
+  static WorkerPool loop(std::max(2u, std::thread::hardware_concurrency()));
+  return loop;
+}
+}
+}
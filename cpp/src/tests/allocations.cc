@@ -0,0 +1,52 @@
+/*
+  Copyright (C) iNuron - info@openvstorage.com
+  This file is part of Open vStorage. For license information, see <LICENSE.txt>
+*/
+
+#include "allocations.h"
+#include <cstdlib>
+#include <new>
+
+namespace {
+thread_local bool _counting = false;
+thread_local allocation_count _count;
+
+// every block starts with its size, so a free knows what it gives back
+const size_t _HEADER = 16;
+}
+
+void start_counting_allocations() {
+  _count = allocation_count();
+  _counting = true;
+}
+
+allocation_count stop_counting_allocations() {
+  _counting = false;
+  return _count;
+}
+
+void *operator new(size_t size) {
+  char *p = (char *)malloc(size + _HEADER);
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  *(size_t *)p = size;
+  if (_counting) {
+    _count.allocations++;
+    _count.live_bytes += size;
+  }
+  return p + _HEADER;
+}
+
+void operator delete(void *p) noexcept {
+  if (p == nullptr) {
+    return;
+  }
+  char *b = (char *)p - _HEADER;
+  if (_counting) {
+    _count.live_bytes -= *(size_t *)b;
+  }
+  free(b);
+}
+
+void operator delete(void *p, size_t) noexcept { operator delete(p); }
@@ -0,0 +1,24 @@
+/*
+  Copyright (C) iNuron - info@openvstorage.com
+  This file is part of Open vStorage. For license information, see <LICENSE.txt>
+*/
+
+#pragma once
+#include <cstdint>
+
+/* the unit tests replace the global operator new/delete, so they can
+ * count what a piece of code allocates on the calling thread. */
+struct allocation_count {
+  uint64_t allocations = 0;
+  // allocated minus freed while counting
+  int64_t live_bytes = 0;
+};
+
+void start_counting_allocations();
+allocation_count stop_counting_allocations();
+
+template <typename F> allocation_count allocations_of(F &&f) {
+  start_counting_allocations();
+  f();
+  return stop_counting_allocations();
+}
@@ -6,6 +6,7 @@
 #include "asd_client.h"
 #include "alba_common.h"
 #include "asd_access.h"
+#include "io_uring_transport.h"
 #include "proxy_protocol.h"
 #include "tcp_transport.h"
 #include "gtest/gtest.h"
@@ -21,6 +22,9 @@ using std::vector;
 using alba::byte;
 using alba::transport::Transport;
 using alba::transport::TCP_transport;
+using alba::transport::TCP_reactor_transport;
+using alba::transport::Reactor;
+using alba::transport::IOUring_transport;
 using alba::asd_protocol::slice;
 using alba::asd_client::Asd_client;
 using namespace std::chrono;
@@ -61,6 +65,117 @@ TEST(asd_client, partial_read) {
   EXPECT_EQ(0, memcmp(target, expected_target, 50));
 }
 
+TEST(asd_client, partial_read_batch) {
+  const steady_clock::duration timeout = seconds(1);
+  auto asd = make_client(timeout);
+
+  byte target[100];
+  memset(target, (int)'b', 100);
+  slice slice1{0, 50, target};
+  slice slice2{10, 25, &target[50]};
+  slice slice3{5, 25, &target[75]};
+  vector<alba::asd_client::key_slices> batch{
+      {"key1", vector<slice>{slice1, slice2}},
+      {"key1", vector<slice>{slice3}}};
+
+  asd->partial_get(batch);
+
+  byte expected_target[100];
+  memset(expected_target, (int)'a', 100);
+  EXPECT_EQ(0, memcmp(target, expected_target, 100));
+
+  // the connection is still usable afterwards
+  asd->get_version();
+}
+
+TEST(asd_client, partial_read_shared_reactor) {
+  const steady_clock::duration timeout = seconds(1);
+  string ip = getenv("ALBA_ASD_IP");
+  string port = "8000";
+  auto reactor = std::make_shared<Reactor>(milliseconds(10));
+
+  vector<std::unique_ptr<Asd_client>> asds;
+  for (int i = 0; i < 3; i++) {
+    auto transport = std::unique_ptr<Transport>(
+        new TCP_reactor_transport(ip, port, timeout, reactor));
+    asds.emplace_back(
+        new Asd_client(timeout, std::move(transport), boost::none));
+  }
+
+  string key = "key1";
+  byte expected_target[80];
+  memset(expected_target, (int)'a', 80);
+  for (int round = 0; round < 2; round++) {
+    for (auto &asd : asds) {
+      byte target[80];
+      memset(target, (int)'b', 80);
+      slice slice1{0, 50, target};
+      slice slice2{20, 30, &target[50]};
+      auto slices = vector<slice>{slice1, slice2};
+      asd->partial_get(key, slices);
+      EXPECT_EQ(0, memcmp(target, expected_target, 80));
+    }
+  }
+  // all deadlines were cancelled
+  EXPECT_EQ(0u, reactor->timers().pending());
+}
+
+TEST(asd_client, partial_read_io_uring) {
+  const steady_clock::duration timeout = seconds(1);
+  string ip = getenv("ALBA_ASD_IP");
+  string port = "8000";
+  auto transport = std::unique_ptr<Transport>(
+      new IOUring_transport(ip, port, timeout));
+  Asd_client asd(timeout, std::move(transport), boost::none);
+
+  byte target[100];
+  memset(target, (int)'b', 100);
+  slice slice1{0, 50, target};
+  slice slice2{10, 50, &target[50]};
+  auto slices = vector<slice>{slice1, slice2};
+  string key = "key1";
+  asd.partial_get(key, slices);
+
+  byte expected_target[100];
+  memset(expected_target, (int)'a', 100);
+  EXPECT_EQ(0, memcmp(target, expected_target, 100));
+  asd.get_version();
+}
+
+TEST(asd_client, partial_read_io_uring_batch) {
+  // several clients, driven together on this thread's ring
+  const steady_clock::duration timeout = seconds(1);
+  string ip = getenv("ALBA_ASD_IP");
+  string port = "8000";
+  const int n = 4;
+  std::vector<std::unique_ptr<Asd_client>> asds;
+  std::vector<std::vector<alba::asd_client::key_slices>> batches(n);
+  std::vector<std::vector<byte>> targets(n, std::vector<byte>(100, 'b'));
+  std::vector<std::unique_ptr<alba::transport::IOUring_job>> jobs;
+  std::vector<alba::transport::IOUring_job *> job_ptrs;
+  for (int i = 0; i < n; i++) {
+    auto transport = std::unique_ptr<Transport>(
+        new IOUring_transport(ip, port, timeout));
+    asds.emplace_back(
+        new Asd_client(timeout, std::move(transport), boost::none));
+    slice slice1{0, 50, targets[i].data()};
+    slice slice2{10, 50, &targets[i][50]};
+    batches[i].emplace_back("key1", vector<slice>{slice1, slice2});
+    jobs.push_back(asds[i]->partial_get_job(batches[i]));
+    ASSERT_TRUE(jobs.back() != nullptr);
+    job_ptrs.push_back(jobs.back().get());
+  }
+  IOUring_transport::run_batch(job_ptrs);
+
+  std::vector<byte> expected_target(100, 'a');
+  for (int i = 0; i < n; i++) {
+    EXPECT_FALSE(jobs[i]->error);
+    EXPECT_EQ(expected_target, targets[i]);
+    // and the connection is still good for plain calls
+    asds[i]->get_version();
+  }
+}
+
 void _dump_version(std::tuple<int32_t, int32_t, int32_t, std::string> &v) {
   int32_t major = std::get<0>(v);
   int32_t minor = std::get<1>(v);
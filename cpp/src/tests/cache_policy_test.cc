@@ -0,0 +1,158 @@
+/*
+  Copyright (C) iNuron - info@openvstorage.com
+  This file is part of Open vStorage. For license information, see <LICENSE.txt>
+*/
+
+#include "lru_cache.h"
+#include "tinylfu_cache.h"
+#include "gtest/gtest.h"
+#include <cmath>
+#include <iostream>
+#include <random>
+
+using cache_t = ovs::UnsafeWeightedCache<uint64_t, uint64_t>;
+
+namespace {
+// key k is asked for with a probability proportional to 1 / (k + 1)^s
+class zipf {
+public:
+  zipf(uint64_t n, double s) {
+    double sum = 0;
+    for (uint64_t k = 0; k < n; k++) {
+      sum += 1.0 / std::pow(k + 1, s);
+      _cdf.push_back(sum);
+    }
+    for (auto &c : _cdf) {
+      c /= sum;
+    }
+  }
+
+  uint64_t operator()(std::mt19937_64 &rng) {
+    double u = std::uniform_real_distribution<double>(0, 1)(rng);
+    return std::lower_bound(_cdf.begin(), _cdf.end(), u) - _cdf.begin();
+  }
+
+private:
+  std::vector<double> _cdf;
+};
+
+uint64_t weight_of(uint64_t key) { return 1 + (key * 2654435761u) % 64; }
+
+struct trace_result {
+  double hit_ratio;      // of the zipfian lookups
+  double hit_ratio_all; // scans included
+};
+
+/* 10000 keys read along a zipfian distribution, and every 20000 reads
+ * a scan over 5000 keys that are read once and never again */
+trace_result run_trace(cache_t &cache, bool weighted) {
+  std::mt19937_64 rng(42);
+  zipf popularity(10000, 0.99);
+  uint64_t hits = 0, lookups = 0, hits_all = 0, lookups_all = 0;
+  uint64_t next_scan_key = 1 << 20;
+  auto read = [&](uint64_t key, bool count) {
+    bool hit = cache.find(key) != boost::none;
+    if (!hit) {
+      cache.insert(key, key, weighted ? weight_of(key) : 1);
+    }
+    hits_all += hit;
+    lookups_all++;
+    if (count) {
+      hits += hit;
+      lookups++;
+    }
+  };
+  for (int round = 0; round < 20; round++) {
+    for (int i = 0; i < 20000; i++) {
+      read(popularity(rng), true);
+    }
+    for (int i = 0; i < 5000; i++) {
+      read(next_scan_key++, false);
+    }
+  }
+  return trace_result{(double)hits / lookups, (double)hits_all / lookups_all};
+}
+}
+
+TEST(cache_policy, zipf_and_scans) {
+  for (bool weighted : {false, true}) {
+    // 1000 entries, or the weight of about as many
+    size_t max_entries = weighted ? 0 : 1000;
+    size_t max_weight = weighted ? 1000 * 32 : 0;
+    ovs::UnsafeWeightedLRUCache<uint64_t, uint64_t> lru(max_entries,
+                                                        max_weight);
+    ovs::UnsafeWTinyLFUCache<uint64_t, uint64_t> tinylfu(max_entries,
+                                                         max_weight);
+    auto r_lru = run_trace(lru, weighted);
+    auto r_tinylfu = run_trace(tinylfu, weighted);
+    std::cout << (weighted ? "weighted" : "unweighted")
+              << " hit ratio, zipfian reads (all reads): LRU "
+              << r_lru.hit_ratio << " (" << r_lru.hit_ratio_all
+              << "), W-TinyLFU " << r_tinylfu.hit_ratio << " ("
+              << r_tinylfu.hit_ratio_all << ")" << std::endl;
+    EXPECT_GT(r_tinylfu.hit_ratio, r_lru.hit_ratio + 0.05);
+    if (weighted) {
+      EXPECT_LE(lru.weight(), max_weight);
+      EXPECT_LE(tinylfu.weight(), max_weight);
+    } else {
+      EXPECT_LE(lru.size(), max_entries);
+      EXPECT_LE(tinylfu.size(), max_entries);
+    }
+  }
+}
+
+TEST(cache_policy, tinylfu_basics) {
+  ovs::UnsafeWTinyLFUCache<uint64_t, uint64_t> cache(100, 0);
+  for (uint64_t k = 0; k < 100; k++) {
+    cache.insert(k, k * 10, 1);
+  }
+  EXPECT_EQ(100u, cache.size());
+  EXPECT_EQ(70u, *cache.find(7));
+
+  // a popular key survives a scan
+  for (int i = 0; i < 10; i++) {
+    cache.find(7);
+  }
+  for (uint64_t k = 1000; k < 2000; k++) {
+    cache.insert(k, k, 1);
+  }
+  EXPECT_EQ(70u, *cache.find(7));
+  EXPECT_LE(cache.size(), 100u);
+
+  cache.reweigh(7, 70, 5);
+  EXPECT_TRUE(cache.erase(7));
+  EXPECT_FALSE(cache.erase(7));
+  cache.erase_if([](const uint64_t &k) { return k >= 1000; });
+  EXPECT_EQ(cache.size(), cache.weight());
+  cache.set_limits(10, 0);
+  EXPECT_LE(cache.size(), 10u);
+}
+
+TEST(cache_policy, too_heavy) {
+  ovs::UnsafeWeightedLRUCache<uint64_t, uint64_t> lru(0, 100);
+  ovs::UnsafeWTinyLFUCache<uint64_t, uint64_t> tinylfu(0, 100);
+  for (cache_t *cache : std::vector<cache_t *>{&lru, &tinylfu}) {
+    for (uint64_t k = 0; k < 10; k++) {
+      cache->insert(k, k, 5);
+    }
+    size_t size = cache->size();
+    size_t weight = cache->weight();
+    EXPECT_LT(0u, size);
+
+    // one that doesn't fit on its own doesn't push the others out
+    cache->insert(1000, 1000, 1000);
+    EXPECT_FALSE(cache->find(1000));
+    EXPECT_EQ(size, cache->size());
+    EXPECT_EQ(weight, cache->weight());
+
+    // and neither does one that grows too heavy
+    uint64_t k = 9;
+    while (cache->find(k) == boost::none) {
+      k--;
+    }
+    cache->reweigh(k, k, 1000);
+    EXPECT_FALSE(cache->find(k));
+    EXPECT_EQ(size - 1, cache->size());
+    EXPECT_EQ(weight - 5, cache->weight());
+  }
+}
@@ -0,0 +1,117 @@
+/*
+  Copyright (C) iNuron - info@openvstorage.com
+  This file is part of Open vStorage. For license information, see <LICENSE.txt>
+*/
+
+#include "erasure.h"
+#include "gtest/gtest.h"
+#include <iostream>
+#include <vector>
+
+using namespace alba::erasure;
+
+TEST(erasure, region_kernel) {
+  std::cout << "kernel: " << gf_kernel_name() << std::endl;
+  // odd length, so the simd kernels also go through their tail
+  const size_t len = 1000;
+  std::vector<uint8_t> src(len), dst(len), expected(len);
+  for (size_t i = 0; i < len; i++) {
+    src[i] = i * 7 + 3;
+    dst[i] = i * 13;
+  }
+  for (int c = 0; c < 256; c++) {
+    for (size_t i = 0; i < len; i++) {
+      expected[i] = dst[i] ^ gf_mul(c, src[i]);
+    }
+    gf_mul_region_xor(c, src.data(), dst.data(), len);
+    EXPECT_EQ(expected, dst);
+  }
+}
+
+TEST(erasure, rebuild_from_any_k) {
+  // every single missing fragment, from every window of k others
+  const uint32_t k = 4;
+  const uint32_t m = 3;
+  const size_t len = 77;
+  ReedSolomon rs(k, m);
+
+  std::vector<std::vector<uint8_t>> fragments(k + m,
+                                              std::vector<uint8_t>(len));
+  for (uint32_t f = 0; f < k; f++) {
+    for (size_t i = 0; i < len; i++) {
+      fragments[f][i] = (f + 1) * 31 + i;
+    }
+  }
+  std::vector<const uint8_t *> data;
+  std::vector<uint8_t *> parity;
+  for (uint32_t f = 0; f < k; f++) {
+    data.push_back(fragments[f].data());
+  }
+  for (uint32_t f = k; f < k + m; f++) {
+    parity.push_back(fragments[f].data());
+  }
+  rs.encode(data, parity, len);
+
+  // the first parity fragment is the xor of the data (row k is all ones)
+  for (size_t i = 0; i < len; i++) {
+    uint8_t x = 0;
+    for (uint32_t f = 0; f < k; f++) {
+      x ^= fragments[f][i];
+    }
+    EXPECT_EQ(x, fragments[k][i]);
+  }
+
+  for (uint32_t lost = 0; lost < k + m; lost++) {
+    for (uint32_t start = 0; start < k + m; start++) {
+      std::vector<uint32_t> sources;
+      std::vector<const uint8_t *> inputs;
+      for (uint32_t i = 0; sources.size() < k && i < k + m; i++) {
+        uint32_t f = (start + i) % (k + m);
+        if (f != lost) {
+          sources.push_back(f);
+          inputs.push_back(fragments[f].data());
+        }
+      }
+      std::vector<uint8_t> output(len);
+      EXPECT_TRUE(rs.decode(lost, sources, inputs, output.data(), len));
+      EXPECT_EQ(fragments[lost], output);
+    }
+  }
+}
+
+namespace {
+// encoding unit vectors exposes the parity rows of the coding matrix
+std::vector<std::vector<uint8_t>> parity_rows(uint32_t k, uint32_t m) {
+  std::vector<std::vector<uint8_t>> fragments(k + m,
+                                              std::vector<uint8_t>(k, 0));
+  std::vector<const uint8_t *> data;
+  std::vector<uint8_t *> parity;
+  for (uint32_t f = 0; f < k; f++) {
+    fragments[f][f] = 1;
+    data.push_back(fragments[f].data());
+  }
+  for (uint32_t f = k; f < k + m; f++) {
+    parity.push_back(fragments[f].data());
+  }
+  ReedSolomon(k, m).encode(data, parity, k);
+  return std::vector<std::vector<uint8_t>>(fragments.begin() + k,
+                                           fragments.end());
+}
+}
+
+TEST(erasure, jerasure_known_answer) {
+  // rows k.. of jerasure's
+  // reed_sol_big_vandermonde_distribution_matrix(k + m, k, 8),
+  // which is what the ocaml side hands to isa-l
+  std::vector<std::vector<uint8_t>> k8m4{
+      {1, 1, 1, 1, 1, 1, 1, 1},
+      {1, 55, 39, 73, 84, 181, 225, 217},
+      {1, 39, 217, 161, 92, 60, 172, 90},
+      {1, 172, 70, 235, 143, 34, 200, 101}};
+  EXPECT_EQ(k8m4, parity_rows(8, 4));
+
+  std::vector<std::vector<uint8_t>> k5m3{{1, 1, 1, 1, 1},
+                                         {1, 156, 123, 166, 244},
+                                         {1, 166, 82, 245, 167}};
+  EXPECT_EQ(k5m3, parity_rows(5, 3));
+}
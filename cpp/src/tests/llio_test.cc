@@ -3,17 +3,209 @@
   This file is part of Open vStorage. For license information, see <LICENSE.txt>
 */
 
+#include "allocations.h"
 #include "llio.h"
 #include "stuff.h"
 #include "gtest/gtest.h"
 #include <boost/log/trivial.hpp>
 #include <boost/optional.hpp>
+#include <chrono>
 #include <sstream>
 #include <string>
 #include <vector>
 
 using namespace alba::llio;
 
+TEST(llio, message_builder_external) {
+  // the referenced bytes end up where a copy would have put them
+  std::string payload(1000, 'x');
+  message_builder copied;
+  message_builder referenced;
+  for (auto *mb : {&copied, &referenced}) {
+    to(*mb, std::string("name"));
+    if (mb == &copied) {
+      mb->add_raw(payload.data(), payload.size());
+    } else {
+      mb->add_external(payload.data(), payload.size());
+    }
+    to(*mb, (uint32_t)42);
+  }
+  EXPECT_FALSE(copied.has_external());
+  EXPECT_TRUE(referenced.has_external());
+
+  std::ostringstream copied_os;
+  copied.output(copied_os);
+  std::string parts;
+  int n_parts = 0;
+  referenced.output_using([&](const char *b, const int len) {
+    parts.append(b, len);
+    n_parts++;
+  });
+  EXPECT_EQ(copied_os.str(), parts);
+  EXPECT_EQ(3, n_parts);
+  EXPECT_EQ(copied.as_string_no_size(), referenced.as_string_no_size());
+
+  referenced.reset();
+  EXPECT_FALSE(referenced.has_external());
+}
+
+TEST(llio, buffer_pool_steady_state) {
+  // a request/response round trip, as the clients do it
+  auto round_trip = []() {
+    message_builder mb;
+    to(mb, std::string(200, 'x'));
+    to(mb, (uint32_t)42);
+    std::string wire;
+    mb.output_using(
+        [&](const char *b, const int len) { wire.append(b, len); });
+    size_t pos = 0;
+    auto buffer = message_buffer::from_reader([&](char *b, const int len) {
+      memcpy(b, &wire[pos], len);
+      pos += len;
+    });
+    message m(buffer);
+    std::string s;
+    uint32_t i;
+    from(m, s);
+    from(m, i);
+    EXPECT_EQ(42u, i);
+  };
+  for (int i = 0; i < 10; i++) {
+    round_trip();
+  }
+  auto before = alba::llio::pool_stats();
+  for (int i = 0; i < 1000; i++) {
+    round_trip();
+  }
+  auto after = alba::llio::pool_stats();
+  std::cout << after << std::endl;
+  EXPECT_EQ(before.misses, after.misses);
+  EXPECT_LE(before.hits + 2000, after.hits);
+}
+
+TEST(llio, decode_allocations) {
+  message_builder mb;
+  std::vector<uint32_t> sizes;
+  for (uint32_t i = 0; i < 1000; i++) {
+    sizes.push_back(i * 7);
+  }
+  std::vector<std::string> names;
+  for (int i = 0; i < 100; i++) {
+    names.push_back("some_object_name_" + std::to_string(i));
+  }
+  std::string name("a_name_that_does_not_fit_in_sso");
+  to(mb, sizes);
+  to(mb, names);
+  to(mb, name);
+  std::string wire = mb.as_string_no_size();
+  auto buffer = message_buffer::from_string(wire);
+
+  const int n = 1000;
+  std::vector<uint32_t> sizes2;
+  std::vector<std::string> names2;
+  boost::string_ref name2;
+  uint64_t n_sizes = 0, n_names = 0, n_name = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < n; i++) {
+    message m(buffer);
+    std::vector<uint32_t> s;
+    std::vector<std::string> ns;
+    n_sizes += allocations_of([&]() { from(m, s); }).allocations;
+    n_names += allocations_of([&]() { from(m, ns); }).allocations;
+    n_name += allocations_of([&]() { from(m, name2); }).allocations;
+    sizes2 = std::move(s);
+    names2 = std::move(ns);
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  std::cout << "per decode: " << (double)n_sizes / n
+            << " allocations for 1000 uint32_t, " << (double)n_names / n
+            << " for 100 strings, " << (double)n_name / n
+            << " for a string_ref; "
+            << std::chrono::duration<double, std::micro>(t1 - t0).count() / n
+            << "us" << std::endl;
+
+  EXPECT_EQ(sizes, sizes2);
+  EXPECT_EQ(names, names2);
+  EXPECT_EQ(name, name2.to_string());
+  // one for the vector, and one per string for the strings
+  EXPECT_EQ(1u * n, n_sizes);
+  EXPECT_EQ(101u * n, n_names);
+  EXPECT_EQ(0u, n_name);
+}
+
+namespace {
+struct record {
+  uint64_t offset;
+  uint32_t length;
+  bool flag;
+
+  auto wire_fields() const { return std::tie(offset, length, flag); }
+  auto wire_fields() { return std::tie(offset, length, flag); }
+};
+
+struct named_records {
+  std::string name;
+  std::vector<record> records;
+  boost::optional<std::string> extra;
+
+  auto wire_fields() const { return std::tie(name, records, extra); }
+  auto wire_fields() { return std::tie(name, records, extra); }
+};
+}
+
+namespace alba {
+namespace llio {
+template <> void to(message_builder &mb, const record &r) noexcept {
+  to_fields(mb, r);
+}
+template <> void from(message &m, record &r) { from_fields(m, r); }
+template <> void to(message_builder &mb, const named_records &r) noexcept {
+  to_fields(mb, r);
+}
+template <> void from(message &m, named_records &r) { from_fields(m, r); }
+}
+}
+
+TEST(llio, wire_fields) {
+  static_assert(wire_size<record>::value == 13, "fixed size record");
+  static_assert(wire_size<named_records>::value == 0, "variable size record");
+
+  named_records nr;
+  nr.name = "some name";
+  nr.records.push_back(record{1, 2, true});
+  nr.records.push_back(record{(uint64_t)1 << 40, 7, false});
+  nr.extra = std::string("extra");
+
+  // by hand, as the specializations used to be written
+  message_builder expected;
+  to(expected, nr.name);
+  to<uint32_t>(expected, 2);
+  for (auto it = nr.records.rbegin(); it != nr.records.rend(); ++it) {
+    to(expected, it->offset);
+    to(expected, it->length);
+    to(expected, it->flag);
+  }
+  to(expected, nr.extra);
+
+  message_builder mb;
+  to_all(mb, nr);
+  std::string wire = mb.as_string_no_size();
+  EXPECT_EQ(expected.as_string_no_size(), wire);
+  EXPECT_EQ(wire.size(), serialized_size(nr));
+
+  auto buffer = message_buffer::from_string(wire);
+  message m(buffer);
+  named_records nr2;
+  from(m, nr2);
+  EXPECT_EQ(nr.name, nr2.name);
+  ASSERT_EQ(2u, nr2.records.size());
+  EXPECT_EQ((uint64_t)1 << 40, nr2.records[1].offset);
+  EXPECT_EQ(7u, nr2.records[1].length);
+  EXPECT_FALSE(nr2.records[1].flag);
+  EXPECT_TRUE(nr2.records[0].flag);
+  EXPECT_TRUE(nr.extra == nr2.extra);
+}
+
 TEST(llio, composition) {
   message_builder mb;
   std::string my_string("0123456789a");
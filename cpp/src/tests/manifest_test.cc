@@ -0,0 +1,566 @@
+/*
+  Copyright (C) iNuron - info@openvstorage.com
+  This file is part of Open vStorage. For license information, see <LICENSE.txt>
+*/
+
+#include "allocations.h"
+#include "flat_manifest.h"
+#include "manifest_cache.h"
+#include "snappy.h"
+#include "gtest/gtest.h"
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace alba::proxy_protocol;
+
+// a big object: 100 chunks of k=8, m=4, encrypted (so every fragment has a
+// ctr) and with a crc per fragment
+std::unique_ptr<ManifestWithNamespaceId> make_manifest(uint32_t n_chunks = 100,
+                                                       uint32_t k = 8,
+                                                       uint32_t m = 4) {
+  std::unique_ptr<ManifestWithNamespaceId> mf(new ManifestWithNamespaceId());
+  mf->name = "some/fairly/long/object/name/of/a/big/object";
+  mf->object_id = std::string(32, 'i');
+  mf->encoding_scheme = EncodingScheme{k, m, 8};
+  mf->compression.reset(new NoCompression());
+  mf->encrypt_info.reset(new alba::encryption::NoEncryption());
+  mf->checksum.reset(new alba::Crc32c(0x1234));
+  mf->version_id = 3;
+  mf->max_disks_per_node = 1;
+  mf->namespace_id = alba::namespace_t{7};
+  uint64_t size = 0;
+  for (uint32_t c = 0; c < n_chunks; c++) {
+    // the last chunk is a short one
+    uint32_t chunk_size = (c + 1 == n_chunks ? 64 : 1024) * k;
+    mf->chunk_sizes.push_back(chunk_size);
+    size += chunk_size;
+    std::vector<std::shared_ptr<Fragment>> chunk;
+    for (uint32_t f = 0; f < k + m; f++) {
+      auto fragment = std::make_shared<Fragment>();
+      if ((c + f) % 17 != 0) {
+        fragment->loc.first = alba::osd_t{c * 100 + f};
+      }
+      fragment->loc.second = c % 3;
+      fragment->crc = std::make_shared<alba::Crc32c>(c * 1000 + f);
+      fragment->len = chunk_size / k + 16;
+      fragment->ctr = std::string(16, (char)('a' + f));
+      fragment->fnr = std::string(8, '\0');
+      chunk.push_back(fragment);
+    }
+    mf->fragments.push_back(std::move(chunk));
+  }
+  mf->size = size;
+  return mf;
+}
+
+using alba::llio::message_builder;
+using alba::llio::to;
+
+void _to_u8(message_builder &mb, uint8_t b) { mb.add_raw((const char *)&b, 1); }
+
+void _to_small_string(message_builder &mb, const std::string &s) {
+  to(mb, alba::llio::varint_t{s.size()});
+  mb.add_raw(s.data(), s.size());
+}
+
+// a version 2 manifest, as the proxy would send it
+std::unique_ptr<CompressedManifest> compress(const ManifestWithNamespaceId &mf) {
+  message_builder mb;
+  to(mb, mf.name);
+  to(mb, mf.object_id);
+  to(mb, mf.chunk_sizes);
+  _to_u8(mb, 1);
+  _to_u8(mb, 1);
+  to(mb, mf.encoding_scheme.k);
+  to(mb, mf.encoding_scheme.m);
+  _to_u8(mb, mf.encoding_scheme.w);
+  _to_u8(mb, 1); // NoCompression
+  _to_u8(mb, 1); // NoEncryption
+  const alba::Checksum *crc = mf.checksum.get();
+  to(mb, crc);
+  to(mb, mf.size);
+  _to_u8(mb, 1);
+  to(mb, (uint32_t)mf.fragments.size());
+  for (auto c = mf.fragments.rbegin(); c != mf.fragments.rend(); ++c) {
+    to(mb, (uint32_t)c->size());
+    for (auto f = c->rbegin(); f != c->rend(); ++f) {
+      auto &fragment = **f;
+      message_builder fb;
+      _to_u8(fb, 1);
+      to(fb, fragment.loc.first != boost::none);
+      if (fragment.loc.first != boost::none) {
+        to(fb, (uint32_t)fragment.loc.first->i);
+      }
+      to(fb, fragment.loc.second);
+      const alba::Checksum *fcrc = fragment.crc.get();
+      to(fb, fcrc);
+      to(fb, fragment.len);
+      for (auto *o : {&fragment.ctr, &fragment.fnr}) {
+        to(fb, *o != boost::none);
+        if (*o != boost::none) {
+          _to_small_string(fb, **o);
+        }
+      }
+      _to_small_string(mb, fb.as_string_no_size());
+    }
+  }
+  std::string plain = mb.as_string_no_size();
+  std::unique_ptr<CompressedManifest> cmf(new CompressedManifest());
+  cmf->version = 2;
+  snappy::Compress(plain.data(), plain.size(), &cmf->compressed);
+  cmf->namespace_id = mf.namespace_id;
+  return cmf;
+}
+
+TEST(flat_manifest, same_as_manifest) {
+  auto mf = make_manifest();
+  auto flat = std::make_shared<FlatManifest>(std::move(*make_manifest()));
+
+  ASSERT_EQ(mf->fragments.size(), flat->n_chunks());
+  EXPECT_EQ(mf->name, flat->name);
+  EXPECT_EQ(mf->object_id, flat->object_id);
+  EXPECT_EQ(mf->size, flat->size);
+  EXPECT_EQ(mf->size, flat->chunk_offset(flat->n_chunks()));
+  for (uint32_t c = 0; c < flat->n_chunks(); c++) {
+    EXPECT_EQ(mf->chunk_sizes[c], flat->chunk_size(c));
+    ASSERT_EQ(mf->fragments[c].size(), flat->n_fragments(c));
+    for (uint32_t f = 0; f < flat->n_fragments(c); f++) {
+      auto &fragment = *mf->fragments[c][f];
+      auto loc = flat->fragment_location(c, f);
+      EXPECT_EQ(fragment.loc.first == boost::none, loc.first == boost::none);
+      if (loc.first != boost::none) {
+        EXPECT_EQ(fragment.loc.first->i, loc.first->i);
+      }
+      EXPECT_EQ(fragment.loc.second, loc.second);
+      EXPECT_EQ(fragment.len, flat->fragment_length(c, f));
+      EXPECT_TRUE(fragment.ctr == flat->ctr(c, f));
+      EXPECT_TRUE(alba::verify(*fragment.crc, *flat->fragment_checksum(c, f)));
+    }
+  }
+
+  // every fragment boundary of a couple of chunks, and the end
+  for (uint32_t c : {0u, 1u, 50u, 99u}) {
+    uint32_t fragment_length = mf->chunk_sizes[c] / 8;
+    for (uint32_t f = 0; f < 8; f++) {
+      uint64_t pos = flat->chunk_offset(c) + f * fragment_length + 3;
+      Location l = get_location(*flat, pos, 1 << 20);
+      EXPECT_EQ(c, l.chunk_id);
+      EXPECT_EQ(f, l.fragment_id);
+      EXPECT_EQ(3u, l.offset);
+      EXPECT_EQ(fragment_length - 3, l.length);
+      EXPECT_TRUE(mf->fragments[c][f]->ctr == l.ctr);
+    }
+  }
+  Location last = get_location(*flat, mf->size - 1, 10);
+  EXPECT_EQ(99u, last.chunk_id);
+  EXPECT_EQ(7u, last.fragment_id);
+  EXPECT_EQ(1u, last.length);
+}
+
+TEST(flat_manifest, bytes_per_manifest) {
+  const int n = 100;
+  std::vector<std::shared_ptr<ManifestWithNamespaceId>> manifests;
+  std::vector<std::shared_ptr<FlatManifest>> flat_manifests;
+  manifests.reserve(n);
+  flat_manifests.reserve(n);
+
+  auto before = allocations_of([&]() {
+    for (int i = 0; i < n; i++) {
+      manifests.emplace_back(make_manifest().release());
+    }
+  });
+  auto after = allocations_of([&]() {
+    for (int i = 0; i < n; i++) {
+      flat_manifests.push_back(
+          std::make_shared<FlatManifest>(std::move(*make_manifest())));
+    }
+  });
+  std::cout << "bytes per cached manifest (100 chunks x 12 fragments): "
+            << before.live_bytes / n << " => " << after.live_bytes / n
+            << ", memory_size() = " << flat_manifests[0]->memory_size()
+            << std::endl;
+  EXPECT_LT(after.live_bytes * 3, before.live_bytes);
+  // memory_size leaves out the encrypt info
+  EXPECT_LE(flat_manifests[0]->memory_size(), (size_t)after.live_bytes / n);
+}
+
+TEST(flat_manifest, chunk_index) {
+  // uniform chunks (the last one shorter), then irregular ones
+  auto uniform = std::make_shared<FlatManifest>(std::move(*make_manifest()));
+  auto mf = make_manifest(50);
+  for (uint32_t c = 0; c < 50; c++) {
+    mf->chunk_sizes[c] = 8 * (c % 7 + 1);
+  }
+  mf->size = 0;
+  auto irregular = std::make_shared<FlatManifest>(std::move(*mf));
+
+  for (auto *flat : {uniform.get(), irregular.get()}) {
+    uint64_t end = flat->chunk_offset(flat->n_chunks());
+    uint32_t linear = 0;
+    for (uint64_t pos = 0; pos < end; pos++) {
+      while (flat->chunk_offset(linear + 1) <= pos) {
+        linear++;
+      }
+      ASSERT_EQ(linear, flat->chunk_index(pos)) << "pos=" << pos;
+      // the hint doesn't change the outcome
+      EXPECT_EQ(linear, get_location(*flat, pos, 1, 0).chunk_id);
+    }
+  }
+}
+
+TEST(lazy_manifest, decoded_on_demand) {
+  auto mf = make_manifest();
+  auto lazy = std::make_shared<LazyManifest>(mf->name, compress(*mf));
+  EXPECT_FALSE(lazy->decoded());
+  size_t compressed_size = lazy->memory_size();
+
+  auto flat = lazy->get();
+  EXPECT_TRUE(lazy->decoded());
+  // memoized: the second get is the same manifest
+  EXPECT_EQ(flat.get(), lazy->get().get());
+  std::cout << "bytes per cached manifest, compressed: " << compressed_size
+            << ", decoded: " << lazy->memory_size() << std::endl;
+
+  EXPECT_EQ(mf->name, flat->name);
+  EXPECT_EQ(mf->object_id, flat->object_id);
+  EXPECT_EQ(7u, flat->namespace_id.i);
+  EXPECT_EQ(mf->size, flat->size);
+  ASSERT_EQ(mf->fragments.size(), flat->n_chunks());
+  for (uint32_t c = 0; c < flat->n_chunks(); c++) {
+    ASSERT_EQ(mf->fragments[c].size(), flat->n_fragments(c));
+    for (uint32_t f = 0; f < flat->n_fragments(c); f++) {
+      auto &fragment = *mf->fragments[c][f];
+      EXPECT_EQ(fragment.loc.first == boost::none,
+                flat->fragment_location(c, f).first == boost::none);
+      EXPECT_EQ(fragment.len, flat->fragment_length(c, f));
+      EXPECT_TRUE(fragment.ctr == flat->ctr(c, f));
+    }
+  }
+}
+
+TEST(lazy_manifest, cache_drops_what_does_not_decode) {
+  using alba::proxy_client::ManifestCache;
+  auto &cache = ManifestCache::getInstance();
+  const std::string ns("lazy_manifest_test");
+  auto mf = make_manifest(3);
+  auto good = compress(*mf);
+  auto bad = compress(*mf);
+  bad->compressed.resize(bad->compressed.size() / 2);
+
+  cache.add(ns, "alba", std::make_shared<LazyManifest>("good", std::move(good)));
+  cache.add(ns, "alba", std::make_shared<LazyManifest>("bad", std::move(bad)));
+  EXPECT_NE(nullptr, cache.find(ns, "alba", "good"));
+  EXPECT_EQ(nullptr, cache.find(ns, "alba", "bad"));
+  cache.invalidate_namespace(ns);
+}
+
+TEST(manifest_cache, concurrent_lookups) {
+  // one hot namespace, looked up from several threads at once: every lookup
+  // hits, and every thread gets the one decoded manifest per object
+  using alba::proxy_client::ManifestCache;
+  auto &cache = ManifestCache::getInstance();
+  const std::string ns("concurrent_lookups");
+  const int n_objects = 1024;
+  const int n_lookups = 4 * n_objects;
+  const int n_threads = 8;
+  std::vector<std::string> names;
+  for (int i = 0; i < n_objects; i++) {
+    names.push_back("object_" + std::to_string(i));
+    auto mf = make_manifest(1);
+    mf->name = names.back();
+    cache.add(ns, "alba",
+              std::make_shared<LazyManifest>(mf->name, compress(*mf)));
+  }
+
+  std::vector<std::vector<const FlatManifest *>> seen(
+      n_threads, std::vector<const FlatManifest *>(n_objects, nullptr));
+  std::atomic<int> misses(0);
+  std::atomic<int> changed(0);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < n_threads; t++) {
+    threads.emplace_back([&, t]() {
+      for (int i = 0; i < n_lookups; i++) {
+        // 7919 is coprime with n_objects: every thread sees every object
+        int o = (i * 7919 + t) % n_objects;
+        auto mf = cache.find(ns, "alba", names[o]);
+        if (mf == nullptr) {
+          misses++;
+        } else if (seen[t][o] == nullptr) {
+          seen[t][o] = mf.get();
+        } else if (seen[t][o] != mf.get()) {
+          changed++;
+        }
+      }
+    });
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+  EXPECT_EQ(0, misses);
+  EXPECT_EQ(0, changed);
+  for (int o = 0; o < n_objects; o++) {
+    ASSERT_TRUE(seen[0][o] != nullptr);
+    EXPECT_EQ(names[o], seen[0][o]->name);
+    for (int t = 1; t < n_threads; t++) {
+      EXPECT_EQ(seen[0][o], seen[t][o]);
+    }
+  }
+  cache.invalidate_namespace(ns);
+}
+
+TEST(manifest_cache, byte_budget) {
+  using alba::proxy_client::ManifestCache;
+  auto &cache = ManifestCache::getInstance();
+  auto make_lazy = [](const std::string &name) {
+    auto mf = make_manifest(1);
+    mf->name = name;
+    return std::make_shared<LazyManifest>(name, compress(*mf));
+  };
+
+  // the weight follows the entry from compressed to decoded
+  cache.set_capacity(0);
+  size_t before = cache.memory_size();
+  auto one = make_lazy("one");
+  size_t compressed = one->memory_size();
+  cache.add("byte_budget_one", "alba", one);
+  EXPECT_EQ(before + compressed, cache.memory_size());
+  ASSERT_NE(nullptr, cache.find("byte_budget_one", "alba", "one"));
+  EXPECT_EQ(before + one->memory_size(), cache.memory_size());
+  cache.invalidate_namespace("byte_budget_one");
+  EXPECT_EQ(before, cache.memory_size());
+
+  // a cold namespace is pushed out by a hot one
+  size_t budget = 200 * one->memory_size();
+  cache.set_budget(budget);
+  for (int i = 0; i < 1000; i++) {
+    std::string name = "cold_" + std::to_string(i);
+    cache.add("byte_budget_cold", "alba", make_lazy(name));
+    cache.find("byte_budget_cold", "alba", name);
+    EXPECT_LE(cache.memory_size(), budget);
+  }
+  // the cold namespace goes idle, the hot one grows
+  const int n_hot = 64;
+  for (int round = 0; round < 3; round++) {
+    for (int i = 0; i < n_hot; i++) {
+      std::string name = "hot_" + std::to_string(i);
+      if (cache.find("byte_budget_hot", "alba", name) == nullptr) {
+        cache.add("byte_budget_hot", "alba", make_lazy(name));
+        cache.find("byte_budget_hot", "alba", name);
+      }
+    }
+  }
+  std::cout << cache.size() << " manifests in " << cache.memory_size()
+            << " bytes (budget " << budget << ")" << std::endl;
+  EXPECT_LE(cache.memory_size(), budget);
+  for (int i = 0; i < n_hot; i++) {
+    std::string name = "hot_" + std::to_string(i);
+    EXPECT_NE(nullptr, cache.find("byte_budget_hot", "alba", name)) << name;
+  }
+  int n_cold = 0;
+  for (int i = 0; i < 1000; i++) {
+    std::string name = "cold_" + std::to_string(i);
+    n_cold += cache.find("byte_budget_cold", "alba", name) != nullptr;
+  }
+  EXPECT_LE(n_cold + n_hot, 200);
+
+  cache.invalidate_namespace("byte_budget_cold");
+  cache.invalidate_namespace("byte_budget_hot");
+  cache.set_budget(0);
+  cache.set_capacity(10000);
+}
+
+TEST(manifest_cache, policy) {
+  using alba::proxy_client::ManifestCache;
+  using alba::proxy_client::manifest_cache_policy;
+  auto &cache = ManifestCache::getInstance();
+  const std::string ns("manifest_cache_policy");
+  auto mf = make_manifest(1);
+  cache.add(ns, "alba", std::make_shared<LazyManifest>(mf->name, compress(*mf)));
+  ASSERT_NE(nullptr, cache.find(ns, "alba", mf->name));
+
+  // a new policy starts from an empty cache
+  cache.set_policy(manifest_cache_policy::w_tinylfu);
+  EXPECT_EQ(nullptr, cache.find(ns, "alba", mf->name));
+  cache.add(ns, "alba", std::make_shared<LazyManifest>(mf->name, compress(*mf)));
+  EXPECT_NE(nullptr, cache.find(ns, "alba", mf->name));
+
+  cache.set_policy(manifest_cache_policy::lru);
+  cache.invalidate_namespace(ns);
+}
+
+TEST(manifest_store, survives_a_restart) {
+  using alba::proxy_client::ManifestStore;
+  const std::string path =
+      "/tmp/manifest_store_test_" + std::to_string(getpid());
+  unlink(path.c_str());
+  auto mf = make_manifest(10);
+  auto cm = compress(*mf);
+  {
+    ManifestStore store(path, 0);
+    for (int i = 0; i < 10; i++) {
+      store.put(i < 5 ? "ns1" : "ns2", i % 2 ? "alba1" : "alba2",
+                "object_" + std::to_string(i), *cm);
+    }
+    store.drop("ns1", "alba2", "object_0");
+    EXPECT_EQ(9u, store.size());
+    EXPECT_EQ(nullptr, store.get("ns1", "alba2", "object_0"));
+  }
+  {
+    ManifestStore store(path, 0);
+    EXPECT_EQ(9u, store.size());
+    auto found = store.get("ns1", "alba1", "object_1");
+    ASSERT_NE(nullptr, found);
+    ManifestWithNamespaceId decoded;
+    decode(*found, decoded);
+    EXPECT_EQ(mf->name, decoded.name);
+    EXPECT_EQ(mf->size, decoded.size);
+    EXPECT_EQ(cm->compressed, found->compressed);
+
+    store.drop_namespace("ns2");
+    EXPECT_EQ(4u, store.size());
+    store.retain({"alba1"});
+    EXPECT_EQ(2u, store.size());
+  }
+  // a record that was being written when the process died
+  {
+    FILE *f = fopen(path.c_str(), "a");
+    fwrite("\x40\x00\x00\x00garbage", 1, 11, f);
+    fclose(f);
+  }
+  {
+    ManifestStore store(path, 0);
+    EXPECT_EQ(2u, store.size());
+    EXPECT_NE(nullptr, store.get("ns1", "alba1", "object_3"));
+    store.put("ns1", "alba1", "object_11", *cm);
+  }
+  {
+    // only the most recent manifests that fit are kept
+    ManifestStore store(path, 2 * cm->compressed.size());
+    EXPECT_EQ(1u, store.size());
+    EXPECT_NE(nullptr, store.get("ns1", "alba1", "object_11"));
+  }
+  unlink(path.c_str());
+}
+
+TEST(manifest_store, stays_within_its_limit) {
+  using alba::proxy_client::ManifestStore;
+  const std::string path =
+      "/tmp/manifest_store_limit_test_" + std::to_string(getpid());
+  unlink(path.c_str());
+  auto mf = make_manifest(10);
+  auto cm = compress(*mf);
+  auto file_size = [&path]() {
+    struct stat st;
+    EXPECT_EQ(0, stat(path.c_str(), &st));
+    return (size_t)st.st_size;
+  };
+  const size_t max_bytes = 20 * cm->compressed.size();
+  ManifestStore store(path, max_bytes);
+
+  // the same manifest again isn't written again
+  store.put("ns", "alba", "object", *cm);
+  store.flush();
+  size_t once = file_size();
+  store.put("ns", "alba", "object", *cm);
+  store.flush();
+  EXPECT_EQ(once, file_size());
+
+  // a working set bigger than the limit doesn't grow the file without end
+  for (int i = 0; i < 1000; i++) {
+    store.put("ns", "alba", "object_" + std::to_string(i), *cm);
+  }
+  EXPECT_NE(nullptr, store.get("ns", "alba", "object_999"));
+  store.flush();
+  EXPECT_LE(file_size(), 2 * max_bytes);
+  EXPECT_LE(store.size(), 20u);
+  EXPECT_NE(nullptr, store.get("ns", "alba", "object_999"));
+  unlink(path.c_str());
+}
+
+TEST(manifest_store, drops_survive_a_compaction) {
+  using alba::proxy_client::ManifestStore;
+  const std::string path =
+      "/tmp/manifest_store_drop_test_" + std::to_string(getpid());
+  unlink(path.c_str());
+  auto mf = make_manifest(10);
+  auto cm = compress(*mf);
+  const int n = 1000;
+  {
+    // small enough to compact all the time, while the drops come in
+    ManifestStore store(path, 50 * cm->compressed.size());
+    std::thread dropper([&]() {
+      for (int i = 0; i < n; i += 3) {
+        while (store.get("ns", "alba", "object_" + std::to_string(i)) ==
+               nullptr) {
+          std::this_thread::yield();
+        }
+        store.drop("ns", "alba", "object_" + std::to_string(i));
+      }
+    });
+    for (int i = 0; i < n; i++) {
+      store.put("ns", "alba", "object_" + std::to_string(i), *cm);
+      if (i % 3 == 0) {
+        // so the writer doesn't drop the put for being behind
+        store.flush();
+      }
+    }
+    dropper.join();
+    store.flush();
+  }
+  ManifestStore store(path, 0);
+  EXPECT_LT(0u, store.size());
+  for (int i = 0; i < n; i += 3) {
+    EXPECT_EQ(nullptr, store.get("ns", "alba", "object_" + std::to_string(i)));
+  }
+  unlink(path.c_str());
+}
+
+TEST(manifest_cache, single_flight) {
+  using alba::proxy_client::ManifestCache;
+  auto &cache = ManifestCache::getInstance();
+  const std::string ns("manifest_cache_single_flight");
+  auto mf = make_manifest(1);
+  {
+    auto leader = cache.claim_fetch(ns, "alba", mf->name);
+    auto follower = cache.claim_fetch(ns, "alba", mf->name);
+    EXPECT_TRUE(leader.leader());
+    EXPECT_FALSE(follower.leader());
+    EXPECT_TRUE(cache.claim_fetch(ns, "other_alba", mf->name).leader());
+    EXPECT_FALSE(follower.wait(std::chrono::milliseconds(1)));
+  }
+
+  // many threads miss at once, one of them fetches
+  std::atomic<int> fetches{0};
+  std::atomic<int> found{0};
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; t++) {
+    threads.emplace_back([&]() {
+      if (cache.find(ns, "alba", mf->name) != nullptr) {
+        found++;
+        return;
+      }
+      auto claim = cache.claim_fetch(ns, "alba", mf->name);
+      if (!claim.leader() && claim.wait(std::chrono::seconds(10)) &&
+          cache.find(ns, "alba", mf->name) != nullptr) {
+        found++;
+        return;
+      }
+      fetches++;
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+      cache.add(ns, "alba",
+                std::make_shared<LazyManifest>(mf->name, compress(*mf)));
+      found++;
+    });
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+  EXPECT_EQ(1, fetches.load());
+  EXPECT_EQ(8, found.load());
+  EXPECT_TRUE(cache.claim_fetch(ns, "alba", mf->name).leader());
+  cache.invalidate_namespace(ns);
+}
@@ -16,8 +16,11 @@
 #include "manifest_cache.h"
 #include "osd_access.h"
 #include "osd_info.h"
+#include "rora_proxy_client.h"
 
+#include <atomic>
 #include <fstream>
+#include <future>
 #include <iostream>
 
 using std::string;
@@ -54,6 +57,8 @@ struct config {
 
     if (transport == "rdma") {
       TRANSPORT = alba::transport::Kind::rdma;
+    } else if (transport == "io_uring") {
+      TRANSPORT = alba::transport::Kind::io_uring;
     }
     NAMESPACE = "demo";
     WORKSPACE = env_or_default("WORKSPACE", ".");
@@ -142,6 +147,41 @@ TEST(proxy_client, get_object_info) {
   delete checksum;
 }
 
+TEST(proxy_client, get_object_info_cached) {
+  config cfg;
+  boost::optional<alba::proxy_client::RoraConfig> rora_config{100};
+  auto client = make_proxy_client(cfg.HOST, cfg.PORT, TIMEOUT, cfg.TRANSPORT,
+                                  rora_config);
+  boost::optional<std::string> preset{"preset_rora"};
+  std::ostringstream nos;
+  nos << "get_object_info_cached_" << std::rand();
+  string namespace_ = nos.str();
+  client->create_namespace(namespace_, preset);
+  string name("get_object_info_object");
+  string file("./ocaml/alba.native");
+  client->write_object_fs(namespace_, name, file,
+                          proxy_client::allow_overwrite::T, nullptr);
+  client->invalidate_cache(namespace_);
+
+  uint64_t size;
+  alba::Checksum *checksum;
+  std::tie(size, checksum) = client->get_object_info(
+      namespace_, name, proxy_client::consistent_read::T,
+      proxy_client::should_cache::F);
+  // a miss, then a hit in the manifest cache
+  for (int i = 0; i < 2; i++) {
+    uint64_t cached_size;
+    alba::Checksum *cached_checksum;
+    std::tie(cached_size, cached_checksum) = client->get_object_info(
+        namespace_, name, proxy_client::consistent_read::F,
+        proxy_client::should_cache::F);
+    EXPECT_EQ(size, cached_size);
+    EXPECT_TRUE(alba::verify(*checksum, *cached_checksum));
+    delete cached_checksum;
+  }
+  delete checksum;
+}
+
 TEST(proxy_client, get_proxy_version) {
 
   config cfg;
@@ -465,6 +505,67 @@ TEST(proxy_client, test_partial_reads) {
   }
 }
 
+void _partial_reads_async(
+    const std::string &namespace_,
+    const boost::optional<alba::proxy_client::RoraConfig> &rora_config) {
+  config cfg;
+  std::ostringstream sos;
+  sos << "with_manifest" << std::rand();
+  string name = sos.str();
+  using namespace proxy_protocol;
+  auto client = make_proxy_client(cfg.HOST, cfg.PORT, TIMEOUT, cfg.TRANSPORT,
+                                  rora_config);
+  boost::optional<std::string> preset{"preset_rora"};
+  client->create_namespace(namespace_, preset);
+  string file("./ocaml/alba.native");
+  client->write_object_fs(namespace_, name, file,
+                          proxy_client::allow_overwrite::T, nullptr);
+
+  const int n = 16;
+  const uint32_t block_size = 4096;
+  std::vector<byte> buf(n * block_size);
+  std::vector<std::vector<ObjectSlices>> reads;
+  std::vector<alba::statistics::RoraCounter> cntrs(n);
+  std::vector<std::future<void>> futures;
+  std::atomic<int> callbacks(0);
+  for (int i = 0; i < n; i++) {
+    SliceDescriptor sd{&buf[i * block_size], (uint64_t)i * 100000, block_size};
+    std::vector<SliceDescriptor> slices{sd};
+    reads.push_back(std::vector<ObjectSlices>{ObjectSlices{name, slices}});
+  }
+  for (int i = 0; i < n; i++) {
+    futures.push_back(client->read_objects_slices_async(
+        namespace_, reads[i], proxy_client::consistent_read::F, cntrs[i],
+        [&callbacks](std::exception_ptr e) {
+          EXPECT_TRUE(e == nullptr);
+          callbacks++;
+        }));
+  }
+  for (auto &f : futures) {
+    f.get();
+  }
+  EXPECT_EQ(n, callbacks);
+
+  std::ifstream for_comparison(file, std::ios::binary);
+  for (auto &read : reads) {
+    auto &slice = read[0].slices[0];
+    std::vector<byte> bytes2(slice.size);
+    for_comparison.seekg(slice.offset);
+    for_comparison.read((char *)&bytes2[0], slice.size);
+    _compare_blocks(bytes2, slice.buf, 0, slice.size);
+  }
+}
+
+TEST(proxy_client, test_partial_reads_async) {
+  boost::optional<alba::proxy_client::RoraConfig> rora_config{100};
+  _partial_reads_async("test_partial_reads_async", rora_config);
+}
+
+TEST(proxy_client, test_partial_reads_async_queued) {
+  // a plain client sends them one after the other on its one connection
+  _partial_reads_async("test_partial_reads_async_queued", boost::none);
+}
+
 TEST(proxy_client, test_partial_read_full_object) {
   using namespace std;
   config cfg;
@@ -559,12 +660,11 @@ TEST(proxy_client, test_partial_read_full_object) {
     for (auto js_fr = chunk->second.begin(); js_fr != chunk->second.end();
          ++js_fr) {
 
-      auto mf_fr = entry->fragments[chunk_index][fragment_index];
-      int mf_len = mf_fr->len;
+      int mf_len = entry->fragment_length(chunk_index, fragment_index);
       int js_len = js_fr->second.get<int>("len");
 
       ASSERT_EQ(mf_len, js_len);
-      auto mf_loc = mf_fr->loc;
+      auto mf_loc = entry->fragment_location(chunk_index, fragment_index);
       boost::optional<osd_t> mf_osd_o = std::get<0>(mf_loc);
 
       if (boost::none != mf_osd_o) {
@@ -581,7 +681,8 @@ TEST(proxy_client, test_partial_read_full_object) {
       ASSERT_EQ(mf_version, js_version);
 
       // "crc": [ "Crc32c", "0xc1103e5c" ],
-      shared_ptr<Checksum> mf_crc = mf_fr->crc;
+      shared_ptr<Checksum> mf_crc =
+          entry->fragment_checksum(chunk_index, fragment_index);
       alba::algo_t mf_crc_algo = mf_crc->get_algo();
       auto js_crc = js_fr->second.get_child("crc");
 
@@ -612,13 +713,6 @@ TEST(proxy_client, test_partial_read_full_object) {
 
       ASSERT_EQ(mf_digest_s, js_digest);
 
-      //"fnr": "\u0004\u0000\u0000\u0000\u0000\u0000\u0000\u0000"
-      ostringstream mf_fnr_ss;
-      dump_string_option(mf_fnr_ss, mf_fr->fnr);
-
-      auto mf_fnr_s = mf_fnr_ss.str();
-      ALBA_LOG(DEBUG, "mf_fnr =" << mf_fnr_s);
-
       fragment_index++;
     }
     chunk_index++;
@@ -644,6 +738,40 @@ TEST(proxy_client, manifest_cache_eviction) {
   }
 }
 
+TEST(proxy_client, prefetch_manifests) {
+  config cfg;
+  std::ostringstream nos;
+  nos << "prefetch_manifests_" << std::rand();
+  string namespace_ = nos.str();
+  boost::optional<alba::proxy_client::RoraConfig> rora_config{100};
+  auto client = make_proxy_client(cfg.HOST, cfg.PORT, TIMEOUT, cfg.TRANSPORT,
+                                  rora_config);
+  boost::optional<std::string> preset{"preset_rora"};
+  client->create_namespace(namespace_, preset);
+  string file("./ocaml/alba.native");
+  std::vector<string> names;
+  for (int i = 0; i < 5; i++) {
+    names.push_back("object_" + std::to_string(i));
+    client->write_object_fs(namespace_, names.back(), file,
+                            proxy_client::allow_overwrite::T, nullptr);
+  }
+  client->invalidate_cache(namespace_);
+
+  auto alba_id = alba::proxy_client::OsdAccess::getInstance(5, std::chrono::seconds(1))
+                     .get_alba_levels(*client)[0];
+  auto &mfc = alba::proxy_client::ManifestCache::getInstance();
+  for (auto &name : names) {
+    EXPECT_EQ(nullptr, mfc.find(namespace_, alba_id, name));
+  }
+  // one that isn't there doesn't keep the others out
+  auto with_missing = names;
+  with_missing.insert(with_missing.begin() + 2, "no_such_object");
+  client->prefetch_manifests(namespace_, with_missing).get();
+  for (auto &name : names) {
+    EXPECT_NE(nullptr, mfc.find(namespace_, alba_id, name)) << name;
+  }
+}
+
 TEST(proxy_client, test_partial_read_fc) {
   std::string namespace_("test_partial_read_fc");
   std::ostringstream sos;
@@ -892,3 +1020,158 @@ TEST(proxy_client, test_partial_read_broken_fragment_cache) {
   do_read("after purge & claim");
   do_read("after purge & claim bis");
 }
+
+TEST(proxy_client, test_partial_read_unreadable_osd) {
+  // an asd that can't be read for longer than 100 reads: the fast path keeps
+  // rebuilding around it instead of falling back to the proxy
+  auto asd = env_or_default("UNREADABLE_ASD", "");
+  if (asd == "") {
+    ALBA_LOG(WARNING, "skipping test, because UNREADABLE_ASD (a pattern "
+                      "matching one asd process) was not set");
+    return;
+  }
+  string namespace_ =
+      (boost::format("test_partial_read_unreadable_osd_%i") % rand()).str();
+  string name("test_partial_read_unreadable_osd");
+
+  config cfg;
+  boost::optional<alba::proxy_client::RoraConfig> rora_config{1000};
+  auto client = make_proxy_client(cfg.HOST, cfg.PORT, TIMEOUT, cfg.TRANSPORT,
+                                  rora_config);
+  client->create_namespace(namespace_, boost::none);
+  client->write_object_fs(namespace_, name, "./ocaml/alba.native",
+                          proxy_client::allow_overwrite::T, nullptr);
+  uint64_t size;
+  alba::Checksum *checksum;
+  std::tie(size, checksum) = client->get_object_info(
+      namespace_, name, proxy_client::consistent_read::T,
+      proxy_client::should_cache::T);
+  delete checksum;
+
+  // slices all over the object, so some fragment lives on the stopped asd
+  const uint32_t n_slices = 16;
+  const uint32_t slice_size = 4096;
+  std::vector<byte> buf(n_slices * slice_size);
+  std::vector<proxy_protocol::SliceDescriptor> descriptors;
+  for (uint32_t i = 0; i < n_slices; i++) {
+    descriptors.push_back(proxy_protocol::SliceDescriptor{
+        &buf[i * slice_size], i * ((size - slice_size) / n_slices),
+        slice_size});
+  }
+  std::vector<proxy_protocol::ObjectSlices> objects_slices{
+      proxy_protocol::ObjectSlices{name, descriptors}};
+  alba::statistics::RoraCounter warm_up;
+  client->read_objects_slices(namespace_, objects_slices,
+                              proxy_client::consistent_read::F, warm_up);
+
+  stuff::shell("pkill -STOP -f " + asd);
+  alba::statistics::RoraCounter cntr;
+  for (int i = 0; i < 150; i++) {
+    client->read_objects_slices(namespace_, objects_slices,
+                                proxy_client::consistent_read::F, cntr);
+  }
+  stuff::shell("pkill -CONT -f " + asd);
+
+  EXPECT_EQ(0, cntr.slow_path);
+  EXPECT_LT(0u, cntr.degraded);
+}
+
+TEST(rora_proxy_client, rebuilt_reads_are_no_fast_path_failures) {
+  alba::proxy_client::asd_leg_result leg;
+  leg.failed.assign(3, false);
+  // an asd failed, but its fragment was rebuilt
+  leg.rc = -1;
+  leg.degraded = 1;
+  EXPECT_EQ(0, leg.fast_path_rc());
+
+  leg.failed[1] = true;
+  EXPECT_EQ(-1, leg.fast_path_rc());
+  // only disqualified asds
+  leg.rc = -2;
+  EXPECT_EQ(-2, leg.fast_path_rc());
+  // a fragment without a location that couldn't be rebuilt
+  leg.rc = 0;
+  EXPECT_EQ(-1, leg.fast_path_rc());
+}
+
+// hands out a canned response
+class replay_transport : public alba::transport::Transport {
+public:
+  replay_transport(const string &data) : _data(data), _pos(0) {}
+
+  void expires_from_now(const std::chrono::steady_clock::duration &) override {
+  }
+  void write_exact(const char *, int) override {}
+  void read_exact(char *buf, int len) override {
+    if (_pos + len > _data.size()) {
+      throw alba::transport::transport_exception("replay: eof");
+    }
+    memcpy(buf, &_data[_pos], len);
+    _pos += len;
+  }
+
+  bool done() const { return _pos == _data.size(); }
+
+private:
+  string _data;
+  size_t _pos;
+};
+
+string _canned_response(alba::llio::message_builder &mb) {
+  std::ostringstream os;
+  mb.output(os);
+  return os.str();
+}
+
+TEST(proxy_protocol, read_objects_slices_streaming) {
+  using namespace alba::proxy_protocol;
+  string data = "0123456789abcdef";
+  string name = "object";
+  byte target[16];
+  memset(target, 0, 16);
+  std::vector<ObjectSlices> objects_slices{
+      ObjectSlices{name, {SliceDescriptor{target, 0, 10},
+                          SliceDescriptor{&target[10], 10, 6}}}};
+
+  alba::llio::message_builder mb;
+  alba::llio::to(mb, (uint32_t)0);
+  alba::llio::to(mb, (uint32_t)data.size());
+  mb.add_raw(data.data(), data.size());
+  // no object infos
+  alba::llio::to(mb, (uint32_t)0);
+  auto response = _canned_response(mb);
+
+  replay_transport t1(response);
+  Status status;
+  std::vector<object_info> object_infos;
+  read_read_objects_slices2_response(t1, status, objects_slices,
+                                     object_infos);
+  EXPECT_TRUE(status.is_ok());
+  EXPECT_EQ(0, memcmp(data.data(), target, 16));
+  EXPECT_EQ(0u, object_infos.size());
+  EXPECT_TRUE(t1.done());
+
+  // the version without object infos skips them
+  memset(target, 0, 16);
+  replay_transport t2(response);
+  read_read_objects_slices_response(t2, status, objects_slices);
+  EXPECT_EQ(0, memcmp(data.data(), target, 16));
+  EXPECT_TRUE(t2.done());
+
+  mb.reset();
+  alba::llio::to(mb, (uint32_t)1);
+  alba::llio::to(mb, string("oops"));
+  replay_transport t3(_canned_response(mb));
+  read_read_objects_slices2_response(t3, status, objects_slices,
+                                     object_infos);
+  EXPECT_FALSE(status.is_ok());
+  EXPECT_EQ("oops", status._what);
+  EXPECT_TRUE(t3.done());
+
+  // ok, but too short to hold the data size
+  string short_response("\x06\0\0\0\0\0\0\0ab", 10);
+  replay_transport t4(short_response);
+  EXPECT_THROW(read_read_objects_slices_response(t4, status, objects_slices),
+               alba::llio::deserialisation_exception);
+  EXPECT_TRUE(t4.done());
+}